@@ -0,0 +1,110 @@
+#!/bin/sh
+# Copyright (c) 2017-2018 Two Sigma Open Source, LLC.
+# All Rights Reserved
+#
+# Distributed under the terms of the 2-clause BSD License. The full
+# license is in the file LICENSE, distributed as part of this software.
+
+# Compare the event queues of the subscriber on the same traffic. For each
+# event queue, msub listens on the given number of endpoints while mpub
+# publishes over the loopback to a subset of them, and the processor time per
+# datagram, the wakeups of the event queue and the latency are reported. A list
+# of coalescing intervals traces the trade-off between processor time and
+# latency of the throughput mode.
+#
+# Usage: bench/event-backends.sh [-c CNT] [-s DUR] [-n EPS] [-a ACT]
+#                                [-e LIST] [-t LIST] IFACE
+#   -c CNT   rounds published to each active endpoint (def=10000)
+#   -s DUR   sleep between the rounds (def=100us)
+#   -n EPS   endpoints of the subscriber (def=16)
+#   -a ACT   endpoints that receive traffic (def=16)
+#   -e LIST  event queues to compare (def=all compiled in)
+#   -t LIST  coalescing intervals, where 0 disables coalescing (def=0)
+
+BIN=${BIN:-$(dirname "$0")/../bin}
+CNT=10000
+DUR=100us
+EPS=16
+ACT=16
+QUEUES=""
+COALESCE=0
+
+while getopts "c:s:n:a:e:t:" opt; do
+  case $opt in
+    c) CNT=$OPTARG ;;
+    s) DUR=$OPTARG ;;
+    n) EPS=$OPTARG ;;
+    a) ACT=$OPTARG ;;
+    e) QUEUES=$OPTARG ;;
+    t) COALESCE=$OPTARG ;;
+    *) exit 1 ;;
+  esac
+done
+shift $((OPTIND - 1))
+
+if [ $# -ne 1 ]; then
+  echo "Usage: $0 [-c CNT] [-s DUR] [-n EPS] [-a ACT] [-e LIST] [-t LIST]" \
+       "IFACE" >&2
+  exit 1
+fi
+IFACE=$1
+
+if [ "$ACT" -gt "$EPS" ]; then
+  ACT=$EPS
+fi
+
+# Endpoints of the subscriber and of the publisher.
+ALL=""
+PUB=""
+i=0
+while [ $i -lt "$EPS" ]; do
+  ep="$IFACE=239.195.$((i / 250)).$((i % 250 + 1))"
+  ALL="$ALL $ep"
+  if [ $i -lt "$ACT" ]; then
+    PUB="$PUB $ep"
+  fi
+  i=$((i + 1))
+done
+
+# Event queues compiled in for the platform, as listed in the usage.
+if [ -z "$QUEUES" ]; then
+  QUEUES=$("$BIN/msub" -h 2>&1 \
+    | sed -n 's/.*Event queue: \(.*\)\. (def=.*/\1/p' | tr -d ',')
+fi
+
+LOG=$(mktemp)
+trap 'rm -f "$LOG"' EXIT
+
+printf "%-8s %9s %10s %8s %10s %12s %10s %10s\n" \
+  "Backend" "Coalesce" "Datagrams" "Lost" "Wakeups" "CPU/dgram" "p50" "p99"
+
+for eq in $QUEUES; do
+  for tc in $COALESCE; do
+    opts="--event-backend $eq"
+    if [ "$tc" != "0" ]; then
+      opts="$opts --coalesce $tc"
+    fi
+
+    # shellcheck disable=SC2086
+    "$BIN/msub" -v -n $opts $ALL > /dev/null 2> "$LOG" &
+    sub=$!
+    sleep 1
+
+    # shellcheck disable=SC2086
+    "$BIN/mpub" -l -c "$CNT" -s "$DUR" $PUB 2> /dev/null
+    sleep 1
+
+    kill -INT $sub
+    wait $sub
+
+    # Fields of the final reports of the subscriber.
+    awk -v eq="$eq" -v tc="$tc" '
+      /Total:/     { recv = $(NF-9); lost = $(NF-5) }
+      /Processor:/ { cpu = $(NF-10); wake = $(NF-6) }
+      /Latency:/   { p50 = $(NF-7); p99 = $(NF-4) }
+      END {
+        printf "%-8s %9s %10s %8s %10s %9s ns %7s ns %7s ns\n",
+               eq, tc, recv, lost, wake, cpu, p50, p99
+      }' "$LOG"
+  done
+done
@@ -20,6 +20,8 @@
 #include <string.h>
 #include <errno.h>
 #include <err.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <inttypes.h>
 
 #include "common.h"
@@ -33,6 +35,9 @@ uint8_t ncol; ///< Colouring policy.
 /// Hostname.
 char hname[HNAME_LEN];
 
+/// Path of the process ID file.
+static char pidpath[PATH_MAX];
+
 /// Free memory used for endpoint storage.
 ///
 /// @param[in] eps endpoint list
@@ -49,6 +54,7 @@ free_endpoints(endpoint* eps)
   while (ep != NULL) {
     tofree = ep;
     ep = ep->ep_next;
+    free(tofree->ep_pids);
     free(tofree);
   }
 }
@@ -72,6 +78,119 @@ cache_hostname(void)
   return true;
 }
 
+/// Detach the process from the controlling terminal and continue running in
+/// the background. The standard input is redirected to /dev/null, while the
+/// standard error stream is redirected to the log file (if any). The standard
+/// output is retained, unless it refers to a terminal. The working directory
+/// is not changed, so that relative paths of output files remain valid.
+/// @return status code
+///
+/// @param[in] log path to the log file (can be NULL)
+bool
+daemonize(const char* log)
+{
+  int nullfd;
+  int logfd;
+  pid_t pid;
+
+  notify(NL_DEBUG, false, "Detaching from the controlling terminal");
+
+  // Open the files before detaching, so that errors can still be reported to
+  // the terminal.
+  nullfd = open("/dev/null", O_RDWR);
+  if (nullfd == -1) {
+    notify(NL_ERROR, true, "Unable to open %s", "/dev/null");
+    return false;
+  }
+
+  logfd = nullfd;
+  if (log != NULL) {
+    logfd = open(log, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (logfd == -1) {
+      notify(NL_ERROR, true, "Unable to open log file %s", log);
+      close(nullfd);
+      return false;
+    }
+  }
+
+  // Ensure that no buffered output is duplicated by the child process.
+  fflush(stdout);
+  fflush(stderr);
+
+  pid = fork();
+  if (pid == -1) {
+    notify(NL_ERROR, true, "Unable to fork the process");
+    return false;
+  }
+
+  // Terminate the parent process.
+  if (pid != 0)
+    _exit(EXIT_SUCCESS);
+
+  // Start a new session without a controlling terminal.
+  if (setsid() == -1) {
+    notify(NL_ERROR, true, "Unable to start a new session");
+    return false;
+  }
+
+  // Redirect the standard streams.
+  if (isatty(STDOUT_FILENO))
+    dup2(nullfd, STDOUT_FILENO);
+  dup2(nullfd, STDIN_FILENO);
+  dup2(logfd, STDERR_FILENO);
+
+  if (logfd != nullfd)
+    close(logfd);
+  close(nullfd);
+
+  // Colors have no use in a log file.
+  ncol = 0;
+
+  notify(NL_INFO, false, "Running in the background with process ID %" PRIiMAX,
+         (intmax_t)getpid());
+  return true;
+}
+
+/// Create the process ID file.
+/// @return status code
+///
+/// @param[in] path path to the file
+bool
+create_pidfile(const char* path)
+{
+  FILE* file;
+
+  file = fopen(path, "w");
+  if (file == NULL) {
+    notify(NL_ERROR, true, "Unable to create process ID file %s", path);
+    return false;
+  }
+
+  fprintf(file, "%" PRIiMAX "\n", (intmax_t)getpid());
+  if (fclose(file) != 0) {
+    notify(NL_ERROR, true, "Unable to write process ID file %s", path);
+    return false;
+  }
+
+  // Remember the path, so that the file can be removed upon exit.
+  strncpy(pidpath, path, sizeof(pidpath) - 1);
+
+  return true;
+}
+
+/// Remove the process ID file, if one was created.
+void
+remove_pidfile(void)
+{
+  if (pidpath[0] == '\0')
+    return;
+
+  if (unlink(pidpath) == -1)
+    notify(NL_WARN, true, "Unable to remove process ID file %s", pidpath);
+
+  pidpath[0] = '\0';
+}
+
 /// Convert time in only nanoseconds into seconds and nanoseconds.
 ///
 /// @param[out] tv seconds and nanoseconds
@@ -125,6 +244,36 @@ ntohll(const uint64_t x)
   return (uint64_t)ntohl(lo) | ((uint64_t)ntohl(hi) << 32);
 }
 
+/// Derive the publisher ID from the identity of the publisher. The ID is
+/// computed by both the publisher and the subscriber, therefore it does not
+/// depend on the byte order of the host.
+/// @return publisher ID
+///
+/// @param[in] key   publisher key
+/// @param[in] iname publisher's interface name
+/// @param[in] hname publisher's hostname
+uint64_t
+publisher_id(const uint64_t key, const char* iname, const char* hname)
+{
+  uint64_t h;
+  size_t i;
+
+  h = FNV_OFFSET;
+  for (i = 0; i < sizeof(key); i++)
+    h = (h ^ ((key >> (i * 8)) & 0xff)) * FNV_PRIME;
+
+  for (i = 0; i < INAME_LEN && iname[i] != '\0'; i++)
+    h = (h ^ (unsigned char)iname[i]) * FNV_PRIME;
+
+  // Separate the names, so that their boundary is part of the identity.
+  h = (h ^ 0xff) * FNV_PRIME;
+
+  for (i = 0; i < HNAME_LEN && hname[i] != '\0'; i++)
+    h = (h ^ (unsigned char)hname[i]) * FNV_PRIME;
+
+  return h;
+}
+
 /// Add ASCII escape sequences to highlight every substitution in a
 /// printf-formatted string.
 ///
@@ -136,7 +285,7 @@ highlight(char* out, const char* inp)
   char* pcent;
   char* delim;
   char* str;
-  char cpy[128];
+  char cpy[NOTIFY_LEN];
   char hold;
 
   // As the input string is likely to be a compiler literal, and therefore
@@ -195,8 +344,8 @@ void
 notify(const uint8_t lvl, const bool perr, const char* fmt, ...)
 {
   char tstr[32];
-  char hfmt[128];
-  char msg[128];
+  char hfmt[NOTIFY_LEN];
+  char msg[NOTIFY_LEN];
   char errmsg[128];
   struct tm* tfmt;
   struct timespec tspec;
@@ -227,7 +376,7 @@ notify(const uint8_t lvl, const bool perr, const char* fmt, ...)
 
   // Fill in the passed message.
   va_start(args, fmt);
-  vsprintf(msg, hfmt, args);
+  vsnprintf(msg, sizeof(msg), hfmt, args);
   va_end(args);
 
   // Obtain the errno message.
@@ -30,7 +30,16 @@ extern char hname[HNAME_LEN];
 
 // Payload-related constants.
 #define MBEAT_PAYLOAD_MAGIC   0x6d626974
-#define MBEAT_PAYLOAD_VERSION          4
+#define MBEAT_PAYLOAD_VERSION          5
+#define MBEAT_PAYLOAD_FULL             4 // Version with names in each payload.
+
+// Datagram types of the compact payload format.
+#define MBEAT_TYPE_DATA     0 // Heartbeat.
+#define MBEAT_TYPE_ANNOUNCE 1 // Names of a publisher.
+
+// FNV-1a hashing constants.
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+#define FNV_PRIME  0x100000001b3ULL
 
 // Notification levels.
 #define NL_ERROR 0 // Error.
@@ -39,6 +48,9 @@ extern char hname[HNAME_LEN];
 #define NL_DEBUG 3 // Debug.
 #define NL_TRACE 4 // Tracing.
 
+// Maximal length of a notification message.
+#define NOTIFY_LEN 512
+
 // Maximal number of allowed endpoints. It is not clear yet what this number
 // should be, but given the availability of specifying IP-address ranges, this
 // number must cover a small number of /8 subnets. The current constant is
@@ -47,10 +59,14 @@ extern char hname[HNAME_LEN];
 
 void free_endpoints(endpoint* eps);
 bool cache_hostname(void);
+bool daemonize(const char* log);
+bool create_pidfile(const char* path);
+void remove_pidfile(void);
 void from_nanos(struct timespec* tv, const uint64_t ns);
 void to_nanos(uint64_t* ns, const struct timespec tv);
 uint64_t htonll(const uint64_t x);
 uint64_t ntohll(const uint64_t x);
+uint64_t publisher_id(const uint64_t key, const char* iname, const char* hname);
 void notify(const uint8_t lvl, const bool perr, const char* msg, ...);
 
 #endif
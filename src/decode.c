@@ -0,0 +1,234 @@
+// Copyright (c) 2017-2018 Two Sigma Open Source, LLC.
+// All Rights Reserved
+//
+// Distributed under the terms of the 2-clause BSD License. The full
+// license is in the file LICENSE, distributed as part of this software.
+
+#include "platform.h"
+
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(MBEAT_HAVE_SSSE3)
+  #include <tmmintrin.h>
+#endif
+
+#include "decode.h"
+#include "common.h"
+
+
+/// Conversion of an array of 64-bit integers to the host byte order.
+typedef void (*swap_fn)(uint64_t* val, const size_t cnt);
+
+/// Selected conversion method.
+static swap_fn swap64 = NULL;
+
+/// Convert 64-bit integers to the host byte order one at a time.
+///
+/// @param[in,out] val integers
+/// @param[in]     cnt number of integers
+static void
+swap64_scalar(uint64_t* val, const size_t cnt)
+{
+  size_t i;
+
+  for (i = 0; i < cnt; i++)
+    val[i] = ntohll(val[i]);
+}
+
+#if defined(MBEAT_HAVE_SSSE3)
+
+/// Convert 64-bit integers to the host byte order two at a time with a single
+/// shuffle. Like the ntohll() function, the shuffle reverses the bytes within
+/// each 32-bit half of the integer.
+///
+/// @param[in,out] val integers
+/// @param[in]     cnt number of integers
+__attribute__((target("ssse3")))
+static void
+swap64_ssse3(uint64_t* val, const size_t cnt)
+{
+  __m128i mask;
+  __m128i x;
+  size_t i;
+
+  mask = _mm_set_epi8(12, 13, 14, 15, 8, 9, 10, 11,
+                       4,  5,  6,  7, 0, 1,  2,  3);
+
+  for (i = 0; i + 2 <= cnt; i += 2) {
+    x = _mm_loadu_si128((const __m128i*)(val + i));
+    _mm_storeu_si128((__m128i*)(val + i), _mm_shuffle_epi8(x, mask));
+  }
+
+  if (i < cnt)
+    val[i] = ntohll(val[i]);
+}
+
+#endif
+
+/// Select the byte order conversion supported by the processor.
+void
+decode_init(void)
+{
+  swap64 = swap64_scalar;
+
+#if defined(MBEAT_HAVE_SSSE3)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("ssse3"))
+    swap64 = swap64_ssse3;
+#endif
+}
+
+/// Name of the selected byte order conversion.
+/// @return method name
+const char*
+decode_method(void)
+{
+#if defined(MBEAT_HAVE_SSSE3)
+  if (swap64 == swap64_ssse3)
+    return "ssse3";
+#endif
+
+  return "scalar";
+}
+
+/// Verify the datagram suitability.
+/// @return decision
+///
+/// @param[in]  dg  datagram in the network byte order
+/// @param[in]  nbs number of received bytes
+/// @param[in]  flg flags of the received message
+/// @param[out] len datagram length including padding
+static bool
+verify_datagram(const datagram* dg,
+                const size_t nbs,
+                const int flg,
+                size_t* len)
+{
+  size_t hdr;
+  size_t exp;
+
+  // Verify that the common header was received.
+  if (nbs < sizeof(dg->dg_cp)) {
+    notify(NL_WARN, false, "Payload too short, expected: %zu, got: %zu",
+           sizeof(dg->dg_cp), nbs);
+    return false;
+  }
+
+  // Verify the magic number of the payload.
+  if (ntohl(dg->dg_pl.pl_magic) != MBEAT_PAYLOAD_MAGIC) {
+    notify(NL_WARN, false,
+           "Payload magic number invalid, expected: %u, got: %u",
+           MBEAT_PAYLOAD_MAGIC, ntohl(dg->dg_pl.pl_magic));
+    return false;
+  }
+
+  // Select the payload size of the format version.
+  if (dg->dg_pl.pl_fver == MBEAT_PAYLOAD_FULL) {
+    hdr = sizeof(dg->dg_pl);
+    exp = ntohl(dg->dg_pl.pl_plen);
+  } else if (dg->dg_pl.pl_fver == MBEAT_PAYLOAD_VERSION) {
+    hdr = dg->dg_cp.cp_type == MBEAT_TYPE_ANNOUNCE ? sizeof(dg->dg_an)
+                                                   : sizeof(dg->dg_cp);
+    exp = ntohs(dg->dg_cp.cp_plen);
+  } else {
+    notify(NL_WARN, false,
+           "Unsupported payload version, expected: %u or %u, got: %u",
+           MBEAT_PAYLOAD_FULL, MBEAT_PAYLOAD_VERSION, dg->dg_pl.pl_fver);
+    return false;
+  }
+
+  // Verify that the whole payload was received.
+  if (nbs < hdr) {
+    notify(NL_WARN, false, "Payload too short, expected: %zu, got: %zu",
+           hdr, nbs);
+    return false;
+  }
+
+  // Verify the datagram length announced by the publisher. Only the payload
+  // is copied from the socket, so that the padding does not have to be read.
+  // Platforms that do not report the full length of truncated datagrams are
+  // trusted to have received the announced length.
+  if (exp == 0)
+    exp = hdr;
+  if (nbs != exp
+   && !((flg & MSG_TRUNC) && nbs == sizeof(*dg) && exp > sizeof(*dg))) {
+    notify(NL_WARN, false, "Wrong datagram size, expected: %zu, got: %zu",
+           exp, nbs);
+    return false;
+  }
+
+  *len = exp;
+  return true;
+}
+
+/// Convert all integers of a verified datagram to the host byte order. The
+/// 64-bit integers of each format are contiguous.
+///
+/// @param[in,out] dg datagram
+static void
+convert_datagram(datagram* dg)
+{
+  if (dg->dg_pl.pl_fver == MBEAT_PAYLOAD_FULL) {
+    dg->dg_pl.pl_magic = ntohl(dg->dg_pl.pl_magic);
+    dg->dg_pl.pl_mport = ntohs(dg->dg_pl.pl_mport);
+    dg->dg_pl.pl_maddr = ntohl(dg->dg_pl.pl_maddr);
+    dg->dg_pl.pl_plen  = ntohl(dg->dg_pl.pl_plen);
+    swap64(&dg->dg_pl.pl_rtime, 5);
+    return;
+  }
+
+  // Announcements share the header with the compact payload.
+  dg->dg_cp.cp_magic = ntohl(dg->dg_cp.cp_magic);
+  dg->dg_cp.cp_mport = ntohs(dg->dg_cp.cp_mport);
+  dg->dg_cp.cp_maddr = ntohl(dg->dg_cp.cp_maddr);
+  dg->dg_cp.cp_plen  = ntohs(dg->dg_cp.cp_plen);
+
+  if (dg->dg_cp.cp_type == MBEAT_TYPE_ANNOUNCE)
+    swap64(&dg->dg_an.an_pid, 2);
+  else
+    swap64(&dg->dg_cp.cp_pid, 7);
+}
+
+/// Verify all datagrams of a batch, compact the invalid ones out of it and
+/// convert the valid ones to the host byte order.
+/// @return number of valid datagrams
+///
+/// @param[in,out] rb batch
+size_t
+decode_batch(rx_batch* rb)
+{
+  size_t i;
+  size_t n;
+
+  n = 0;
+  for (i = 0; i < rb->rb_cnt; i++) {
+    if (!verify_datagram(&rb->rb_dg[i], rb->rb_nbs[i], rb->rb_flg[i],
+                         &rb->rb_len[i]))
+      continue;
+
+    // Move the datagram over the invalid ones preceding it.
+    if (n != i) {
+      memcpy(&rb->rb_dg[n], &rb->rb_dg[i], rb->rb_nbs[i] < sizeof(datagram)
+                                           ? rb->rb_nbs[i] : sizeof(datagram));
+      rb->rb_nbs[n] = rb->rb_nbs[i];
+      rb->rb_len[n] = rb->rb_len[i];
+      rb->rb_flg[n] = rb->rb_flg[i];
+      rb->rb_ttl[n] = rb->rb_ttl[i];
+    }
+
+    convert_datagram(&rb->rb_dg[n]);
+    n++;
+  }
+
+  rb->rb_cnt = n;
+  return n;
+}
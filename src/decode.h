@@ -0,0 +1,37 @@
+// Copyright (c) 2017-2018 Two Sigma Open Source, LLC.
+// All Rights Reserved
+//
+// Distributed under the terms of the 2-clause BSD License. The full
+// license is in the file LICENSE, distributed as part of this software.
+
+#ifndef MBEAT_DECODE_H
+#define MBEAT_DECODE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "platform.h"
+#include "types.h"
+
+
+// Maximal number of datagrams received and decoded as a batch.
+#define DECODE_BATCH 32
+
+/// Batch of received datagrams. The decode stage verifies the datagrams,
+/// compacts the invalid ones out of the batch and converts the valid ones to
+/// the host byte order in place.
+typedef struct _rx_batch {
+  datagram rb_dg[DECODE_BATCH];  ///< Received datagrams.
+  size_t   rb_nbs[DECODE_BATCH]; ///< Number of received bytes.
+  size_t   rb_len[DECODE_BATCH]; ///< Datagram length including padding.
+  int      rb_flg[DECODE_BATCH]; ///< Flags of the received message.
+  int      rb_ttl[DECODE_BATCH]; ///< Time-To-Live value upon arrival.
+  size_t   rb_cnt;               ///< Number of datagrams.
+} rx_batch;
+
+void        decode_init(void);
+const char* decode_method(void);
+size_t      decode_batch(rx_batch* rb);
+
+#endif
@@ -0,0 +1,663 @@
+// Copyright (c) 2017-2018 Two Sigma Open Source, LLC.
+// All Rights Reserved
+//
+// Distributed under the terms of the 2-clause BSD License. The full
+// license is in the file LICENSE, distributed as part of this software.
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+
+#include "flow.h"
+#include "common.h"
+#include "tune.h"
+
+
+/// Find the position of the most significant set bit.
+/// @return bit position
+///
+/// @param[in] x non-zero integer
+static unsigned int
+msb(uint64_t x)
+{
+#if defined(__GNUC__)
+  return 63 - (unsigned int)__builtin_clzll(x);
+#else
+  unsigned int r;
+
+  r = 0;
+  while (x >>= 1)
+    r++;
+
+  return r;
+#endif
+}
+
+/// Record a value in the histogram.
+///
+/// @param[in] hg  histogram
+/// @param[in] val value
+void
+hist_add(histogram* hg, const uint64_t val)
+{
+  unsigned int e;
+  unsigned int idx;
+
+  if (val < HIST_SUB) {
+    idx = (unsigned int)val;
+  } else {
+    e = msb(val);
+    idx = (e - HIST_SUB_BITS + 1) * HIST_SUB
+        + (unsigned int)((val >> (e - HIST_SUB_BITS)) & (HIST_SUB - 1));
+  }
+
+  hg->hg_cnt[idx]++;
+  hg->hg_sum++;
+  if (val > hg->hg_max)
+    hg->hg_max = val;
+}
+
+/// Halve all counters of the histogram, so that older values gradually lose
+/// their weight and the counters never overflow.
+///
+/// @param[in] hg histogram
+void
+hist_decay(histogram* hg)
+{
+  unsigned int i;
+
+  hg->hg_sum = 0;
+  for (i = 0; i < HIST_LEN; i++) {
+    hg->hg_cnt[i] >>= 1;
+    hg->hg_sum += hg->hg_cnt[i];
+  }
+}
+
+/// Compute the upper bound of the bucket that contains the percentile.
+/// @return percentile value
+///
+/// @param[in] hg  histogram
+/// @param[in] pct percentile (0..100)
+uint64_t
+hist_percentile(const histogram* hg, const double pct)
+{
+  uint64_t rank;
+  uint64_t acc;
+  uint64_t val;
+  unsigned int i;
+  unsigned int e;
+
+  if (hg->hg_sum == 0)
+    return 0;
+
+  rank = (uint64_t)((double)hg->hg_sum * pct / 100.0);
+  if (rank >= hg->hg_sum)
+    rank = hg->hg_sum - 1;
+
+  acc = 0;
+  for (i = 0; i < HIST_LEN; i++) {
+    acc += hg->hg_cnt[i];
+    if (acc > rank)
+      break;
+  }
+
+  if (i < HIST_SUB)
+    return i;
+
+  // Report the upper bound of the bucket, but never more than the maximum.
+  e = i / HIST_SUB + HIST_SUB_BITS - 1;
+  val = (((uint64_t)(HIST_SUB + i % HIST_SUB) + 1) << (e - HIST_SUB_BITS)) - 1;
+  return val < hg->hg_max ? val : hg->hg_max;
+}
+
+/// Compute the hash of the flow identity.
+/// @return hash
+///
+/// @param[in] ep  endpoint
+/// @param[in] pid publisher ID
+static uint64_t
+flow_hash(const endpoint* ep, const uint64_t pid)
+{
+  uint64_t h;
+  uintptr_t ptr;
+  size_t i;
+
+  h = FNV_OFFSET;
+  ptr = (uintptr_t)ep;
+  for (i = 0; i < sizeof(ptr); i++)
+    h = (h ^ ((ptr >> (i * 8)) & 0xff)) * FNV_PRIME;
+
+  for (i = 0; i < sizeof(pid); i++)
+    h = (h ^ ((pid >> (i * 8)) & 0xff)) * FNV_PRIME;
+
+  return h;
+}
+
+/// Allocate the flow table with a fixed capacity.
+/// @return status code
+///
+/// @param[out] ft   flow table
+/// @param[in]  cap  maximal number of flows
+/// @param[in]  idle idle duration after which flows are evicted (0 = never)
+/// @param[in]  huge back the pool with huge pages
+bool
+flow_table_init(flow_table* ft,
+                const uint64_t cap,
+                const uint64_t idle,
+                const bool huge)
+{
+  uint64_t i;
+
+  memset(ft, 0, sizeof(*ft));
+  ft->ft_cap  = cap;
+  ft->ft_idle = idle;
+
+  // Use at least twice as many buckets as flows to keep the chains short.
+  ft->ft_nbkts = 1;
+  while (ft->ft_nbkts < cap * 2)
+    ft->ft_nbkts <<= 1;
+
+  // The pool is allocated at once, so that the memory usage is bounded. Pages
+  // that are never touched do not contribute to the resident memory.
+  ft->ft_pool = calloc(cap, sizeof(flow));
+  ft->ft_bkts = calloc(ft->ft_nbkts, sizeof(flow*));
+  if (ft->ft_pool == NULL || ft->ft_bkts == NULL) {
+    notify(NL_ERROR, true, "Unable to allocate memory for %" PRIu64 " flows",
+           cap);
+    flow_table_free(ft);
+    return false;
+  }
+
+  // The advice only takes effect before the free list touches the pool.
+  if (huge)
+    tune_advise(ft->ft_pool, cap * sizeof(flow));
+
+  // The free list hands out the pool from its start, so that all flows that
+  // were ever used stay within a prefix of the pool.
+  for (i = cap; i > 0; i--) {
+    ft->ft_pool[i - 1].fl_hnext = ft->ft_free;
+    ft->ft_free = &ft->ft_pool[i - 1];
+  }
+
+  return true;
+}
+
+/// Release the memory held by the flow table.
+///
+/// @param[in] ft flow table
+void
+flow_table_free(flow_table* ft)
+{
+  free(ft->ft_pool);
+  free(ft->ft_bkts);
+  ft->ft_pool = NULL;
+  ft->ft_bkts = NULL;
+}
+
+/// Remove a flow from the idle order.
+///
+/// @param[in] ft flow table
+/// @param[in] fl flow
+static void
+idle_unlink(flow_table* ft, flow* fl)
+{
+  if (fl->fl_prev != NULL)
+    fl->fl_prev->fl_next_idle = fl->fl_next_idle;
+  else
+    ft->ft_oldest = fl->fl_next_idle;
+
+  if (fl->fl_next_idle != NULL)
+    fl->fl_next_idle->fl_prev = fl->fl_prev;
+  else
+    ft->ft_newest = fl->fl_prev;
+}
+
+/// Append a flow to the end of the idle order.
+///
+/// @param[in] ft flow table
+/// @param[in] fl flow
+static void
+idle_append(flow_table* ft, flow* fl)
+{
+  fl->fl_prev = ft->ft_newest;
+  fl->fl_next_idle = NULL;
+
+  if (ft->ft_newest != NULL)
+    ft->ft_newest->fl_next_idle = fl;
+  else
+    ft->ft_oldest = fl;
+
+  ft->ft_newest = fl;
+}
+
+/// Remove a flow from the table and return it to the free list.
+///
+/// @param[in] ft flow table
+/// @param[in] fl flow
+static void
+flow_remove(flow_table* ft, flow* fl)
+{
+  flow** link;
+
+  if (ft->ft_gone != NULL)
+    ft->ft_gone(fl);
+
+  link = &ft->ft_bkts[fl->fl_hash & (ft->ft_nbkts - 1)];
+  while (*link != fl)
+    link = &(*link)->fl_hnext;
+  *link = fl->fl_hnext;
+
+  idle_unlink(ft, fl);
+
+  fl->fl_hnext = ft->ft_free;
+  ft->ft_free = fl;
+  ft->ft_used--;
+}
+
+/// Find the flow of a publisher, creating it if necessary. The least recently
+/// active flow is evicted if the table is full. The names of a new flow are
+/// unknown until they are set by the caller.
+/// @return flow
+///
+/// @param[in] ft  flow table
+/// @param[in] ep  receiving endpoint
+/// @param[in] pid publisher ID
+/// @param[in] key publisher key
+/// @param[in] now steady time of arrival
+flow*
+flow_lookup(flow_table* ft,
+            const endpoint* ep,
+            const uint64_t pid,
+            const uint64_t key,
+            const uint64_t now)
+{
+  flow* fl;
+  flow** bkt;
+  uint64_t h;
+
+  h = flow_hash(ep, pid);
+  bkt = &ft->ft_bkts[h & (ft->ft_nbkts - 1)];
+
+  for (fl = *bkt; fl != NULL; fl = fl->fl_hnext) {
+    if (fl->fl_hash == h && fl->fl_ep == ep && fl->fl_pid == pid) {
+      // Mark the flow as the most recently active one.
+      if (fl != ft->ft_newest) {
+        idle_unlink(ft, fl);
+        idle_append(ft, fl);
+      }
+      fl->fl_last = now;
+      return fl;
+    }
+  }
+
+  // Make room for the new flow.
+  if (ft->ft_free == NULL) {
+    notify(NL_DEBUG, false, "Flow table is full, evicting the oldest flow");
+    flow_remove(ft, ft->ft_oldest);
+    ft->ft_force++;
+  }
+
+  fl = ft->ft_free;
+  ft->ft_free = fl->fl_hnext;
+  memset(fl, 0, sizeof(*fl));
+  if ((uint64_t)(fl - ft->ft_pool) >= ft->ft_hwm)
+    ft->ft_hwm = (uint64_t)(fl - ft->ft_pool) + 1;
+
+  fl->fl_ep    = ep;
+  fl->fl_pid   = pid;
+  fl->fl_key   = key;
+  fl->fl_hash  = h;
+  fl->fl_first = now;
+  fl->fl_last  = now;
+
+  fl->fl_hnext = *bkt;
+  *bkt = fl;
+  idle_append(ft, fl);
+
+  ft->ft_used++;
+  ft->ft_new++;
+
+  notify(NL_DEBUG, false, "New flow with key %" PRIu64 " and publisher ID %"
+         PRIx64, key, pid);
+
+  return fl;
+}
+
+/// Set the names of the publisher of a flow.
+///
+/// @param[in] fl    flow
+/// @param[in] iname publisher's interface name
+/// @param[in] hname publisher's hostname
+void
+flow_name(flow* fl, const char* iname, const char* hname)
+{
+  if (fl->fl_named
+   && memcmp(fl->fl_iname, iname, sizeof(fl->fl_iname)) == 0
+   && memcmp(fl->fl_hname, hname, sizeof(fl->fl_hname)) == 0)
+    return;
+
+  memcpy(fl->fl_iname, iname, sizeof(fl->fl_iname));
+  memcpy(fl->fl_hname, hname, sizeof(fl->fl_hname));
+  fl->fl_named = 1;
+
+  notify(NL_DEBUG, false, "Publisher ID %" PRIx64 " is interface %.*s on "
+         "host %.*s", fl->fl_pid, (int)sizeof(fl->fl_iname), fl->fl_iname,
+         (int)sizeof(fl->fl_hname), fl->fl_hname);
+}
+
+/// Account a received datagram in the sequence state of the flow.
+/// @return anomalies of the datagram (FLOW_* flags)
+///
+/// @param[in] fl  flow
+/// @param[in] ivl interval counters
+/// @param[in] ro  received record
+/// @param[in] len number of received bytes
+/// @param[in] lat one-way latency in nanoseconds
+uint8_t
+flow_update(flow* fl,
+            flow_stats* ivl,
+            const raw_output* ro,
+            const uint64_t len,
+            const uint64_t lat)
+{
+  uint64_t snum;
+  uint64_t back;
+  uint64_t bit;
+  uint8_t anom;
+
+  snum = ro->ro_pl.pl_snum;
+  anom = 0;
+
+  if (fl->fl_tot.fs_recv == 0) {
+    // First datagram of the flow.
+    fl->fl_next = snum + 1;
+    fl->fl_seen = 1;
+  } else if (snum >= fl->fl_next) {
+    // Expected or newer datagram. Every skipped sequence number is considered
+    // lost until it arrives.
+    fl->fl_tot.fs_lost += snum - fl->fl_next;
+    ivl->fs_lost       += snum - fl->fl_next;
+    if (snum > fl->fl_next)
+      anom |= FLOW_GAP;
+
+    back = snum - fl->fl_next + 1;
+    fl->fl_seen = back >= FLOW_WINDOW ? 0 : fl->fl_seen << back;
+    fl->fl_seen |= 1;
+    fl->fl_next = snum + 1;
+  } else {
+    // Older datagram, either a duplicate or a late arrival.
+    back = fl->fl_next - 1 - snum;
+    bit = back < FLOW_WINDOW ? (1ULL << back) : 0;
+
+    if (bit != 0 && (fl->fl_seen & bit) != 0) {
+      fl->fl_tot.fs_dups++;
+      ivl->fs_dups++;
+      anom |= FLOW_DUP;
+    } else {
+      fl->fl_seen |= bit;
+      fl->fl_tot.fs_reord++;
+      ivl->fs_reord++;
+      anom |= FLOW_REORD;
+
+      // Beyond the window, a late arrival and a late duplicate look the same,
+      // so only a datagram within the window makes up for a loss.
+      if (bit != 0) {
+        if (fl->fl_tot.fs_lost > 0)
+          fl->fl_tot.fs_lost--;
+        if (ivl->fs_lost > 0)
+          ivl->fs_lost--;
+      }
+    }
+  }
+
+  fl->fl_lsnum = snum;
+  fl->fl_ldep  = ro->ro_pl.pl_rtime;
+  fl->fl_larr  = ro->ro_rtime;
+
+  fl->fl_tot.fs_recv++;
+  fl->fl_tot.fs_bytes += len;
+  ivl->fs_recv++;
+  ivl->fs_bytes += len;
+
+  if (fl->fl_tot.fs_recv > 1 && fl->fl_ttl != ro->ro_ttl)
+    anom |= FLOW_TTL;
+
+  fl->fl_ttl = ro->ro_ttl;
+  hist_add(&fl->fl_hist, lat);
+
+  return anom;
+}
+
+/// Correct the latency of the last datagram of the flow with the transmit time
+/// that the following datagram carries. The correction applies only if the
+/// last arrival immediately precedes the following datagram.
+/// @return true if the correction applies, false otherwise
+///
+/// @param[in]  fl    flow
+/// @param[in]  snum  sequence number of the following datagram
+/// @param[in]  ttime transmit time of the preceding datagram
+/// @param[out] lat   corrected one-way latency in nanoseconds
+/// @param[out] dly   delay between departure and transmit in nanoseconds
+bool
+flow_follow_up(const flow* fl,
+               const uint64_t snum,
+               const uint64_t ttime,
+               uint64_t* lat,
+               uint64_t* dly)
+{
+  if (ttime == 0 || fl->fl_tot.fs_recv == 0 || fl->fl_lsnum + 1 != snum)
+    return false;
+
+  // Negative durations caused by unsynchronised clocks are clamped to zero.
+  *lat = fl->fl_larr > ttime ? fl->fl_larr - ttime : 0;
+  *dly = ttime > fl->fl_ldep ? ttime - fl->fl_ldep : 0;
+  return true;
+}
+
+/// Detect a change of the hop count of the path of a flow.
+/// @return FLOW_HOPS if the hop count changed, zero otherwise
+///
+/// @param[in]  ps   path state
+/// @param[in]  hops hop count of the datagram, or -1 if unknown
+/// @param[out] pc   path change
+static uint8_t
+path_hops(path_state* ps, const int hops, path_change* pc)
+{
+  uint8_t ret;
+
+  if (hops < 0 || hops > 255)
+    return 0;
+
+  ret = 0;
+  if (ps->ps_hopa && ps->ps_hops != (uint8_t)hops) {
+    pc->pc_hops0 = ps->ps_hops;
+    ret = FLOW_HOPS;
+  }
+
+  ps->ps_hops = (uint8_t)hops;
+  ps->ps_hopa = 1;
+  return ret;
+}
+
+/// Detect a shift of the latency level of the path of a flow. Queueing only
+/// adds to the latency, therefore the path is characterised by its latency
+/// floor, sampled as the minimum of each block of latencies. A two-sided
+/// CUSUM accumulates the deviations of the samples from the level beyond the
+/// slack of half the smallest shift of interest. The deviations are clamped,
+/// so that outliers do not add up to a shift, while a sustained shift crosses
+/// the threshold within a few blocks. The level and its deviation follow slow
+/// drifts while no shift is suspected.
+/// @return FLOW_LEVEL if the level shifted, zero otherwise
+///
+/// @param[in]  ps    path state
+/// @param[in]  lat   one-way latency in nanoseconds
+/// @param[in]  shift smallest shift of interest in nanoseconds
+/// @param[out] pc    path change
+static uint8_t
+path_level(path_state* ps, const uint64_t lat, const uint64_t shift,
+           path_change* pc)
+{
+  int64_t x;
+  int64_t diff;
+  int64_t clip;
+  int64_t delta;
+  int64_t slack;
+  int64_t limit;
+  int64_t w;
+
+  x = lat > INT64_MAX ? INT64_MAX : (int64_t)lat;
+
+  // Sample the minimum of each block.
+  if (ps->ps_bcnt == 0 || x < ps->ps_bmin)
+    ps->ps_bmin = x;
+  if (++ps->ps_bcnt < PATH_BLOCK)
+    return 0;
+  x = ps->ps_bmin;
+  ps->ps_bcnt = 0;
+
+  // Establish the level with a cumulative average.
+  if (ps->ps_cnt < PATH_WARMUP) {
+    ps->ps_cnt++;
+    diff = x - ps->ps_lvl;
+    ps->ps_lvl += diff / (int64_t)ps->ps_cnt;
+    ps->ps_dev += ((diff < 0 ? -diff : diff) - ps->ps_dev)
+                / (int64_t)ps->ps_cnt;
+    return 0;
+  }
+
+  // The smallest detectable shift exceeds the usual deviation, so that the
+  // noise of the path does not accumulate.
+  delta = 3 * ps->ps_dev;
+  if (delta < (int64_t)shift)
+    delta = (int64_t)shift;
+  if (delta < 1)
+    delta = 1;
+  slack = delta / 2;
+  limit = 8 * delta;
+
+  diff = x - ps->ps_lvl;
+  clip = diff;
+  if (clip > 2 * delta)
+    clip = 2 * delta;
+  if (clip < -2 * delta)
+    clip = -2 * delta;
+
+  ps->ps_pos += clip - slack;
+  if (ps->ps_pos > 0) {
+    ps->ps_spos += diff;
+    ps->ps_npos++;
+  } else {
+    ps->ps_pos = 0;
+    ps->ps_spos = 0;
+    ps->ps_npos = 0;
+  }
+
+  ps->ps_neg += -clip - slack;
+  if (ps->ps_neg > 0) {
+    ps->ps_sneg += diff;
+    ps->ps_nneg++;
+  } else {
+    ps->ps_neg = 0;
+    ps->ps_sneg = 0;
+    ps->ps_nneg = 0;
+  }
+
+  // The new level is the average of the latencies since the sum left zero.
+  if (ps->ps_pos > limit || ps->ps_neg > limit) {
+    pc->pc_lvl0 = (uint64_t)(ps->ps_lvl > 0 ? ps->ps_lvl : 0);
+    if (ps->ps_pos > limit)
+      ps->ps_lvl += ps->ps_spos / (int64_t)ps->ps_npos;
+    else
+      ps->ps_lvl += ps->ps_sneg / (int64_t)ps->ps_nneg;
+    pc->pc_lvl1 = (uint64_t)(ps->ps_lvl > 0 ? ps->ps_lvl : 0);
+
+    ps->ps_pos  = 0;
+    ps->ps_neg  = 0;
+    ps->ps_spos = 0;
+    ps->ps_sneg = 0;
+    ps->ps_npos = 0;
+    ps->ps_nneg = 0;
+    return FLOW_LEVEL;
+  }
+
+  // Follow slow drifts of the level only while no shift is suspected.
+  w = PATH_WARMUP;
+  if (ps->ps_pos < slack && ps->ps_neg < slack) {
+    ps->ps_lvl += diff / w;
+    ps->ps_dev += ((clip < 0 ? -clip : clip) - ps->ps_dev) / w;
+  }
+
+  return 0;
+}
+
+/// Detect a change of the network path of a flow, either from its hop count,
+/// which is exact, or from a shift of its latency level.
+/// @return FLOW_HOPS and FLOW_LEVEL flags of the detected changes
+///
+/// @param[in]  fl    flow
+/// @param[in]  hops  hop count of the datagram, or -1 if unknown
+/// @param[in]  lata  availability of the latency
+/// @param[in]  lat   one-way latency in nanoseconds
+/// @param[in]  shift smallest latency shift of interest in nanoseconds
+/// @param[out] pc    path change
+uint8_t
+flow_path(flow* fl,
+          const int hops,
+          const bool lata,
+          const uint64_t lat,
+          const uint64_t shift,
+          path_change* pc)
+{
+  path_state* ps;
+  uint8_t ret;
+
+  ps = &fl->fl_path;
+  ret = path_hops(ps, hops, pc);
+  if (lata)
+    ret |= path_level(ps, lat, shift, pc);
+
+  pc->pc_hops1 = ps->ps_hops;
+  pc->pc_hopa  = ps->ps_hopa;
+  if (!(ret & FLOW_HOPS))
+    pc->pc_hops0 = ps->ps_hops;
+  if (!(ret & FLOW_LEVEL)) {
+    pc->pc_lvl0 = (uint64_t)(ps->ps_lvl > 0 ? ps->ps_lvl : 0);
+    pc->pc_lvl1 = pc->pc_lvl0;
+  }
+
+  return ret;
+}
+
+/// Evict all flows that were inactive for longer than the idle duration.
+///
+/// @param[in] ft  flow table
+/// @param[in] now current steady time
+void
+flow_evict(flow_table* ft, const uint64_t now)
+{
+  if (ft->ft_idle == 0)
+    return;
+
+  while (ft->ft_oldest != NULL && now - ft->ft_oldest->fl_last >= ft->ft_idle) {
+    notify(NL_DEBUG, false, "Evicting idle flow with key %" PRIu64,
+           ft->ft_oldest->fl_key);
+    flow_remove(ft, ft->ft_oldest);
+    ft->ft_evict++;
+  }
+}
+
+/// Compute the memory used by the flow table.
+/// @return number of bytes
+///
+/// @param[in] ft   flow table
+/// @param[in] used only account for active flows
+size_t
+flow_table_memory(const flow_table* ft, const bool used)
+{
+  if (used)
+    return ft->ft_used * sizeof(flow);
+
+  return ft->ft_cap * sizeof(flow) + ft->ft_nbkts * sizeof(flow*);
+}
@@ -0,0 +1,169 @@
+// Copyright (c) 2017-2018 Two Sigma Open Source, LLC.
+// All Rights Reserved
+//
+// Distributed under the terms of the 2-clause BSD License. The full
+// license is in the file LICENSE, distributed as part of this software.
+
+#ifndef MBEAT_FLOW_H
+#define MBEAT_FLOW_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "types.h"
+
+
+// Latency histogram layout. Each power of two of nanoseconds is split into
+// HIST_SUB linear sub-buckets, so that the relative error of a percentile is
+// bounded by 1/HIST_SUB.
+#define HIST_SUB_BITS 2
+#define HIST_SUB      (1 << HIST_SUB_BITS)
+#define HIST_LEN      (64 * HIST_SUB)
+
+// Size of the sequence number window used to detect duplicates.
+#define FLOW_WINDOW 64
+
+// Anomalies of a datagram detected by the sequence accounting.
+#define FLOW_GAP   0x01 // Preceding sequence numbers are missing.
+#define FLOW_REORD 0x02 // Datagram arrived out of order.
+#define FLOW_DUP   0x04 // Datagram is a duplicate.
+#define FLOW_TTL   0x08 // Time-To-Live value changed.
+#define FLOW_HOPS  0x10 // Hop count of the path changed.
+#define FLOW_LEVEL 0x20 // Latency level of the path shifted.
+
+// Number of latencies whose minimum forms one sample of the latency floor of
+// a path. Queueing delays shorter than a block do not move the floor.
+#define PATH_BLOCK 4
+
+// Number of floor samples that establish the level before the detection of
+// shifts starts, and the weight of the moving averages afterwards.
+#define PATH_WARMUP 32
+
+/// Fixed-size logarithmic latency histogram.
+typedef struct _histogram {
+  uint32_t hg_cnt[HIST_LEN]; ///< Bucket counters.
+  uint64_t hg_sum;           ///< Number of recorded values.
+  uint64_t hg_max;           ///< Maximal recorded value.
+} histogram;
+
+/// Sequence accounting counters.
+typedef struct _flow_stats {
+  uint64_t fs_recv;  ///< Received datagrams.
+  uint64_t fs_bytes; ///< Received bytes.
+  uint64_t fs_lost;  ///< Datagrams missing from the sequence.
+  uint64_t fs_dups;  ///< Duplicate datagrams.
+  uint64_t fs_reord; ///< Datagrams that arrived out of order.
+} flow_stats;
+
+/// Change detection of the network path of a flow. The level of the latency
+/// floor is tracked by a two-sided CUSUM, which needs constant state per flow.
+typedef struct _path_state {
+  int64_t  ps_lvl;    ///< Level of the latency floor (ns).
+  int64_t  ps_dev;    ///< Mean absolute deviation from the level (ns).
+  int64_t  ps_pos;    ///< Cumulative sum of upward deviations.
+  int64_t  ps_neg;    ///< Cumulative sum of downward deviations.
+  int64_t  ps_spos;   ///< Sum of deviations since the upward sum left zero.
+  int64_t  ps_sneg;   ///< Sum of deviations since the downward sum left zero.
+  int64_t  ps_bmin;   ///< Minimal latency of the current block (ns).
+  uint32_t ps_npos;   ///< Samples since the upward sum left zero.
+  uint32_t ps_nneg;   ///< Samples since the downward sum left zero.
+  uint32_t ps_cnt;    ///< Samples seen, up to the warm-up count.
+  uint32_t ps_bcnt;   ///< Latencies in the current block.
+  uint8_t  ps_hops;   ///< Hop count of the path.
+  uint8_t  ps_hopa;   ///< Availability of the hop count.
+  uint8_t  ps_pad[6]; ///< Padding (unused).
+} path_state;
+
+/// Change of the network path of a flow.
+typedef struct _path_change {
+  uint8_t  pc_hops0;  ///< Hop count before the change.
+  uint8_t  pc_hops1;  ///< Hop count after the change.
+  uint8_t  pc_hopa;   ///< Availability of the hop count.
+  uint8_t  pc_pad[5]; ///< Padding (unused).
+  uint64_t pc_lvl0;   ///< Latency level before the change (ns).
+  uint64_t pc_lvl1;   ///< Latency level after the change (ns).
+} path_change;
+
+/// State of a single publisher as seen on one endpoint.
+typedef struct _flow {
+  const endpoint* fl_ep;               ///< Receiving endpoint.
+  uint64_t        fl_pid;              ///< Publisher ID.
+  uint64_t        fl_key;              ///< Publisher key.
+  uint64_t        fl_hash;             ///< Hash of the identity.
+  char            fl_iname[INAME_LEN]; ///< Publisher's interface name.
+  char            fl_hname[HNAME_LEN]; ///< Publisher's hostname.
+  uint64_t        fl_first;            ///< Steady time of the first arrival.
+  uint64_t        fl_last;             ///< Steady time of the last arrival.
+  uint64_t        fl_next;             ///< Next expected sequence number.
+  uint64_t        fl_seen;             ///< Window of recently seen numbers.
+  uint64_t        fl_lsnum;            ///< Sequence number of the last arrival.
+  uint64_t        fl_ldep;             ///< System time of the last departure.
+  uint64_t        fl_larr;             ///< System time of the last arrival.
+  uint64_t        fl_llim;             ///< Latency limit of anomalies.
+  uint8_t         fl_ttl;              ///< Last destination Time-To-Live.
+  uint8_t         fl_named;            ///< Names of the publisher are known.
+  uint8_t         fl_pad[6];           ///< Padding (unused).
+  flow_stats      fl_tot;              ///< Cumulative counters.
+  histogram       fl_hist;             ///< Decaying latency histogram.
+  path_state      fl_path;             ///< Path change detection.
+  struct _flow*   fl_hnext;            ///< Next flow in the hash chain.
+  struct _flow*   fl_prev;             ///< Previous flow in the idle order.
+  struct _flow*   fl_next_idle;        ///< Next flow in the idle order.
+} flow;
+
+/// Handler of a flow that is about to be removed from the flow table.
+typedef void (*flow_handler)(const flow* fl);
+
+/// Bounded table of flows with eviction of idle entries.
+typedef struct _flow_table {
+  flow*        ft_pool;   ///< Preallocated flows.
+  flow*        ft_free;   ///< List of unused flows.
+  flow**       ft_bkts;   ///< Hash buckets.
+  uint64_t     ft_nbkts;  ///< Number of hash buckets (power of two).
+  uint64_t     ft_cap;    ///< Maximal number of flows.
+  uint64_t     ft_used;   ///< Number of active flows.
+  uint64_t     ft_hwm;    ///< Pool entries that were ever used.
+  uint64_t     ft_idle;   ///< Idle duration after which a flow is evicted.
+  uint64_t     ft_new;    ///< Flows created in total.
+  uint64_t     ft_evict;  ///< Flows evicted due to inactivity.
+  uint64_t     ft_force;  ///< Flows evicted to make room for new ones.
+  flow*        ft_oldest; ///< Least recently active flow.
+  flow*        ft_newest; ///< Most recently active flow.
+  flow_handler ft_gone;   ///< Handler of removed flows (optional).
+} flow_table;
+
+bool  flow_table_init(flow_table* ft,
+                      const uint64_t cap,
+                      const uint64_t idle,
+                      const bool huge);
+void  flow_table_free(flow_table* ft);
+flow* flow_lookup(flow_table* ft,
+                  const endpoint* ep,
+                  const uint64_t pid,
+                  const uint64_t key,
+                  const uint64_t now);
+void  flow_name(flow* fl, const char* iname, const char* hname);
+bool  flow_follow_up(const flow* fl,
+                     const uint64_t snum,
+                     const uint64_t ttime,
+                     uint64_t* lat,
+                     uint64_t* dly);
+uint8_t flow_update(flow* fl,
+                    flow_stats* ivl,
+                    const raw_output* ro,
+                    const uint64_t len,
+                    const uint64_t lat);
+uint8_t flow_path(flow* fl,
+                  const int hops,
+                  const bool lata,
+                  const uint64_t lat,
+                  const uint64_t shift,
+                  path_change* pc);
+void  flow_evict(flow_table* ft, const uint64_t now);
+size_t flow_table_memory(const flow_table* ft, const bool used);
+
+void     hist_add(histogram* hg, const uint64_t val);
+void     hist_decay(histogram* hg);
+uint64_t hist_percentile(const histogram* hg, const double pct);
+
+#endif
@@ -0,0 +1,238 @@
+// Copyright (c) 2017-2018 Two Sigma Open Source, LLC.
+// All Rights Reserved
+//
+// Distributed under the terms of the 2-clause BSD License. The full
+// license is in the file LICENSE, distributed as part of this software.
+
+#include "platform.h"
+
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#include <net/if.h>
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#if defined(MBEAT_HAVE_RTNETLINK)
+  #include <linux/netlink.h>
+  #include <linux/rtnetlink.h>
+#endif
+
+#include "link.h"
+#include "common.h"
+
+
+#if defined(MBEAT_HAVE_RTNETLINK)
+
+/// Find an attribute of a routing message.
+/// @return attribute, or NULL if not present
+///
+/// @param[in] rta  first attribute
+/// @param[in] len  length of all attributes
+/// @param[in] type attribute type
+static struct rtattr*
+find_attr(struct rtattr* rta, int len, const unsigned short type)
+{
+  for (; RTA_OK(rta, len); rta = RTA_NEXT(rta, len))
+    if (rta->rta_type == type)
+      return rta;
+
+  return NULL;
+}
+
+/// Copy the name of an interface from an attribute, or look it up by the
+/// index of the interface.
+/// @return status code
+///
+/// @param[out] iname interface name
+/// @param[in]  rta   attribute with the name, or NULL
+/// @param[in]  idx   interface index
+static bool
+find_name(char* iname, const struct rtattr* rta, const unsigned int idx)
+{
+  size_t len;
+
+  if (rta != NULL) {
+    len = RTA_PAYLOAD(rta);
+    if (len > IF_NAMESIZE)
+      len = IF_NAMESIZE;
+    memcpy(iname, RTA_DATA(rta), len);
+    iname[IF_NAMESIZE - 1] = '\0';
+    return true;
+  }
+
+  return if_indextoname(idx, iname) != NULL;
+}
+
+/// Translate a routing message into a change of an interface.
+///
+/// @param[in] nh routing message
+/// @param[in] fn handler of the change
+static void
+handle_message(struct nlmsghdr* nh, link_handler fn)
+{
+  struct ifinfomsg* ifi;
+  struct ifaddrmsg* ifa;
+  struct rtmsg* rtm;
+  struct rtattr* rta;
+  char iname[IF_NAMESIZE];
+  uint8_t kind;
+
+  switch (nh->nlmsg_type) {
+    // The operational state of the link is reflected by IFF_RUNNING.
+    case RTM_NEWLINK:
+    case RTM_DELLINK:
+      ifi = NLMSG_DATA(nh);
+      rta = find_attr(IFLA_RTA(ifi), (int)IFLA_PAYLOAD(nh), IFLA_IFNAME);
+      if (!find_name(iname, rta, (unsigned int)ifi->ifi_index))
+        return;
+
+      kind = LINK_UP;
+      if (nh->nlmsg_type == RTM_DELLINK
+       || !(ifi->ifi_flags & IFF_UP)
+       || !(ifi->ifi_flags & IFF_RUNNING))
+        kind = LINK_DOWN;
+      break;
+
+    // Labels of address aliases differ from the interface name, therefore
+    // the name is looked up by the index of the interface.
+    case RTM_NEWADDR:
+    case RTM_DELADDR:
+      ifa = NLMSG_DATA(nh);
+      if (ifa->ifa_family != AF_INET)
+        return;
+      if (!find_name(iname, NULL, ifa->ifa_index))
+        return;
+
+      kind = LINK_ADDR;
+      break;
+
+    // Only the routes of the main table are configured by the operator.
+    case RTM_NEWROUTE:
+    case RTM_DELROUTE:
+      rtm = NLMSG_DATA(nh);
+      if (rtm->rtm_family != AF_INET || rtm->rtm_table != RT_TABLE_MAIN)
+        return;
+
+      rta = find_attr(RTM_RTA(rtm), (int)RTM_PAYLOAD(nh), RTA_OIF);
+      if (rta == NULL)
+        return;
+      if (!find_name(iname, NULL, *(unsigned int*)RTA_DATA(rta)))
+        return;
+
+      kind = LINK_ROUTE;
+      break;
+
+    default:
+      return;
+  }
+
+  fn(iname, kind);
+}
+
+#endif
+
+/// Open a socket that receives the changes of links, IPv4 addresses and IPv4
+/// routes of all network interfaces.
+/// @return socket, or -1 if not available
+int
+link_open(void)
+{
+#if defined(MBEAT_HAVE_RTNETLINK)
+  struct sockaddr_nl sa;
+  int sock;
+
+  sock = socket(AF_NETLINK, SOCK_RAW, NETLINK_ROUTE);
+  if (sock == -1) {
+    notify(NL_WARN, true, "Unable to create the link monitor socket");
+    return -1;
+  }
+
+  memset(&sa, 0, sizeof(sa));
+  sa.nl_family = AF_NETLINK;
+  sa.nl_groups = RTMGRP_LINK | RTMGRP_IPV4_IFADDR | RTMGRP_IPV4_ROUTE;
+  if (bind(sock, (struct sockaddr*)&sa, sizeof(sa)) == -1) {
+    notify(NL_WARN, true, "Unable to subscribe to the link changes");
+    close(sock);
+    return -1;
+  }
+
+  // The socket is drained until no messages are left.
+  if (fcntl(sock, F_SETFL, O_NONBLOCK) == -1) {
+    notify(NL_WARN, true, "Unable to make the link monitor non-blocking");
+    close(sock);
+    return -1;
+  }
+
+  return sock;
+#else
+  notify(NL_DEBUG, false, "Link monitoring is not supported on this platform");
+  return -1;
+#endif
+}
+
+/// Receive all pending changes of the network interfaces.
+/// @return status code
+///
+/// @param[in] sock link monitor socket
+/// @param[in] fn   handler of each change
+bool
+link_receive(const int sock, link_handler fn)
+{
+#if defined(MBEAT_HAVE_RTNETLINK)
+  char buf[8192];
+  struct nlmsghdr* nh;
+  ssize_t ret;
+  int len;
+
+  while (1) {
+    ret = recv(sock, buf, sizeof(buf), 0);
+    if (ret == -1) {
+      if (errno == EAGAIN)
+        return true;
+
+      // The kernel dropped changes that did not fit into the socket buffer.
+      if (errno == ENOBUFS) {
+        notify(NL_WARN, false, "Link changes were lost, checking all "
+               "interfaces");
+        fn(NULL, LINK_ADDR);
+        continue;
+      }
+
+      notify(NL_WARN, true, "Unable to receive the link changes");
+      return false;
+    }
+
+    len = (int)ret;
+    for (nh = (struct nlmsghdr*)buf; NLMSG_OK(nh, len);
+         nh = NLMSG_NEXT(nh, len))
+      handle_message(nh, fn);
+  }
+#else
+  (void)sock;
+  (void)fn;
+  return true;
+#endif
+}
+
+/// Describe a kind of change of a network interface.
+/// @return description
+///
+/// @param[in] kind kind of change
+const char*
+link_kind(const uint8_t kind)
+{
+  switch (kind) {
+    case LINK_DOWN:  return "went down";
+    case LINK_UP:    return "came up";
+    case LINK_ADDR:  return "changed its address";
+    case LINK_ROUTE: return "changed its routes";
+    default:         return "changed";
+  }
+}
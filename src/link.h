@@ -0,0 +1,28 @@
+// Copyright (c) 2017-2018 Two Sigma Open Source, LLC.
+// All Rights Reserved
+//
+// Distributed under the terms of the 2-clause BSD License. The full
+// license is in the file LICENSE, distributed as part of this software.
+
+#ifndef MBEAT_LINK_H
+#define MBEAT_LINK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+// Kinds of changes of a network interface.
+#define LINK_DOWN  0 // The link went down or was removed.
+#define LINK_UP    1 // The link came up.
+#define LINK_ADDR  2 // An IPv4 address was added or removed.
+#define LINK_ROUTE 3 // An IPv4 route through the interface changed.
+
+/// Handler of a change of a network interface, where no interface name
+/// denotes that changes were lost and that all interfaces may have changed.
+typedef void (*link_handler)(const char* iname, const uint8_t kind);
+
+int  link_open(void);
+bool link_receive(const int sock, link_handler fn);
+const char* link_kind(const uint8_t kind);
+
+#endif
@@ -0,0 +1,195 @@
+// Copyright (c) 2017-2018 Two Sigma Open Source, LLC.
+// All Rights Reserved
+//
+// Distributed under the terms of the 2-clause BSD License. The full
+// license is in the file LICENSE, distributed as part of this software.
+
+// The sched_setaffinity(2) and sched_getcpu(3) functions are GNU extensions
+// on Linux.
+#if defined(__linux__) && !defined(MBEAT_FORCE_POSIX)
+  #define _GNU_SOURCE
+#endif
+
+#include "platform.h"
+
+#include <sys/types.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <dirent.h>
+#include <sched.h>
+
+#include "numa.h"
+#include "common.h"
+
+
+/// NUMA node of each CPU, or -1 if unknown.
+static int cpu_node[NUMA_CPU_MAX + 1];
+
+#if defined(MBEAT_HAVE_NUMA)
+
+/// Read a single integer from a file.
+/// @return status code
+///
+/// @param[out] val  integer
+/// @param[in]  path path to the file
+static bool
+read_int(int* val, const char* path)
+{
+  FILE* file;
+  int ret;
+
+  file = fopen(path, "r");
+  if (file == NULL)
+    return false;
+
+  ret = fscanf(file, "%d", val);
+  fclose(file);
+
+  return ret == 1;
+}
+
+/// Find the NUMA node of a CPU, which is exposed as a link named after the
+/// node in the directory of the CPU.
+/// @return node, or -1 if unknown
+///
+/// @param[in] cpu CPU number
+static int
+find_cpu_node(const int cpu)
+{
+  char path[64];
+  DIR* dir;
+  struct dirent* ent;
+  int node;
+
+  snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+  dir = opendir(path);
+  if (dir == NULL)
+    return -1;
+
+  node = -1;
+  while ((ent = readdir(dir)) != NULL)
+    if (sscanf(ent->d_name, "node%d", &node) == 1)
+      break;
+
+  closedir(dir);
+  return node < NUMA_NODE_MAX ? node : -1;
+}
+
+#endif
+
+/// Learn the NUMA node of each CPU, so that the node of the CPU that delivers
+/// a datagram can be found without a system call.
+void
+numa_init(void)
+{
+  int cpu;
+
+  for (cpu = 0; cpu <= NUMA_CPU_MAX; cpu++) {
+#if defined(MBEAT_HAVE_NUMA)
+    cpu_node[cpu] = find_cpu_node(cpu);
+#else
+    cpu_node[cpu] = -1;
+#endif
+  }
+}
+
+/// Find the NUMA node of the network device behind an interface. Devices
+/// that are not attached to a PCI bus directly, such as virtio devices,
+/// report the node through their parent.
+/// @return node, or -1 if unknown
+///
+/// @param[in] iname interface name
+int
+numa_iface_node(const char* iname)
+{
+#if defined(MBEAT_HAVE_NUMA)
+  char path[128];
+  int node;
+
+  snprintf(path, sizeof(path), "/sys/class/net/%s/device/numa_node", iname);
+  if (read_int(&node, path))
+    return node < 0 || node >= NUMA_NODE_MAX ? -1 : node;
+
+  snprintf(path, sizeof(path), "/sys/class/net/%s/device/../numa_node",
+           iname);
+  if (read_int(&node, path))
+    return node < 0 || node >= NUMA_NODE_MAX ? -1 : node;
+#else
+  (void)iname;
+#endif
+
+  return -1;
+}
+
+/// Look up the NUMA node of a CPU.
+/// @return node, or -1 if unknown
+///
+/// @param[in] cpu CPU number
+int
+numa_cpu_node(const int cpu)
+{
+  if (cpu < 0 || cpu > NUMA_CPU_MAX)
+    return -1;
+
+  return cpu_node[cpu];
+}
+
+/// Find the CPU that currently runs the process.
+/// @return CPU number, or -1 if unknown
+int
+numa_current_cpu(void)
+{
+#if defined(MBEAT_HAVE_NUMA)
+  return sched_getcpu();
+#else
+  return -1;
+#endif
+}
+
+/// Restrict the process to the CPUs of a NUMA node. Memory that is touched
+/// afterwards is allocated on the node by the default first-touch policy.
+/// @return status code
+///
+/// @param[in] node NUMA node
+bool
+numa_place(const int node)
+{
+#if defined(MBEAT_HAVE_NUMA)
+  cpu_set_t set;
+  int cpu;
+  int cnt;
+
+  CPU_ZERO(&set);
+  cnt = 0;
+  for (cpu = 0; cpu <= NUMA_CPU_MAX && cpu < CPU_SETSIZE; cpu++) {
+    if (cpu_node[cpu] != node)
+      continue;
+
+    CPU_SET(cpu, &set);
+    cnt++;
+  }
+
+  if (cnt == 0) {
+    notify(NL_WARN, false, "No CPUs found on NUMA node %d", node);
+    return false;
+  }
+
+  if (sched_setaffinity(0, sizeof(set), &set) == -1) {
+    notify(NL_WARN, true, "Unable to place the process on NUMA node %d",
+           node);
+    return false;
+  }
+
+  notify(NL_INFO, false, "Placed the process on the %d CPUs of NUMA node %d",
+         cnt, node);
+  return true;
+#else
+  notify(NL_WARN, false, "Placement on NUMA node %d is not supported on this "
+         "platform", node);
+  return false;
+#endif
+}
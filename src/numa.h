@@ -0,0 +1,26 @@
+// Copyright (c) 2017-2018 Two Sigma Open Source, LLC.
+// All Rights Reserved
+//
+// Distributed under the terms of the 2-clause BSD License. The full
+// license is in the file LICENSE, distributed as part of this software.
+
+#ifndef MBEAT_NUMA_H
+#define MBEAT_NUMA_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+// Highest CPU number with a known NUMA node.
+#define NUMA_CPU_MAX 1023
+
+// Maximal number of NUMA nodes.
+#define NUMA_NODE_MAX 64
+
+void numa_init(void);
+int  numa_iface_node(const char* iname);
+int  numa_cpu_node(const int cpu);
+int  numa_current_cpu(void);
+bool numa_place(const int node);
+
+#endif
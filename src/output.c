@@ -0,0 +1,597 @@
+// Copyright (c) 2017-2018 Two Sigma Open Source, LLC.
+// All Rights Reserved
+//
+// Distributed under the terms of the 2-clause BSD License. The full
+// license is in the file LICENSE, distributed as part of this software.
+
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <inttypes.h>
+#include <string.h>
+#include <strings.h>
+
+#include "output.h"
+#include "types.h"
+#include "common.h"
+
+
+// Number of available columns, and of the columns in the default selection.
+#define COLUMN_CNT 16
+#define COLUMN_DEF 15
+
+// Upper bound of the length of a CSV line with all columns.
+#define LINE_MAX_LEN 512
+
+// Upper bound of the length of a CSV rollup row with all latency buckets.
+#define ROLLUP_MAX_LEN 2048
+
+// Offset of a payload field in the record.
+#define PL_OFF(f) (offsetof(raw_output, ro_pl) + offsetof(payload, f))
+
+// Offset of the record sequence number, which is not part of the record and
+// is placed right after it in the formatting plan.
+#define RSEQ_OFF sizeof(raw_output)
+
+/// Formatter of a CSV column.
+/// @return end of the formatted column
+typedef char* (*column_fmt)(char* buf, const raw_output* ro);
+
+/// Output column.
+typedef struct _column {
+  const char* cl_name; ///< Name in the CSV header.
+  column_fmt  cl_fmt;  ///< CSV formatter.
+  size_t      cl_off;  ///< Offset of the field in the record.
+  size_t      cl_len;  ///< Length of the field in the record.
+} column;
+
+/// Contiguous part of the record copied to the projected raw record.
+typedef struct _segment {
+  size_t sg_off; ///< Offset in the record.
+  size_t sg_len; ///< Length in bytes.
+} segment;
+
+// Formatting plan of the selected columns.
+static const column* pn_cols[COLUMN_CNT]; ///< Selected columns.
+static column_fmt    pn_fmt[COLUMN_CNT];  ///< CSV formatters in order.
+static segment       pn_seg[COLUMN_CNT];  ///< Segments of the raw record.
+static size_t        pn_ncols;            ///< Number of selected columns.
+static size_t        pn_nsegs;            ///< Number of raw segments.
+static size_t        pn_rlen;             ///< Length of the raw record.
+static bool          pn_proj;             ///< Raw records are projected.
+static uint64_t      pn_rseq;             ///< Sequence number of the record.
+
+/// Format an unsigned integer in decimal.
+/// @return end of the formatted number
+///
+/// @param[out] buf output buffer
+/// @param[in]  val value
+static char*
+put_uint(char* buf, uint64_t val)
+{
+  char tmp[20];
+  size_t n;
+
+  n = 0;
+  do {
+    tmp[sizeof(tmp) - ++n] = (char)('0' + val % 10);
+    val /= 10;
+  } while (val != 0);
+
+  memcpy(buf, tmp + sizeof(tmp) - n, n);
+  return buf + n;
+}
+
+/// Copy a fixed-size string field, which is not necessarily terminated.
+/// @return end of the copied string
+///
+/// @param[out] buf output buffer
+/// @param[in]  str string field
+/// @param[in]  len size of the field
+static char*
+put_name(char* buf, const char* str, const size_t len)
+{
+  const char* end;
+  size_t n;
+
+  end = memchr(str, '\0', len);
+  n = end == NULL ? len : (size_t)(end - str);
+  memcpy(buf, str, n);
+  return buf + n;
+}
+
+/// Format a multicast address stored in the network byte order.
+/// @return end of the formatted address
+///
+/// @param[out] buf   output buffer
+/// @param[in]  maddr multicast address
+static char*
+put_maddr(char* buf, const uint32_t maddr)
+{
+  const uint8_t* oct;
+
+  // Same as inet_ntoa(3) of the stored address, without the static buffer.
+  oct = (const uint8_t*)&maddr;
+  buf = put_uint(buf, oct[0]);
+  *buf++ = '.';
+  buf = put_uint(buf, oct[1]);
+  *buf++ = '.';
+  buf = put_uint(buf, oct[2]);
+  *buf++ = '.';
+  return put_uint(buf, oct[3]);
+}
+
+/// Format the key.
+/// @return end of the formatted column
+///
+/// @param[out] buf output buffer
+/// @param[in]  ro  record
+static char*
+fmt_key(char* buf, const raw_output* ro)
+{
+  return put_uint(buf, ro->ro_pl.pl_key);
+}
+
+/// Format the sequence number.
+/// @return end of the formatted column
+///
+/// @param[out] buf output buffer
+/// @param[in]  ro  record
+static char*
+fmt_snum(char* buf, const raw_output* ro)
+{
+  return put_uint(buf, ro->ro_pl.pl_snum);
+}
+
+/// Format the sequence length.
+/// @return end of the formatted column
+///
+/// @param[out] buf output buffer
+/// @param[in]  ro  record
+static char*
+fmt_slen(char* buf, const raw_output* ro)
+{
+  return put_uint(buf, ro->ro_pl.pl_slen);
+}
+
+/// Format the multicast address.
+/// @return end of the formatted column
+///
+/// @param[out] buf output buffer
+/// @param[in]  ro  record
+static char*
+fmt_maddr(char* buf, const raw_output* ro)
+{
+  return put_maddr(buf, ro->ro_pl.pl_maddr);
+}
+
+/// Format the multicast port.
+/// @return end of the formatted column
+///
+/// @param[out] buf output buffer
+/// @param[in]  ro  record
+static char*
+fmt_mport(char* buf, const raw_output* ro)
+{
+  return put_uint(buf, ro->ro_pl.pl_mport);
+}
+
+/// Format the source Time-To-Live.
+/// @return end of the formatted column
+///
+/// @param[out] buf output buffer
+/// @param[in]  ro  record
+static char*
+fmt_src_ttl(char* buf, const raw_output* ro)
+{
+  return put_uint(buf, ro->ro_pl.pl_ttl);
+}
+
+/// Format the destination Time-To-Live.
+/// @return end of the formatted column
+///
+/// @param[out] buf output buffer
+/// @param[in]  ro  record
+static char*
+fmt_dst_ttl(char* buf, const raw_output* ro)
+{
+  // Destination Time-To-Live string, depending on its availability.
+  if (ro->ro_ttla)
+    return put_uint(buf, ro->ro_ttl);
+
+  memcpy(buf, "N/A", 3);
+  return buf + 3;
+}
+
+/// Format the publisher's interface name.
+/// @return end of the formatted column
+///
+/// @param[out] buf output buffer
+/// @param[in]  ro  record
+static char*
+fmt_pub_if(char* buf, const raw_output* ro)
+{
+  return put_name(buf, ro->ro_pl.pl_iname, sizeof(ro->ro_pl.pl_iname));
+}
+
+/// Format the publisher's hostname.
+/// @return end of the formatted column
+///
+/// @param[out] buf output buffer
+/// @param[in]  ro  record
+static char*
+fmt_pub_host(char* buf, const raw_output* ro)
+{
+  return put_name(buf, ro->ro_pl.pl_hname, sizeof(ro->ro_pl.pl_hname));
+}
+
+/// Format the subscriber's interface name.
+/// @return end of the formatted column
+///
+/// @param[out] buf output buffer
+/// @param[in]  ro  record
+static char*
+fmt_sub_if(char* buf, const raw_output* ro)
+{
+  return put_name(buf, ro->ro_iname, sizeof(ro->ro_iname));
+}
+
+/// Format the subscriber's hostname.
+/// @return end of the formatted column
+///
+/// @param[out] buf output buffer
+/// @param[in]  ro  record
+static char*
+fmt_sub_host(char* buf, const raw_output* ro)
+{
+  return put_name(buf, ro->ro_hname, sizeof(ro->ro_hname));
+}
+
+/// Format the system time of departure.
+/// @return end of the formatted column
+///
+/// @param[out] buf output buffer
+/// @param[in]  ro  record
+static char*
+fmt_real_dep(char* buf, const raw_output* ro)
+{
+  return put_uint(buf, ro->ro_pl.pl_rtime);
+}
+
+/// Format the system time of arrival.
+/// @return end of the formatted column
+///
+/// @param[out] buf output buffer
+/// @param[in]  ro  record
+static char*
+fmt_real_arr(char* buf, const raw_output* ro)
+{
+  return put_uint(buf, ro->ro_rtime);
+}
+
+/// Format the steady time of departure.
+/// @return end of the formatted column
+///
+/// @param[out] buf output buffer
+/// @param[in]  ro  record
+static char*
+fmt_mono_dep(char* buf, const raw_output* ro)
+{
+  return put_uint(buf, ro->ro_pl.pl_mtime);
+}
+
+/// Format the steady time of arrival.
+/// @return end of the formatted column
+///
+/// @param[out] buf output buffer
+/// @param[in]  ro  record
+static char*
+fmt_mono_arr(char* buf, const raw_output* ro)
+{
+  return put_uint(buf, ro->ro_mtime);
+}
+
+/// Format the sequence number of the record among all printed records.
+/// @return end of the formatted column
+///
+/// @param[out] buf output buffer
+/// @param[in]  ro  record
+static char*
+fmt_rec_seq(char* buf, const raw_output* ro)
+{
+  (void)ro;
+  return put_uint(buf, pn_rseq);
+}
+
+/// All columns in their default order. The Time-To-Live availability and
+/// value form the raw field of the destination Time-To-Live. The record
+/// sequence number is available only through a selection of columns.
+static const column columns[COLUMN_CNT] = {
+  {"Key",       fmt_key,      PL_OFF(pl_key),   sizeof(uint64_t)},
+  {"SeqNum",    fmt_snum,     PL_OFF(pl_snum),  sizeof(uint64_t)},
+  {"SeqLen",    fmt_slen,     PL_OFF(pl_slen),  sizeof(uint64_t)},
+  {"McastAddr", fmt_maddr,    PL_OFF(pl_maddr), sizeof(uint32_t)},
+  {"McastPort", fmt_mport,    PL_OFF(pl_mport), sizeof(uint16_t)},
+  {"SrcTTL",    fmt_src_ttl,  PL_OFF(pl_ttl),   sizeof(uint8_t)},
+  {"DstTTL",    fmt_dst_ttl,  offsetof(raw_output, ro_ttla),
+                              2 * sizeof(uint8_t)},
+  {"PubIf",     fmt_pub_if,   PL_OFF(pl_iname), INAME_LEN},
+  {"PubHost",   fmt_pub_host, PL_OFF(pl_hname), HNAME_LEN},
+  {"SubIf",     fmt_sub_if,   offsetof(raw_output, ro_iname), INAME_LEN},
+  {"SubHost",   fmt_sub_host, offsetof(raw_output, ro_hname), HNAME_LEN},
+  {"RealDep",   fmt_real_dep, PL_OFF(pl_rtime), sizeof(uint64_t)},
+  {"RealArr",   fmt_real_arr, offsetof(raw_output, ro_rtime),
+                              sizeof(uint64_t)},
+  {"MonoDep",   fmt_mono_dep, PL_OFF(pl_mtime), sizeof(uint64_t)},
+  {"MonoArr",   fmt_mono_arr, offsetof(raw_output, ro_mtime),
+                              sizeof(uint64_t)},
+  {"RecSeq",    fmt_rec_seq,  RSEQ_OFF,         sizeof(uint64_t)}
+};
+
+/// Append a column to the formatting plan, merging its raw field with the
+/// previous segment if they are adjacent in the record.
+/// @return status code
+///
+/// @param[in] cl column
+static bool
+plan_column(const column* cl)
+{
+  size_t i;
+
+  for (i = 0; i < pn_ncols; i++) {
+    if (pn_cols[i] == cl) {
+      notify(NL_ERROR, false, "Column %s selected more than once",
+             cl->cl_name);
+      return false;
+    }
+  }
+
+  pn_cols[pn_ncols] = cl;
+  pn_fmt[pn_ncols]  = cl->cl_fmt;
+  pn_ncols++;
+
+  if (pn_nsegs > 0 && pn_seg[pn_nsegs - 1].sg_off
+                    + pn_seg[pn_nsegs - 1].sg_len == cl->cl_off) {
+    pn_seg[pn_nsegs - 1].sg_len += cl->cl_len;
+  } else {
+    pn_seg[pn_nsegs].sg_off = cl->cl_off;
+    pn_seg[pn_nsegs].sg_len = cl->cl_len;
+    pn_nsegs++;
+  }
+  pn_rlen += cl->cl_len;
+
+  return true;
+}
+
+/// Compile the selection of output columns into the formatting plan.
+/// @return status code
+///
+/// @param[in] spec comma-separated list of column names (NULL for all)
+bool
+output_columns(const char* spec)
+{
+  char* str;
+  char* tok;
+  char* save;
+  size_t i;
+  bool ret;
+
+  pn_ncols = 0;
+  pn_nsegs = 0;
+  pn_rlen  = 0;
+  pn_proj  = spec != NULL;
+
+  // All columns in the default order keep the full raw record.
+  if (spec == NULL) {
+    for (i = 0; i < COLUMN_DEF; i++)
+      (void)plan_column(&columns[i]);
+    return true;
+  }
+
+  str = strdup(spec);
+  if (str == NULL) {
+    notify(NL_ERROR, true, "Unable to copy the column selection");
+    return false;
+  }
+
+  ret = true;
+  for (tok = strtok_r(str, ",", &save); tok != NULL && ret;
+       tok = strtok_r(NULL, ",", &save)) {
+    for (i = 0; i < COLUMN_CNT; i++)
+      if (strcasecmp(tok, columns[i].cl_name) == 0)
+        break;
+
+    if (i == COLUMN_CNT) {
+      notify(NL_ERROR, false, "Unknown column %s", tok);
+      ret = false;
+    } else {
+      ret = plan_column(&columns[i]);
+    }
+  }
+
+  if (ret && pn_ncols == 0) {
+    notify(NL_ERROR, false, "No columns selected");
+    ret = false;
+  }
+
+  free(str);
+  return ret;
+}
+
+/// Print the CSV header.
+///
+/// @param[in] out output stream
+void
+print_csv_header(FILE* out)
+{
+  size_t i;
+
+  for (i = 0; i < pn_ncols; i++)
+    fprintf(out, "%s%c", pn_cols[i]->cl_name, i + 1 < pn_ncols ? ',' : '\n');
+}
+
+/// Decide whether a column is part of the formatting plan.
+/// @return decision
+///
+/// @param[in] name column name
+bool
+output_has_column(const char* name)
+{
+  size_t i;
+
+  for (i = 0; i < pn_ncols; i++)
+    if (strcasecmp(pn_cols[i]->cl_name, name) == 0)
+      return true;
+
+  return false;
+}
+
+/// Print the record as a CSV-formatted line to an output stream. Each selected
+/// column is followed by a separator, and the last separator is replaced by
+/// the end of the line.
+///
+/// @param[in] out output stream
+/// @param[in] ro  record
+void
+print_record_csv(FILE* out, const raw_output* ro)
+{
+  char line[LINE_MAX_LEN];
+  char* end;
+  size_t i;
+
+  end = line;
+  for (i = 0; i < pn_ncols; i++) {
+    end = pn_fmt[i](end, ro);
+    *end++ = ',';
+  }
+  end[-1] = '\n';
+
+  fwrite(line, 1, (size_t)(end - line), out);
+  pn_rseq++;
+}
+
+/// Print the record in the raw binary format to an output stream. With a
+/// column selection, only the selected fields are written, in the selected
+/// order.
+///
+/// @param[in] out output stream
+/// @param[in] ro  record
+void
+print_record_raw(FILE* out, const raw_output* ro)
+{
+  char rec[sizeof(raw_output) + sizeof(uint64_t)];
+  const char* src;
+  char* end;
+  size_t i;
+
+  if (!pn_proj) {
+    fwrite(ro, sizeof(*ro), 1, out);
+    return;
+  }
+
+  end = rec;
+  for (i = 0; i < pn_nsegs; i++) {
+    if (pn_seg[i].sg_off == RSEQ_OFF)
+      src = (const char*)&pn_rseq;
+    else
+      src = (const char*)ro + pn_seg[i].sg_off;
+
+    memcpy(end, src, pn_seg[i].sg_len);
+    end += pn_seg[i].sg_len;
+  }
+
+  fwrite(rec, pn_rlen, 1, out);
+  pn_rseq++;
+}
+
+/// Print the CSV header of the rollup rows.
+///
+/// @param[in] nbkt number of latency buckets
+void
+print_rollup_header(const size_t nbkt)
+{
+  size_t i;
+
+  printf("Start,Duration,Key,McastAddr,PubIf,PubHost,SubIf,SubHost,Datagrams,"
+         "Bytes,Lost,Gaps,Dups,Reord,LatMin,LatMean,LatMax,LatP99,Drops");
+  for (i = 0; i < nbkt; i++)
+    printf(",Bkt%zu", i);
+  printf("\n");
+}
+
+/// Print the rollup row of a flow as a CSV-formatted line to the standard
+/// output, followed by its latency buckets.
+///
+/// @param[in] rr  rollup row
+/// @param[in] bkt latency buckets, or NULL
+void
+print_rollup_csv(const raw_rollup* rr, const uint32_t* bkt)
+{
+  char line[ROLLUP_MAX_LEN];
+  char* end;
+  size_t i;
+
+  end = put_uint(line, rr->rr_start);
+  *end++ = ',';
+  end = put_uint(end, rr->rr_dur);
+  *end++ = ',';
+  end = put_uint(end, rr->rr_key);
+  *end++ = ',';
+  end = put_maddr(end, rr->rr_maddr);
+  *end++ = ',';
+  end = put_name(end, rr->rr_piname, sizeof(rr->rr_piname));
+  *end++ = ',';
+  end = put_name(end, rr->rr_phname, sizeof(rr->rr_phname));
+  *end++ = ',';
+  end = put_name(end, rr->rr_iname, sizeof(rr->rr_iname));
+  *end++ = ',';
+  end = put_name(end, rr->rr_hname, sizeof(rr->rr_hname));
+  *end++ = ',';
+  end = put_uint(end, rr->rr_recv);
+  *end++ = ',';
+  end = put_uint(end, rr->rr_bytes);
+  *end++ = ',';
+  end = put_uint(end, rr->rr_lost);
+  *end++ = ',';
+  end = put_uint(end, rr->rr_gaps);
+  *end++ = ',';
+  end = put_uint(end, rr->rr_dups);
+  *end++ = ',';
+  end = put_uint(end, rr->rr_reord);
+  *end++ = ',';
+  end = put_uint(end, rr->rr_lmin);
+  *end++ = ',';
+  end = put_uint(end, rr->rr_lmean);
+  *end++ = ',';
+  end = put_uint(end, rr->rr_lmax);
+  *end++ = ',';
+  end = put_uint(end, rr->rr_lp99);
+  *end++ = ',';
+  end = put_uint(end, rr->rr_drops);
+
+  for (i = 0; bkt != NULL && i < rr->rr_nbkt; i++) {
+    *end++ = ',';
+    end = put_uint(end, bkt[i]);
+  }
+  *end++ = '\n';
+
+  fwrite(line, 1, (size_t)(end - line), stdout);
+}
+
+/// Print the rollup row of a flow in the raw binary format to the standard
+/// output, followed by its latency buckets.
+///
+/// @param[in] rr  rollup row
+/// @param[in] bkt latency buckets, or NULL
+void
+print_rollup_raw(const raw_rollup* rr, const uint32_t* bkt)
+{
+  fwrite(rr, sizeof(*rr), 1, stdout);
+  if (bkt != NULL)
+    fwrite(bkt, sizeof(*bkt), rr->rr_nbkt, stdout);
+}
@@ -0,0 +1,27 @@
+// Copyright (c) 2017-2018 Two Sigma Open Source, LLC.
+// All Rights Reserved
+//
+// Distributed under the terms of the 2-clause BSD License. The full
+// license is in the file LICENSE, distributed as part of this software.
+
+#ifndef MBEAT_OUTPUT_H
+#define MBEAT_OUTPUT_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "types.h"
+
+
+bool output_columns(const char* spec);
+bool output_has_column(const char* name);
+void print_csv_header(FILE* out);
+void print_record_csv(FILE* out, const raw_output* ro);
+void print_record_raw(FILE* out, const raw_output* ro);
+void print_rollup_header(const size_t nbkt);
+void print_rollup_csv(const raw_rollup* rr, const uint32_t* bkt);
+void print_rollup_raw(const raw_rollup* rr, const uint32_t* bkt);
+
+#endif
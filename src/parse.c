@@ -68,8 +68,12 @@ parse_uint64(uint64_t* out,
 /// @param[out] ep  connection endpoint
 /// @param[in]  inp input string
 /// @param[in]  ifs list of interfaces
+/// @param[in]  lvl notification level of the problems
 static bool
-parse_iface(endpoint* ep, const char* inp, const struct ifaddrs* ifaces)
+parse_iface(endpoint* ep,
+            const char* inp,
+            const struct ifaddrs* ifaces,
+            const uint8_t lvl)
 {
   const struct ifaddrs* iface;
   struct sockaddr_in* if_addr_in;
@@ -94,9 +98,9 @@ parse_iface(endpoint* ep, const char* inp, const struct ifaddrs* ifaces)
   // If no suitable interface was found.
   if (iface == NULL) {
     if (inp == NULL)
-      notify(NL_ERROR, false, "Unable to find any suitable interface");
+      notify(lvl, false, "Unable to find any suitable interface");
     else
-      notify(NL_ERROR, false, "Unable to find interface %s with an "
+      notify(lvl, false, "Unable to find interface %s with an "
              "IPv4 address", inp);
 
     return false;
@@ -104,13 +108,13 @@ parse_iface(endpoint* ep, const char* inp, const struct ifaddrs* ifaces)
 
   // Make sure that the interface is up.
   if (!(iface->ifa_flags & IFF_UP)) {
-    notify(NL_ERROR, false, "Interface %s is not up", iface->ifa_name);
+    notify(lvl, false, "Interface %s is not up", iface->ifa_name);
     return false;
   }
 
   // Make sure that the interface supports multicast traffic.
   if (!(iface->ifa_flags & IFF_MULTICAST)) {
-    notify(NL_ERROR, false, "Interface %s is not available for "
+    notify(lvl, false, "Interface %s is not available for "
            "multicast traffic", iface->ifa_name);
     return false;
   }
@@ -188,7 +192,7 @@ parse_endpoint(endpoint* ep, char* inp, const struct ifaddrs* ifs)
   }
 
   // Parse the endpoint interface.
-  if (!parse_iface(ep, iname, ifs))
+  if (!parse_iface(ep, iname, ifs, NL_ERROR))
     return false;
 
   // Parse the endpoint multicast address.
@@ -238,7 +242,7 @@ parse_endpoints(endpoint** eps,
 
   for (i = 0; i < ep_cnt; i++) {
     // Parse all endpoint parts.
-    new = malloc(sizeof(*new));
+    new = calloc(1, sizeof(*new));
     if (new == NULL) {
       notify(NL_ERROR, true, "Unable to allocate memory for an endpoint");
       return false;
@@ -262,6 +266,28 @@ parse_endpoints(endpoint** eps,
   return result;
 }
 
+/// Resolve the address of the interface of an endpoint again, after the
+/// interface changed. Problems are reported as warnings, as the interface is
+/// expected to recover.
+/// @return status code
+///
+/// @param[out] addr   interface address
+/// @param[in]  ep     endpoint
+/// @param[in]  ifaces list of network interfaces
+bool
+parse_refresh(struct in_addr* addr,
+              const endpoint* ep,
+              const struct ifaddrs* ifaces)
+{
+  endpoint tmp;
+
+  if (!parse_iface(&tmp, ep->ep_iname, ifaces, NL_WARN))
+    return false;
+
+  *addr = tmp.ep_iaddr;
+  return true;
+}
+
 /// Find the multiplier for the selected time unit for conversion to
 /// nanoseconds.
 ///
@@ -7,8 +7,11 @@
 #ifndef MBEAT_PARSE_H
 #define MBEAT_PARSE_H
 
+#include <netinet/in.h>
+
 #include <stdbool.h>
 #include <stdint.h>
+#include <ifaddrs.h>
 
 #include "types.h"
 
@@ -23,6 +26,10 @@ bool parse_endpoints(endpoint** eps,
                      char* argv[],
                      const int ep_cnt);
 
+bool parse_refresh(struct in_addr* addr,
+                   const endpoint* ep,
+                   const struct ifaddrs* ifaces);
+
 bool parse_scalar(uint64_t* out,
                   const char* inp,
                   void (*upf) (uint64_t*, const char*));
@@ -7,29 +7,77 @@
 #ifndef MBEAT_PLATFORM_H
 #define MBEAT_PLATFORM_H
 
-// This header defines three macros: MBEAT_EVENT_PSELECT, MBEAT_EVENT_KQUEUE,
-// and MBEAT_EVENT_EPOLL. Based on the operating system and available event
-// queue, one of these values becomes the value of MBEAT_EVENT, which is
-// used to include the correct code.
-#define MBEAT_EVENT_PSELECT 0
-#define MBEAT_EVENT_EPOLL   1
-#define MBEAT_EVENT_KQUEUE  2
-
-// Enforce the fully POSIX-compliant behaviour. This way it is possible to use
-// the standard event queue even on systems that support more advanced queues.
-#if defined(MBEAT_FORCE_POSIX)
-  #define MBEAT_EVENT MBEAT_EVENT_PSELECT
-#else
-  #if defined(__linux__)
-    #define MBEAT_EVENT MBEAT_EVENT_EPOLL
-  #elif defined(__FreeBSD__) \
-     || defined(__NetBSD__)  \
-     || defined(__OpenBSD__) \
-     || defined(__DragonFly__)
-    #define MBEAT_EVENT MBEAT_EVENT_KQUEUE
-  #else
-    #define MBEAT_EVENT MBEAT_EVENT_PSELECT
-  #endif
+// Availability of the event queues. The POSIX event queues, poll and pselect,
+// are available on all platforms. Enforcing the fully POSIX-compliant
+// behaviour leaves out the more advanced queues of the operating system.
+#if !defined(MBEAT_FORCE_POSIX) && defined(__linux__)
+  #define MBEAT_HAVE_EPOLL
+#endif
+
+#if !defined(MBEAT_FORCE_POSIX) \
+ && (defined(__FreeBSD__) || defined(__NetBSD__) \
+  || defined(__OpenBSD__) || defined(__DragonFly__))
+  #define MBEAT_HAVE_KQUEUE
+#endif
+
+
+// Availability of the sendmmsg(2) function, which publishes multiple datagrams
+// with a single system call.
+#if !defined(MBEAT_FORCE_POSIX) && (defined(__linux__) || defined(__FreeBSD__))
+  #define MBEAT_HAVE_SENDMMSG
+#endif
+
+// Availability of the recvmmsg(2) function, which receives multiple datagrams
+// with a single system call.
+#if !defined(MBEAT_FORCE_POSIX) && (defined(__linux__) || defined(__FreeBSD__))
+  #define MBEAT_HAVE_RECVMMSG
+#endif
+
+// Availability of zero-copy sends with completions reported through the socket
+// error queue.
+#if !defined(MBEAT_FORCE_POSIX) && defined(__linux__)
+  #define MBEAT_HAVE_ZEROCOPY
+#endif
+
+// Availability of per-datagram launch times and transmit timestamps.
+#if !defined(MBEAT_FORCE_POSIX) && defined(__linux__)
+  #define MBEAT_HAVE_TXTIME
+#endif
+
+// Availability of the Time Stamp Counter as a timestamp source.
+#if !defined(MBEAT_FORCE_POSIX) && defined(__GNUC__) \
+ && (defined(__x86_64__) || defined(__i386__))
+  #define MBEAT_HAVE_TSC
+#endif
+
+// Availability of the SSSE3 byte shuffles for the decode of received
+// datagrams, subject to a check of the processor at runtime.
+#if !defined(MBEAT_FORCE_POSIX) && defined(__GNUC__) \
+ && (defined(__x86_64__) || defined(__i386__))
+  #define MBEAT_HAVE_SSSE3
+#endif
+
+// Availability of pinning the process to a set of processors.
+#if !defined(MBEAT_FORCE_POSIX) && defined(__linux__)
+  #define MBEAT_HAVE_AFFINITY
+#endif
+
+// Availability of the NUMA topology of processors and network devices, and of
+// the processor that delivered the traffic of a socket.
+#if !defined(MBEAT_FORCE_POSIX) && defined(__linux__)
+  #define MBEAT_HAVE_NUMA
+#endif
+
+// Availability of the counter of the datagrams that the kernel dropped on a
+// socket, reported with each received datagram.
+#if !defined(MBEAT_FORCE_POSIX) && defined(__linux__)
+  #define MBEAT_HAVE_RXQ_OVFL
+#endif
+
+// Availability of the rtnetlink(7) notifications about the changes of links,
+// addresses and routes.
+#if !defined(MBEAT_FORCE_POSIX) && defined(__linux__)
+  #define MBEAT_HAVE_RTNETLINK
 #endif
 
 #endif
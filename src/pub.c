@@ -4,9 +4,15 @@
 // Distributed under the terms of the 2-clause BSD License. The full
 // license is in the file LICENSE, distributed as part of this software.
 
+// The sendmmsg(2) function is a GNU extension on Linux.
+#if defined(__linux__) && !defined(MBEAT_FORCE_POSIX)
+  #define _GNU_SOURCE
+#endif
+
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/time.h>
+#include <sys/resource.h>
 #include <sys/uio.h>
 
 #include <net/if.h>
@@ -25,10 +31,17 @@
 #include <time.h>
 #include <err.h>
 #include <getopt.h>
+#include <poll.h>
 
+#include "platform.h"
 #include "types.h"
 #include "common.h"
 #include "parse.h"
+#include "zcopy.h"
+#include "txtime.h"
+#include "flow.h"
+#include "tstamp.h"
+#include "tune.h"
 
 
 // Default values for optional arguments.
@@ -41,6 +54,54 @@
 #define DEF_LOOP                  0 // Looping policy on localhost.
 #define DEF_NOTIFY_LEVEL          1 // Log errors and warnings by default.
 #define DEF_NOTIFY_COLOR          1 // Colors in the notification output.
+#define DEF_FLOWS                 1 // Number of flows per endpoint.
+#define DEF_SIZE_STEP             1 // Size increment of a sweep.
+#define DEF_LEAD_TIME      10000000 // Rounds are queued 10ms ahead of launch.
+#define DEF_ANNOUNCE     1000000000 // Publishers are announced every second.
+
+// Long-only command-line options.
+#define LO_SIZE_MAX  256
+#define LO_SIZE_STEP 257
+#define LO_ZERO_COPY 258
+#define LO_LAUNCH    259
+#define LO_LEAD_TIME 260
+#define LO_CLOCK     261
+#define LO_BACKPRESS 262
+#define LO_ANNOUNCE  263
+#define LO_PAYLOAD   264
+#define LO_FOLLOW_UP 265
+#define LO_SHARE     266
+#define LO_LATENCY   267
+#define LO_CPU       268
+#define LO_HUGEPAGES 269
+
+// Reactions to a full send buffer.
+#define BP_DROP 0 // Drop the datagram.
+#define BP_WAIT 1 // Wait until the socket becomes writable.
+#define BP_AIMD 2 // Drop the datagram and slow down the publishing rate.
+
+// Waiting for the send buffer space.
+#define WAIT_TIMEOUT    1000 // Maximal wait for a writable socket in ms.
+#define NOBUFS_PAUSE  100000 // Pause before retrying after ENOBUFS.
+#define NOBUFS_TRIES     100 // Number of retries after ENOBUFS.
+#define WBLOCK_TRIES     100 // Number of retries after EAGAIN.
+
+// Additional delay between rounds under congestion.
+#define AIMD_MIN       10000 // Initial delay after the first congestion.
+#define AIMD_MAX  1000000000 // Maximal delay.
+#define AIMD_STEP      10000 // Reduction after a round without congestion.
+
+// Maximal size of a UDP datagram over IPv4.
+#define SIZE_MAX_UDP 65507
+
+// Maximal number of simulated flows per endpoint.
+#define FLOW_MAX 1048576
+
+// Maximal number of datagrams published with a single system call.
+#define BATCH_LEN 64
+
+// Maximal number of shared sockets per interface.
+#define SHARE_MAX 64
 
 // Command-line options.
 static uint64_t op_buf;  ///< Socket send buffer size in bytes.
@@ -54,6 +115,85 @@ static uint8_t  op_err;  ///< Process exit policy on publishing error.
 static uint8_t  op_loop; ///< Datagram looping policy on local host.
 static uint8_t  op_nlvl; ///< Notification verbosity level.
 static uint8_t  op_ncol; ///< Notification coloring policy.
+static uint64_t op_flws; ///< Number of simulated flows per endpoint.
+static uint64_t op_size; ///< Datagram size in bytes.
+static uint64_t op_smax; ///< Maximal datagram size of the sweep.
+static uint64_t op_sstp; ///< Datagram size increment of the sweep.
+static uint8_t  op_zc;   ///< Send datagrams without copying them.
+static uint8_t  op_txt;  ///< Hand datagrams over with a launch time.
+static clockid_t op_tclk; ///< Clock of the launch times.
+static uint64_t op_lead; ///< Duration between queueing and launch of a round.
+static uint8_t  op_bp;   ///< Reaction to a full send buffer.
+static uint64_t op_fver; ///< Payload format version.
+static uint64_t op_aint; ///< Interval between announcements.
+static uint8_t  op_fup;  ///< Carry the transmit time of the previous datagram.
+static uint64_t op_shr;  ///< Number of shared sockets per interface.
+static uint64_t op_lat;  ///< Real-time priority of the latency mode.
+static uint64_t op_cpu;  ///< CPU of the process.
+static uint8_t  op_pin;  ///< Pin the process to a CPU.
+static uint8_t  op_huge; ///< Back large buffers with huge pages.
+
+/// Size of the payload in front of the padding.
+static size_t pl_size;
+
+// Schedule of the current round with launch times.
+static uint64_t rd_launch; ///< Launch time on the launch clock.
+static uint64_t rd_rtime;  ///< Launch time on the system clock.
+static uint64_t rd_mtime;  ///< Launch time on the steady clock.
+
+/// Pre-built padding shared by all datagrams.
+static uint8_t* padding;
+
+// Publishing statistics.
+static uint64_t st_dgrams; ///< Number of published datagrams.
+static uint64_t st_bytes;  ///< Number of published bytes.
+static uint64_t st_drops;  ///< Number of datagrams that were not published.
+static uint64_t st_delay;  ///< Additional delay between rounds.
+static uint64_t st_backs;  ///< Number of rate reductions.
+static bool     st_cong;   ///< Congestion was detected in the current round.
+static uint64_t st_anns;   ///< Number of published announcements.
+
+/// Simulated publisher flows.
+static pub_flow* flows;
+
+/// Sockets shared by the endpoints of an interface.
+typedef struct _sock_pool {
+  struct in_addr sp_iaddr;            ///< Local interface address.
+  uint64_t       sp_neps;             ///< Number of endpoints.
+  uint64_t       sp_seen;             ///< Number of assigned endpoints.
+  uint64_t       sp_open;             ///< Number of opened sockets.
+  int            sp_sock[SHARE_MAX];  ///< Sockets.
+} sock_pool;
+
+/// Position of an endpoint in the socket order.
+typedef struct _ep_slot {
+  endpoint* es_ep;  ///< Endpoint.
+  uint64_t  es_key; ///< Interface, later socket, of the endpoint.
+  uint64_t  es_idx; ///< Position in the endpoint list.
+} ep_slot;
+
+#if !defined(MBEAT_HAVE_SENDMMSG)
+/// Message entry of a batch, as defined by the sendmmsg(2) interface.
+struct mmsghdr {
+  struct msghdr msg_hdr; ///< Message.
+  unsigned int  msg_len; ///< Number of sent bytes.
+};
+#endif
+
+// Batch of outgoing datagrams.
+static struct mmsghdr     bt_msg[BATCH_LEN];    ///< Messages.
+static struct iovec       bt_iov[BATCH_LEN][2]; ///< Payload and padding.
+static struct sockaddr_in bt_addr[BATCH_LEN];   ///< Message destinations.
+static datagram           bt_pl[BATCH_LEN];     ///< Payloads.
+static bool               bt_ann[BATCH_LEN];    ///< Messages are announcements.
+static uint64_t           bt_rtm[BATCH_LEN];    ///< Departure times in payloads.
+static endpoint*          bt_ep[BATCH_LEN];     ///< Endpoints of the messages.
+static uint64_t           bt_flw[BATCH_LEN];    ///< Flows of the messages.
+static union {
+  char           cc_buf[CMSG_SPACE(sizeof(uint64_t))];
+  struct cmsghdr cc_align;
+} bt_ctl[BATCH_LEN]; ///< Launch times of the messages.
+static unsigned int       bt_cnt;               ///< Number of queued messages.
 
 /// Print the utility usage information to the standard output.
 static void
@@ -70,6 +210,7 @@ print_usage(void)
     "  -b, --buffer-size BSZ    Send buffer size in bytes.\n"
     "  -c, --count CNT          Publish exactly CNT datagrams. (def=%d)\n"
     "  -e, --exit-on-error      Stop the process on publishing error.\n"
+    "  -f, --flows CNT          Simulate CNT flows per endpoint. (def=%d)\n"
     "  -h, --help               Print this help message.\n"
     "  -k, --key KEY            Key for the current run. (def=random)\n"
     "  -l, --loopback           Turn on datagram looping.\n"
@@ -78,14 +219,39 @@ print_usage(void)
     "  -p, --port NUM           UDP port to use for all endpoints. (def=%d)\n"
     "  -s, --sleep-time DUR     Sleep duration between published datagram rounds. (def=1s)\n"
     "  -t, --time-to-live TTL   Set the Time-To-Live for all published datagrams. (def=%d)\n"
-    "  -v, --verbose            Increase the verbosity of the logging output.\n",
+    "  -v, --verbose            Increase the verbosity of the logging output.\n"
+    "  -z, --size SZ            Size of each datagram in bytes. (def=%zu)\n"
+    "      --size-max SZ        Sweep datagram sizes up to SZ bytes.\n"
+    "      --size-step SZ       Size increment of the sweep. (def=%d)\n"
+    "      --zero-copy          Send datagrams without copying them.\n"
+    "      --launch-time[=CLK]  Let the kernel launch each round on schedule.\n"
+    "                           CLK is monotonic (fq, def) or tai (etf).\n"
+    "      --lead-time DUR      Queue rounds DUR ahead of launch. (def=10ms)\n"
+    "      --clock SRC          Timestamp source: realtime, tai, monotonic_raw\n"
+    "                           or tsc. (def=realtime)\n"
+    "      --backpressure MODE  Reaction to a full send buffer: drop, wait\n"
+    "                           or aimd. (def=drop)\n"
+    "      --announce DUR       Interval between announcements. (def=1s)\n"
+    "      --payload-version V  Payload format version, 4 or 5. (def=%d)\n"
+    "      --follow-up          Carry the transmit time of the previous datagram.\n"
+    "      --share-sockets[=CNT] Share CNT sockets among the endpoints of each\n"
+    "                           interface. (def=1)\n"
+    "      --latency-mode[=PRIO] Lock memory, run with the real-time priority\n"
+    "                           PRIO and keep the CPUs awake. (def=%d)\n"
+    "      --cpu CPU            Pin the process to CPU.\n"
+    "      --hugepages          Back large buffers with huge pages.\n",
     MBEAT_VERSION_MAJOR,
     MBEAT_VERSION_MINOR,
     MBEAT_VERSION_PATCH,
     DEF_COUNT,
+    DEF_FLOWS,
     DEF_OFFSET,
     MBEAT_PORT,
-    DEF_TIME_TO_LIVE);
+    DEF_TIME_TO_LIVE,
+    sizeof(compact),
+    DEF_SIZE_STEP,
+    MBEAT_PAYLOAD_VERSION,
+    TUNE_PRIORITY);
 }
 
 /// Generate a random key.
@@ -112,6 +278,52 @@ generate_key(void)
   return key;
 }
 
+/// Parse the name of the clock used for launch times.
+/// @return status code
+///
+/// @param[out] clk clock identifier
+/// @param[in]  str clock name (optional)
+static bool
+parse_launch_clock(clockid_t* clk, const char* str)
+{
+  if (str == NULL || strcmp(str, "monotonic") == 0) {
+    *clk = CLOCK_MONOTONIC;
+    return true;
+  }
+
+#if defined(CLOCK_TAI)
+  if (strcmp(str, "tai") == 0) {
+    *clk = CLOCK_TAI;
+    return true;
+  }
+#endif
+
+  notify(NL_ERROR, false, "Unknown launch time clock %s", str);
+  return false;
+}
+
+/// Parse the reaction to a full send buffer.
+/// @return status code
+///
+/// @param[out] bp  reaction
+/// @param[in]  str reaction name
+static bool
+parse_backpressure(uint8_t* bp, const char* str)
+{
+  if (strcmp(str, "drop") == 0)
+    *bp = BP_DROP;
+  else if (strcmp(str, "wait") == 0)
+    *bp = BP_WAIT;
+  else if (strcmp(str, "aimd") == 0)
+    *bp = BP_AIMD;
+  else {
+    notify(NL_ERROR, false, "Unknown backpressure mode %s", str);
+    return false;
+  }
+
+  return true;
+}
+
 /// Parse the command-line options.
 /// @return status code
 ///
@@ -124,18 +336,34 @@ parse_args(int* ep_cnt, int* ep_idx, int argc, char* argv[])
 {
   int opt;
   struct option lopts[] = {
-    {"buffer-size",   required_argument, NULL, 'b'},
-    {"count",         required_argument, NULL, 'c'},
-    {"exit-on-error", no_argument,       NULL, 'e'},
-    {"help",          no_argument,       NULL, 'h'},
-    {"key",           required_argument, NULL, 'k'},
-    {"loopback",      no_argument,       NULL, 'l'},
-    {"no-color",      no_argument,       NULL, 'n'},
-    {"offset",        required_argument, NULL, 'o'},
-    {"port",          required_argument, NULL, 'p'},
-    {"sleep-time",    required_argument, NULL, 's'},
-    {"time-to-live",  required_argument, NULL, 't'},
-    {"verbose",       no_argument,       NULL, 'v'},
+    {"buffer-size",     required_argument, NULL, 'b'},
+    {"count",           required_argument, NULL, 'c'},
+    {"exit-on-error",   no_argument,       NULL, 'e'},
+    {"flows",           required_argument, NULL, 'f'},
+    {"help",            no_argument,       NULL, 'h'},
+    {"key",             required_argument, NULL, 'k'},
+    {"loopback",        no_argument,       NULL, 'l'},
+    {"no-color",        no_argument,       NULL, 'n'},
+    {"offset",          required_argument, NULL, 'o'},
+    {"port",            required_argument, NULL, 'p'},
+    {"sleep-time",      required_argument, NULL, 's'},
+    {"time-to-live",    required_argument, NULL, 't'},
+    {"verbose",         no_argument,       NULL, 'v'},
+    {"size",            required_argument, NULL, 'z'},
+    {"size-max",        required_argument, NULL, LO_SIZE_MAX},
+    {"size-step",       required_argument, NULL, LO_SIZE_STEP},
+    {"zero-copy",       no_argument,       NULL, LO_ZERO_COPY},
+    {"launch-time",     optional_argument, NULL, LO_LAUNCH},
+    {"lead-time",       required_argument, NULL, LO_LEAD_TIME},
+    {"clock",           required_argument, NULL, LO_CLOCK},
+    {"backpressure",    required_argument, NULL, LO_BACKPRESS},
+    {"announce",        required_argument, NULL, LO_ANNOUNCE},
+    {"payload-version", required_argument, NULL, LO_PAYLOAD},
+    {"follow-up",       no_argument,       NULL, LO_FOLLOW_UP},
+    {"share-sockets",   optional_argument, NULL, LO_SHARE},
+    {"latency-mode",    optional_argument, NULL, LO_LATENCY},
+    {"cpu",             required_argument, NULL, LO_CPU},
+    {"hugepages",       no_argument,       NULL, LO_HUGEPAGES},
     {NULL, 0, NULL, 0}
   };
 
@@ -151,8 +379,25 @@ parse_args(int* ep_cnt, int* ep_idx, int argc, char* argv[])
   op_nlvl = nlvl = DEF_NOTIFY_LEVEL;
   op_ncol = ncol = DEF_NOTIFY_COLOR;
   op_key  = generate_key();
-
-  while ((opt = getopt_long(argc, argv, "b:c:ehk:lno:p:s:t:v", lopts, NULL)) != -1) {
+  op_flws = DEF_FLOWS;
+  op_size = 0;
+  op_smax = 0;
+  op_sstp = DEF_SIZE_STEP;
+  op_zc   = 0;
+  op_txt  = 0;
+  op_tclk = CLOCK_MONOTONIC;
+  op_lead = DEF_LEAD_TIME;
+  op_bp   = BP_DROP;
+  op_fver = MBEAT_PAYLOAD_VERSION;
+  op_aint = DEF_ANNOUNCE;
+  op_fup  = 0;
+  op_shr  = 0;
+  op_lat  = 0;
+  op_cpu  = 0;
+  op_pin  = 0;
+  op_huge = 0;
+
+  while ((opt = getopt_long(argc, argv, "b:c:ef:hk:lno:p:s:t:vz:", lopts, NULL)) != -1) {
     switch (opt) {
 
       // Send buffer size.
@@ -172,6 +417,12 @@ parse_args(int* ep_cnt, int* ep_idx, int argc, char* argv[])
         op_err = 1;
         break;
 
+      // Number of simulated flows.
+      case 'f':
+        if (parse_uint64(&op_flws, optarg, 1, FLOW_MAX) == 0)
+          return false;
+        break;
+
       // Usage information.
       case 'h':
         print_usage();
@@ -223,6 +474,98 @@ parse_args(int* ep_cnt, int* ep_idx, int argc, char* argv[])
           op_nlvl++;
         break;
 
+      // Datagram size.
+      case 'z':
+        if (parse_uint64(&op_size, optarg, sizeof(compact), SIZE_MAX_UDP) == 0)
+          return false;
+        break;
+
+      // Maximal datagram size of the sweep.
+      case LO_SIZE_MAX:
+        if (parse_uint64(&op_smax, optarg, sizeof(compact), SIZE_MAX_UDP) == 0)
+          return false;
+        break;
+
+      // Datagram size increment of the sweep.
+      case LO_SIZE_STEP:
+        if (parse_uint64(&op_sstp, optarg, 1, SIZE_MAX_UDP) == 0)
+          return false;
+        break;
+
+      // Zero-copy sends.
+      case LO_ZERO_COPY:
+        op_zc = 1;
+        break;
+
+      // Launch times and their clock.
+      case LO_LAUNCH:
+        op_txt = 1;
+        if (!parse_launch_clock(&op_tclk, optarg))
+          return false;
+        break;
+
+      // Duration between queueing and launch of a round.
+      case LO_LEAD_TIME:
+        if (parse_scalar(&op_lead, optarg, parse_time_unit) == 0)
+          return false;
+        break;
+
+      // Timestamp source.
+      case LO_CLOCK:
+        if (!tstamp_select(optarg))
+          return false;
+        break;
+
+      // Reaction to a full send buffer.
+      case LO_BACKPRESS:
+        if (!parse_backpressure(&op_bp, optarg))
+          return false;
+        break;
+
+      // Interval between announcements.
+      case LO_ANNOUNCE:
+        if (parse_scalar(&op_aint, optarg, parse_time_unit) == 0)
+          return false;
+        break;
+
+      // Payload format version.
+      case LO_PAYLOAD:
+        if (parse_uint64(&op_fver, optarg, MBEAT_PAYLOAD_FULL,
+                         MBEAT_PAYLOAD_VERSION) == 0)
+          return false;
+        break;
+
+      // Transmit times of the previous datagrams.
+      case LO_FOLLOW_UP:
+        op_fup = 1;
+        break;
+
+      // Shared sockets per interface.
+      case LO_SHARE:
+        op_shr = 1;
+        if (optarg != NULL && parse_uint64(&op_shr, optarg, 1, SHARE_MAX) == 0)
+          return false;
+        break;
+
+      // Low-latency tuning of the host.
+      case LO_LATENCY:
+        op_lat = TUNE_PRIORITY;
+        if (optarg != NULL && parse_uint64(&op_lat, optarg, 1, 99) == 0)
+          return false;
+        break;
+
+      // CPU of the process.
+      case LO_CPU:
+        op_pin = 1;
+        if (parse_uint64(&op_cpu, optarg, 0, TUNE_CPU_MAX) == 0)
+          return false;
+        break;
+
+      // Huge pages for large buffers.
+      case LO_HUGEPAGES:
+        op_huge = 1;
+        break;
+
       // Unknown option.
       case '?':
         fprintf(stderr, "Invalid option '%c'.\n", optopt);
@@ -240,126 +583,1251 @@ parse_args(int* ep_cnt, int* ep_idx, int argc, char* argv[])
   nlvl = op_nlvl;
   ncol = op_ncol;
 
+  // Datagrams are at least as large as the payload.
+  pl_size = op_fver == MBEAT_PAYLOAD_FULL ? sizeof(payload) : sizeof(compact);
+  if (op_size == 0)
+    op_size = pl_size;
+  if (op_size < pl_size) {
+    notify(NL_ERROR, false, "Size %" PRIu64 " is smaller than the payload of "
+           "%zu bytes", op_size, pl_size);
+    return false;
+  }
+
+  // Validate the range of the size sweep.
+  if (op_smax != 0 && op_smax < op_size) {
+    notify(NL_ERROR, false, "Maximal size %" PRIu64 " is smaller than the "
+           "size %" PRIu64, op_smax, op_size);
+    return false;
+  }
+
+  // The kernel performs the pacing of datagrams with launch times.
+  if (op_txt && op_bp == BP_AIMD) {
+    notify(NL_ERROR, false, "Adaptive rate is not available with launch times");
+    return false;
+  }
+
+  // Both modes consume the socket error queue in a different manner.
+  if (op_zc && (op_txt || op_fup)) {
+    notify(NL_ERROR, false, "Zero-copy sends are exclusive with launch times "
+           "and follow-up timestamps");
+    return false;
+  }
+
+  // The completions and timestamps of the error queue are tracked per
+  // endpoint rather than per socket.
+  if (op_shr > 0 && (op_zc || op_txt || op_fup)) {
+    notify(NL_ERROR, false, "Shared sockets are not available with zero-copy "
+           "sends, launch times and follow-up timestamps");
+    return false;
+  }
+
+  // Only the compact payload has room for the follow-up timestamp.
+  if (op_fup && op_fver == MBEAT_PAYLOAD_FULL) {
+    notify(NL_ERROR, false, "Follow-up timestamps require the payload format "
+           "version %d", MBEAT_PAYLOAD_VERSION);
+    return false;
+  }
+
   *ep_cnt = argc - optind;
   *ep_idx = optind;
 
   return true;
 }
 
-/// Create endpoint sockets and apply the interface settings.
-/// @return status code
+/// Create a socket and apply the settings of the interface of an endpoint.
+/// @return socket, or -1 on error
 ///
-/// @param[in] eps  endpoint list
-static bool
-create_sockets(endpoint* eps)
+/// @param[in] ep endpoint
+static int
+open_socket(const endpoint* ep)
 {
+  int sock;
   int enable;
   uint8_t ttl_set;
   int buf_size;
-  endpoint* ep;
 
+  // Create a UDP socket.
+  sock = socket(AF_INET, SOCK_DGRAM, 0);
+  if (sock == -1) {
+    notify(NL_ERROR, true, "Unable to create socket");
+    return -1;
+  }
+
+  // Enable multiple sockets being bound to the same address/port.
   enable = 1;
-  for (ep = eps; ep != NULL; ep = ep->ep_next) {
-    notify(NL_INFO, false,
-           "Creating endpoint on interface %s for multicast group %s",
-           ep->ep_iname, inet_ntoa(ep->ep_maddr));
+  if (setsockopt(sock, SOL_SOCKET, SO_REUSEADDR,
+                 &enable, sizeof(enable)) == -1) {
+    notify(NL_ERROR, true, "Unable to set the socket address reusable");
+    return -1;
+  }
 
-    // Create a UDP socket.
-    ep->ep_sock = socket(AF_INET, SOCK_DGRAM, 0);
-    if (ep->ep_sock == -1) {
-      notify(NL_ERROR, true, "Unable to create socket");
-      return false;
+  // Set the socket send buffer size to the requested value.
+  if (op_buf != 0) {
+    notify(NL_TRACE, false,
+           "Setting socket send buffer to %" PRIu64 " bytes", op_buf);
+    buf_size = (int)op_buf;
+    if (setsockopt(sock, SOL_SOCKET, SO_SNDBUF,
+                   &buf_size, sizeof(buf_size)) == -1) {
+      notify(NL_ERROR, true,
+             "Unable to set the socket send buffer size to %d", buf_size);
+      return -1;
     }
+  }
 
-    // Enable multiple sockets being bound to the same address/port.
-    if (setsockopt(ep->ep_sock, SOL_SOCKET, SO_REUSEADDR,
-                   &enable, sizeof(enable)) == -1) {
-      notify(NL_ERROR, true, "Unable to set the socket address reusable");
-      return false;
-    }
+  // Limit the socket to the selected interface.
+  if (setsockopt(sock, IPPROTO_IP, IP_MULTICAST_IF,
+                 &(ep->ep_iaddr), sizeof(ep->ep_iaddr)) == -1) {
+    notify(NL_ERROR, true, "Unable to set the socket interface to %s",
+           ep->ep_iname);
+    return -1;
+  }
 
-    // Set the socket send buffer size to the requested value.
-    if (op_buf != 0) {
-      notify(NL_TRACE, false,
-             "Setting socket send buffer to %" PRIu64 " bytes", op_buf);
-      buf_size = (int)op_buf;
-      if (setsockopt(ep->ep_sock, SOL_SOCKET, SO_SNDBUF,
-                     &buf_size, sizeof(buf_size)) == -1) {
-        notify(NL_ERROR, true,
-               "Unable to set the socket send buffer size to %d", buf_size);
-        return false;
+  // Set the datagram looping policy.
+  if (setsockopt(sock, IPPROTO_IP, IP_MULTICAST_LOOP,
+                 &op_loop, sizeof(op_loop)) == -1) {
+    notify(NL_ERROR, true,
+           "Unable to turn %s the localhost datagram delivery",
+           op_loop ? "on" : "off");
+    return -1;
+  }
+
+  // Adjust the Time-To-Live setting to reach farther networks.
+  ttl_set = (uint8_t)op_ttl;
+  if (setsockopt(sock, IPPROTO_IP, IP_MULTICAST_TTL,
+                 &ttl_set, sizeof(ttl_set)) == -1) {
+    notify(NL_ERROR, true,
+           "Unable to set Time-To-Live of datagrams to %" PRIu8, ttl_set);
+    return -1;
+  }
+
+  // Let the kernel reference the datagram data instead of copying it.
+  if (op_zc && !zc_enable(sock))
+    return -1;
+
+  // Let the queueing discipline release the datagrams on schedule.
+  if (op_txt && !tx_enable(sock, op_tclk))
+    return -1;
+
+  // Learn the time at which each datagram reached the device.
+  if ((op_txt || op_fup) && !tx_stamp(sock))
+    return -1;
+
+  return sock;
+}
+
+/// Compare two endpoints by their socket order, preserving the order of the
+/// endpoint list otherwise.
+/// @return negative, zero or positive integer
+///
+/// @param[in] a first endpoint slot
+/// @param[in] b second endpoint slot
+static int
+compare_slots(const void* a, const void* b)
+{
+  const ep_slot* x;
+  const ep_slot* y;
+
+  x = a;
+  y = b;
+  if (x->es_key != y->es_key)
+    return x->es_key < y->es_key ? -1 : 1;
+  if (x->es_idx != y->es_idx)
+    return x->es_idx < y->es_idx ? -1 : 1;
+
+  return 0;
+}
+
+/// Let all endpoints of each interface share a small pool of sockets. The
+/// endpoints of an interface are split into contiguous chunks, one per socket,
+/// and the endpoint list is reordered, so that the datagrams of each socket
+/// are adjacent in a round and can be published in a single batch.
+/// @return status code
+///
+/// @param[in,out] eps endpoint list
+/// @param[out]    cnt number of created sockets
+static bool
+share_sockets(endpoint** eps, uint64_t* cnt)
+{
+  ep_slot* slots;
+  sock_pool* pools;
+  sock_pool* sp;
+  void* tmp;
+  endpoint* ep;
+  uint64_t neps;
+  uint64_t npools;
+  uint64_t cap;
+  uint64_t i;
+  uint64_t k;
+  bool ret;
+
+  neps = 0;
+  for (ep = *eps; ep != NULL; ep = ep->ep_next)
+    neps++;
+
+  ret    = false;
+  pools  = NULL;
+  npools = 0;
+  cap    = 0;
+  slots  = calloc(neps, sizeof(*slots));
+  if (slots == NULL) {
+    notify(NL_ERROR, true, "Unable to allocate memory for %" PRIu64
+           " endpoints", neps);
+    return false;
+  }
+
+  // Count the endpoints of each interface.
+  for (ep = *eps, i = 0; ep != NULL; ep = ep->ep_next, i++) {
+    for (k = 0; k < npools; k++)
+      if (pools[k].sp_iaddr.s_addr == ep->ep_iaddr.s_addr)
+        break;
+
+    if (k == npools) {
+      if (npools == cap) {
+        cap = cap == 0 ? 4 : cap * 2;
+        tmp = realloc(pools, cap * sizeof(*pools));
+        if (tmp == NULL) {
+          notify(NL_ERROR, true, "Unable to allocate socket pools");
+          goto out;
+        }
+        pools = tmp;
       }
+
+      memset(&pools[k], 0, sizeof(pools[k]));
+      pools[k].sp_iaddr = ep->ep_iaddr;
+      npools++;
     }
 
-    // Limit the socket to the selected interface.
-    if (setsockopt(ep->ep_sock, IPPROTO_IP, IP_MULTICAST_IF,
-                   &(ep->ep_iaddr), sizeof(ep->ep_iaddr)) == -1) {
-      notify(NL_ERROR, true, "Unable to set the socket interface to %s",
-             ep->ep_iname);
-      return false;
+    pools[k].sp_neps++;
+    slots[i].es_ep  = ep;
+    slots[i].es_idx = i;
+    slots[i].es_key = k;
+  }
+
+  // Assign each endpoint to the socket of its chunk, opening the socket upon
+  // its first use.
+  *cnt = 0;
+  for (i = 0; i < neps; i++) {
+    sp = &pools[slots[i].es_key];
+    k = sp->sp_seen++ * op_shr / sp->sp_neps;
+
+    if (sp->sp_open <= k) {
+      sp->sp_sock[k] = open_socket(slots[i].es_ep);
+      if (sp->sp_sock[k] == -1)
+        goto out;
+
+      sp->sp_open = k + 1;
+      (*cnt)++;
     }
 
-    // Set the datagram looping policy.
-    if (setsockopt(ep->ep_sock, IPPROTO_IP, IP_MULTICAST_LOOP,
-                   &op_loop, sizeof(op_loop)) == -1) {
-      notify(NL_ERROR, true,
-             "Unable to turn %s the localhost datagram delivery",
-             op_loop ? "on" : "off");
+    slots[i].es_ep->ep_sock = sp->sp_sock[k];
+    slots[i].es_key = slots[i].es_key * op_shr + k;
+  }
+
+  // Reorder the endpoint list by socket.
+  qsort(slots, neps, sizeof(*slots), compare_slots);
+  for (i = 0; i < neps; i++)
+    slots[i].es_ep->ep_next = i + 1 < neps ? slots[i + 1].es_ep : NULL;
+  *eps = slots[0].es_ep;
+
+  ret = true;
+
+out:
+  free(slots);
+  free(pools);
+  return ret;
+}
+
+/// Create endpoint sockets and apply the interface settings.
+/// @return status code
+///
+/// @param[in,out] eps endpoint list
+static bool
+create_sockets(endpoint** eps)
+{
+  endpoint* ep;
+  uint64_t start;
+  uint64_t end;
+  uint64_t neps;
+  uint64_t cnt;
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  to_nanos(&start, now);
+
+  neps = 0;
+  for (ep = *eps; ep != NULL; ep = ep->ep_next) {
+    notify(NL_DEBUG, false,
+           "Creating endpoint on interface %s for multicast group %s",
+           ep->ep_iname, inet_ntoa(ep->ep_maddr));
+    neps++;
+  }
+
+  if (op_shr > 0) {
+    if (!share_sockets(eps, &cnt))
       return false;
+  } else {
+    cnt = 0;
+    for (ep = *eps; ep != NULL; ep = ep->ep_next) {
+      ep->ep_sock = open_socket(ep);
+      if (ep->ep_sock == -1)
+        return false;
+      cnt++;
     }
+  }
 
-    // Adjust the Time-To-Live setting to reach farther networks.
-    ttl_set = (uint8_t)op_ttl;
-    if (setsockopt(ep->ep_sock, IPPROTO_IP, IP_MULTICAST_TTL,
-                   &ttl_set, sizeof(ttl_set)) == -1) {
-      notify(NL_ERROR, true,
-             "Unable to set Time-To-Live of datagrams to %" PRIu8, ttl_set);
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  to_nanos(&end, now);
+  notify(NL_INFO, false, "Created %" PRIu64 " sockets for %" PRIu64
+         " endpoints in %.3fms", cnt, neps, (double)(end - start) / 1e6);
+
+  return true;
+}
+
+/// Create the simulated publisher flows. Each flow has a distinct key and its
+/// own sequence space. With more than one flow, the hostname and interface
+/// name of each flow are suffixed with the flow index.
+/// @return status code
+static bool
+create_flows(void)
+{
+  uint64_t i;
+  pub_flow* pf;
+  char sfx[32];
+  int len;
+
+  flows = calloc(op_flws, sizeof(*flows));
+  if (flows == NULL) {
+    notify(NL_ERROR, true, "Unable to allocate memory for %" PRIu64 " flows",
+           op_flws);
+    return false;
+  }
+
+  if (op_huge)
+    tune_advise(flows, op_flws * sizeof(*flows));
+
+  for (i = 0; i < op_flws; i++) {
+    pf = &flows[i];
+
+    // Derive the key from the key of the process, while skipping the zero
+    // value that denotes no filtering in the subscriber.
+    pf->pf_key = op_key + i;
+    if (pf->pf_key < op_key)
+      pf->pf_key++;
+
+    pf->pf_snum = op_off;
+    memcpy(pf->pf_hname, hname, sizeof(pf->pf_hname));
+    if (op_flws == 1)
+      continue;
+
+    // Append the flow index to the hostname, truncating the hostname if
+    // necessary.
+    len = snprintf(sfx, sizeof(sfx), "-%" PRIu64, i);
+    memset(pf->pf_hname, '\0', sizeof(pf->pf_hname));
+    snprintf(pf->pf_hname, sizeof(pf->pf_hname), "%.*s%s",
+             (int)(sizeof(pf->pf_hname) - 1 - (size_t)len), hname, sfx);
+
+    // Prepare the suffix of the interface name, in the style of an alias.
+    len = snprintf(sfx, sizeof(sfx), ":%" PRIu64, i);
+    memcpy(pf->pf_isfx, sfx, (size_t)len);
+    pf->pf_islen = (size_t)len;
+  }
+
+  notify(NL_DEBUG, false, "Simulating %" PRIu64 " flow%s per endpoint",
+         op_flws, op_flws > 1 ? "s" : "");
+  return true;
+}
+
+/// Create the padding that follows the payload in datagrams larger than the
+/// payload itself. The padding is built only once and shared by all datagrams,
+/// so that no per-datagram copying takes place.
+/// @return status code
+static bool
+create_padding(void)
+{
+  size_t len;
+  size_t i;
+
+  len = (size_t)(op_smax > op_size ? op_smax : op_size) - pl_size;
+  if (len == 0)
+    return true;
+
+  padding = malloc(len);
+  if (padding == NULL) {
+    notify(NL_ERROR, true, "Unable to allocate %zu bytes of padding", len);
+    return false;
+  }
+
+  if (op_huge)
+    tune_advise(padding, len);
+
+  // Use a recognisable pattern instead of zeros.
+  for (i = 0; i < len; i++)
+    padding[i] = (uint8_t)(i & 0xff);
+
+  return true;
+}
+
+/// Select the datagram size of the round.
+/// @return size in bytes
+///
+/// @param[in] c round number
+static uint64_t
+round_size(const uint64_t c)
+{
+  uint64_t n;
+
+  if (op_smax == 0)
+    return op_size;
+
+  // Cycle through the sizes of the sweep.
+  n = (op_smax - op_size) / op_sstp + 1;
+  return op_size + (c % n) * op_sstp;
+}
+
+/// Compose the interface name of a flow from the endpoint and the flow suffix.
+///
+/// @param[out] iname interface name
+/// @param[in]  ep    endpoint
+/// @param[in]  pf    publisher flow
+static void
+compose_iname(char iname[INAME_LEN], const endpoint* ep, const pub_flow* pf)
+{
+  size_t ilen;
+
+  memset(iname, 0, INAME_LEN);
+  ilen = strnlen(ep->ep_iname, sizeof(ep->ep_iname));
+  if (ilen > INAME_LEN - pf->pf_islen)
+    ilen = INAME_LEN - pf->pf_islen;
+  memcpy(iname, ep->ep_iname, ilen);
+  memcpy(iname + ilen, pf->pf_isfx, pf->pf_islen);
+}
+
+/// Derive the publisher IDs of all flows of all endpoints.
+/// @return status code
+///
+/// @param[in] eps endpoint list
+static bool
+create_ids(endpoint* eps)
+{
+  endpoint* ep;
+  uint64_t f;
+  char iname[INAME_LEN];
+
+  if (op_fver == MBEAT_PAYLOAD_FULL)
+    return true;
+
+  for (ep = eps; ep != NULL; ep = ep->ep_next) {
+    ep->ep_pids = calloc(op_flws, sizeof(*ep->ep_pids));
+    if (ep->ep_pids == NULL) {
+      notify(NL_ERROR, true, "Unable to allocate publisher IDs");
       return false;
     }
+
+    for (f = 0; f < op_flws; f++) {
+      compose_iname(iname, ep, &flows[f]);
+      ep->ep_pids[f] = publisher_id(flows[f].pf_key, iname,
+                                    flows[f].pf_hname);
+    }
   }
 
   return true;
 }
 
+/// Update the payload fields that change with each datagram.
+/// @return system time of departure
+///
+/// @param[out] dg  datagram
+/// @param[in]  ep  endpoint
+/// @param[in]  f   flow index
+/// @param[in]  len datagram length including padding
+static uint64_t
+stamp_payload(datagram* dg,
+              const endpoint* ep,
+              const uint64_t f,
+              const uint64_t len)
+{
+  const pub_flow* pf;
+  uint64_t rt;
+  uint64_t mt;
+
+  pf = &flows[f];
+
+  // Datagrams with a launch time carry the scheduled time of departure.
+  if (op_txt) {
+    rt = rd_rtime;
+    mt = rd_mtime;
+  } else {
+    // Get the system and steady clock values.
+    tstamp_now(&rt, &mt);
+  }
+
+  if (op_fver == MBEAT_PAYLOAD_FULL) {
+    dg->dg_pl.pl_plen  = htonl((uint32_t)len);
+    dg->dg_pl.pl_snum  = htonll(pf->pf_snum);
+    dg->dg_pl.pl_rtime = htonll(rt);
+    dg->dg_pl.pl_mtime = htonll(mt);
+  } else {
+    dg->dg_cp.cp_plen  = htons((uint16_t)len);
+    dg->dg_cp.cp_snum  = htonll(pf->pf_snum);
+    dg->dg_cp.cp_rtime = htonll(rt);
+    dg->dg_cp.cp_mtime = htonll(mt);
+
+    // Follow up on the previous datagram of the flow with the time at which
+    // it actually left the host.
+    if (op_fup)
+      dg->dg_cp.cp_ttime = htonll(tx_follow_up(ep->ep_tx, f, pf->pf_snum));
+  }
+
+  return rt;
+}
+
 /// Create the datagram payload.
+/// @return system time of departure
 ///
-/// @param[out] pl   payload
-/// @param[in]  ep   endpoint
-/// @param[in]  snum sequence iterator counter
-static void
-fill_payload(payload* pl, const endpoint* ep, const uint32_t snum)
+/// @param[out] dg  datagram
+/// @param[in]  ep  endpoint
+/// @param[in]  f   flow index
+/// @param[in]  len datagram length including padding
+static uint64_t
+fill_payload(datagram* dg,
+             const endpoint* ep,
+             const uint64_t f,
+             const uint64_t len)
 {
-  struct timespec rtv;
-  struct timespec mtv;
+  payload* pl;
+  compact* cp;
+  const pub_flow* pf;
+
+  pf = &flows[f];
+
+  // The compact payload identifies the publisher by its ID only.
+  if (op_fver != MBEAT_PAYLOAD_FULL) {
+    cp = &dg->dg_cp;
+    memset(cp, 0, sizeof(*cp));
+
+    cp->cp_magic = htonl(MBEAT_PAYLOAD_MAGIC);
+    cp->cp_fver  = MBEAT_PAYLOAD_VERSION;
+    cp->cp_ttl   = op_ttl;
+    cp->cp_mport = htons(op_port);
+    cp->cp_maddr = htonl(ep->ep_maddr.s_addr);
+    cp->cp_type  = MBEAT_TYPE_DATA;
+    cp->cp_pid   = htonll(ep->ep_pids[f]);
+    cp->cp_key   = htonll(pf->pf_key);
+    cp->cp_slen  = htonll(op_cnt);
+
+    return stamp_payload(dg, ep, f, len);
+  }
 
+  pl = &dg->dg_pl;
   memset(pl, 0, sizeof(*pl));
 
   pl->pl_magic = htonl(MBEAT_PAYLOAD_MAGIC);
-  pl->pl_fver  = MBEAT_PAYLOAD_VERSION;
+  pl->pl_fver  = MBEAT_PAYLOAD_FULL;
   pl->pl_ttl   = op_ttl;
   pl->pl_mport = htons(op_port);
   pl->pl_maddr = htonl(ep->ep_maddr.s_addr);
-  pl->pl_key   = htonll(op_key);
-  pl->pl_snum  = htonll(snum);
+  pl->pl_key   = htonll(pf->pf_key);
   pl->pl_slen  = htonll(op_cnt);
-  memcpy(pl->pl_iname, ep->ep_iname, sizeof(pl->pl_iname));
-  memcpy(pl->pl_hname, hname, sizeof(pl->pl_hname));
+  memcpy(pl->pl_hname, pf->pf_hname, sizeof(pl->pl_hname));
+  compose_iname(pl->pl_iname, ep, pf);
+
+  return stamp_payload(dg, ep, f, len);
+}
+
+/// Create the announcement of the names of a flow.
+///
+/// @param[out] an announcement
+/// @param[in]  ep endpoint
+/// @param[in]  f  flow index
+static void
+fill_announce(announce* an, const endpoint* ep, const uint64_t f)
+{
+  memset(an, 0, sizeof(*an));
+
+  an->an_magic = htonl(MBEAT_PAYLOAD_MAGIC);
+  an->an_fver  = MBEAT_PAYLOAD_VERSION;
+  an->an_ttl   = op_ttl;
+  an->an_mport = htons(op_port);
+  an->an_maddr = htonl(ep->ep_maddr.s_addr);
+  an->an_plen  = htons(sizeof(*an));
+  an->an_type  = MBEAT_TYPE_ANNOUNCE;
+  an->an_pid   = htonll(ep->ep_pids[f]);
+  an->an_key   = htonll(flows[f].pf_key);
+  memcpy(an->an_hname, flows[f].pf_hname, sizeof(an->an_hname));
+  compose_iname(an->an_iname, ep, &flows[f]);
+}
+
+/// Create the pinned payloads of all endpoints for zero-copy sends. All
+/// fields that do not change between datagrams are filled in only once.
+/// @return status code
+///
+/// @param[in] eps endpoint list
+static bool
+create_zerocopy(endpoint* eps)
+{
+  endpoint* ep;
+  uint64_t f;
+
+  if (!op_zc)
+    return true;
 
-  // Get the system clock value.
-  clock_gettime(CLOCK_REALTIME, &rtv);
+  for (ep = eps; ep != NULL; ep = ep->ep_next) {
+    ep->ep_zc = malloc(sizeof(*ep->ep_zc));
+    if (ep->ep_zc == NULL) {
+      notify(NL_ERROR, true, "Unable to allocate zero-copy state");
+      return false;
+    }
 
-  // Get the steady clock value.
-  #ifdef __linux__
-    clock_gettime(CLOCK_MONOTONIC_RAW, &mtv);
-  #else
-    clock_gettime(CLOCK_MONOTONIC, &mtv);
-  #endif
+    if (!zc_create(ep->ep_zc, op_flws)) {
+      free(ep->ep_zc);
+      ep->ep_zc = NULL;
+      return false;
+    }
 
-  to_nanos(&pl->pl_rtime, rtv);
-  to_nanos(&pl->pl_mtime, mtv);
+    for (f = 0; f < op_flws; f++)
+      fill_payload(&ep->ep_zc->zs_pl[f], ep, f, op_size);
+  }
 
-  pl->pl_rtime = htonll(pl->pl_rtime);
-  pl->pl_mtime = htonll(pl->pl_mtime);
+  notify(NL_DEBUG, false, "Pinned %" PRIu64 " payloads per endpoint for "
+         "zero-copy sends", op_flws);
+  return true;
+}
+
+/// Create the launch time state of all endpoints.
+/// @return status code
+///
+/// @param[in] eps endpoint list
+static bool
+create_txtime(endpoint* eps)
+{
+  endpoint* ep;
+
+  if (!op_txt && !op_fup)
+    return true;
+
+  for (ep = eps; ep != NULL; ep = ep->ep_next) {
+    ep->ep_tx = malloc(sizeof(*ep->ep_tx));
+    if (ep->ep_tx == NULL) {
+      notify(NL_ERROR, true, "Unable to allocate launch time state");
+      return false;
+    }
+
+    if (!tx_create(ep->ep_tx, op_fup ? op_flws : 0)) {
+      free(ep->ep_tx);
+      ep->ep_tx = NULL;
+      return false;
+    }
+  }
+
+  return true;
+}
+
+/// Wait for all outstanding zero-copy sends and release the pinned payloads.
+///
+/// @param[in] eps endpoint list
+static void
+free_zerocopy(endpoint* eps)
+{
+  endpoint* ep;
+
+  for (ep = eps; ep != NULL; ep = ep->ep_next) {
+    if (ep->ep_zc == NULL)
+      continue;
+
+    zc_drain(ep->ep_zc, ep->ep_sock);
+    zc_free(ep->ep_zc);
+    free(ep->ep_zc);
+    ep->ep_zc = NULL;
+  }
+}
+
+/// Release the launch time state of all endpoints.
+///
+/// @param[in] eps endpoint list
+static void
+free_txtime(endpoint* eps)
+{
+  endpoint* ep;
+
+  for (ep = eps; ep != NULL; ep = ep->ep_next) {
+    if (ep->ep_tx != NULL)
+      tx_free(ep->ep_tx);
+    free(ep->ep_tx);
+    ep->ep_tx = NULL;
+  }
+}
+
+/// Link the messages of the batch with their data and destinations.
+static void
+create_batch(void)
+{
+  unsigned int i;
+
+  memset(bt_msg, 0, sizeof(bt_msg));
+  memset(bt_addr, 0, sizeof(bt_addr));
+
+  for (i = 0; i < BATCH_LEN; i++) {
+    bt_addr[i].sin_family = AF_INET;
+    bt_addr[i].sin_port   = htons((uint16_t)op_port);
+
+    bt_iov[i][0].iov_base = &bt_pl[i];
+    bt_iov[i][0].iov_len  = pl_size;
+    bt_iov[i][1].iov_base = padding;
+    bt_iov[i][1].iov_len  = 0;
+
+    bt_msg[i].msg_hdr.msg_name       = &bt_addr[i];
+    bt_msg[i].msg_hdr.msg_namelen    = sizeof(bt_addr[i]);
+    bt_msg[i].msg_hdr.msg_iov        = bt_iov[i];
+    bt_msg[i].msg_hdr.msg_iovlen     = 1;
+    bt_msg[i].msg_hdr.msg_control    = op_txt ? bt_ctl[i].cc_buf : NULL;
+    bt_msg[i].msg_hdr.msg_controllen = op_txt ? sizeof(bt_ctl[i].cc_buf) : 0;
+  }
+
+  bt_cnt = 0;
+}
+
+/// Send a part of the batch that shares the same socket.
+/// @return number of sent messages, or -1 on error
+///
+/// @param[in] first index of the first message
+/// @param[in] cnt   number of messages
+static int
+send_messages(const unsigned int first, const unsigned int cnt)
+{
+  int flags;
+
+  // Announcements are never sent from the pinned payloads.
+  flags = MSG_DONTWAIT | (op_zc && !bt_ann[first] ? ZC_SEND_FLAG : 0);
+
+#if defined(MBEAT_HAVE_SENDMMSG)
+  return sendmmsg(bt_ep[first]->ep_sock, &bt_msg[first], cnt, flags);
+#else
+  (void)cnt;
+
+  if (sendmsg(bt_ep[first]->ep_sock, &bt_msg[first].msg_hdr, flags) == -1)
+    return -1;
+
+  return 1;
+#endif
+}
+
+/// Account the successfully published messages.
+///
+/// @param[in] first index of the first message
+/// @param[in] cnt   number of messages
+static void
+account_messages(const unsigned int first, const unsigned int cnt)
+{
+  unsigned int i;
+  uint64_t len;
+
+  for (i = first; i < first + cnt; i++) {
+    len = bt_iov[i][0].iov_len + bt_iov[i][1].iov_len;
+    bt_ep[i]->ep_dgrams++;
+    bt_ep[i]->ep_bytes += len;
+    if (bt_ann[i])
+      st_anns++;
+    else if (bt_ep[i]->ep_zc != NULL)
+      zc_sent(bt_ep[i]->ep_zc, bt_flw[i]);
+    if (bt_ep[i]->ep_tx != NULL)
+      tx_sent(bt_ep[i]->ep_tx, bt_rtm[i], bt_flw[i],
+              bt_ann[i] ? TX_NO_SNUM : flows[bt_flw[i]].pf_snum);
+    st_dgrams++;
+    st_bytes += len;
+  }
+}
+
+/// Wait until the send buffer of the socket has space for another datagram.
+/// @return true if the send should be retried, false otherwise
+///
+/// @param[in] ep  endpoint
+/// @param[in] err error of the failed send
+/// @param[in] try number of previous retries of the datagram
+static bool
+wait_writable(const endpoint* ep, const int err, const unsigned int try)
+{
+  struct pollfd pfd;
+  struct timespec ts;
+  int ret;
+
+  // The device queue is full, which is not reflected in the writability of
+  // the socket, so just pause for a while.
+  if (err == ENOBUFS) {
+    if (try >= NOBUFS_TRIES)
+      return false;
+
+    from_nanos(&ts, NOBUFS_PAUSE);
+    nanosleep(&ts, NULL);
+    return true;
+  }
+
+  // A socket that is reported as writable, while the sends still would
+  // block, must not keep the publisher spinning.
+  if (try >= WBLOCK_TRIES)
+    return false;
+
+  pfd.fd      = ep->ep_sock;
+  pfd.events  = POLLOUT;
+  pfd.revents = 0;
+
+  ret = poll(&pfd, 1, WAIT_TIMEOUT);
+  if (ret == -1 && errno != EINTR) {
+    notify(NL_WARN, true, "Unable to wait for the socket of interface %s",
+           ep->ep_iname);
+    return false;
+  }
+
+  return ret != 0;
+}
+
+/// Account a failed send and decide how to proceed.
+/// @return true if the send should be retried, false otherwise
+///
+/// @param[in] ep  endpoint
+/// @param[in] err error of the failed send
+/// @param[in] try number of previous retries of the datagram
+static bool
+handle_send_error(endpoint* ep, const int err, const unsigned int try)
+{
+  if (err == EAGAIN || err == EWOULDBLOCK)
+    ep->ep_wblk++;
+  else if (err == ENOBUFS)
+    ep->ep_nobuf++;
+  else {
+    ep->ep_fail++;
+
+    // With -e, the error is reported once the publisher gives up.
+    if (!op_err) {
+      errno = err;
+      notify(NL_WARN, true, "Unable to publish datagram from interface %s "
+             "to multicast group %s", ep->ep_iname, inet_ntoa(ep->ep_maddr));
+    }
+    return false;
+  }
+
+  st_cong = true;
+  notify(NL_TRACE, false, "Send buffer of interface %s is full", ep->ep_iname);
+
+  if (op_bp == BP_WAIT)
+    return wait_writable(ep, err, try);
+
+  return false;
+}
+
+/// Publish all queued datagrams. Consecutive datagrams that share the same
+/// socket are published with a single system call where possible.
+/// @return status code
+static bool
+flush_batch(void)
+{
+  unsigned int i;
+  unsigned int k;
+  unsigned int try;
+  int ret;
+  int err;
+
+  i = 0;
+  try = 0;
+  while (i < bt_cnt) {
+    // Find the run of messages that share the socket and the kind of send.
+    for (k = i + 1; k < bt_cnt; k++)
+      if (bt_ep[k]->ep_sock != bt_ep[i]->ep_sock || bt_ann[k] != bt_ann[i])
+        break;
+
+    ret = send_messages(i, k - i);
+    err = errno;
+    if (ret > 0)
+      account_messages(i, (unsigned int)ret);
+
+    // Collect the completions of earlier zero-copy sends.
+    if (bt_ep[i]->ep_zc != NULL
+     && !zc_reap(bt_ep[i]->ep_zc, bt_ep[i]->ep_sock)) {
+      bt_cnt = 0;
+      return false;
+    }
+
+    // Collect the transmit timestamps of earlier datagrams.
+    if (bt_ep[i]->ep_tx != NULL
+     && !tx_reap(bt_ep[i]->ep_tx, bt_ep[i]->ep_sock)) {
+      bt_cnt = 0;
+      return false;
+    }
+
+    if (ret == -1) {
+      if (handle_send_error(bt_ep[i], err, try)) {
+        try++;
+        continue;
+      }
+
+      if (op_err) {
+        errno = err;
+        notify(NL_ERROR, true, "Unable to publish datagram from interface %s"
+               " to multicast group %s", bt_ep[i]->ep_iname,
+               inet_ntoa(bt_ep[i]->ep_maddr));
+        bt_cnt = 0;
+        return false;
+      }
+
+      // Skip the failed message.
+      st_drops++;
+      ret = 1;
+    }
+
+    i += (unsigned int)ret;
+    try = 0;
+  }
+
+  bt_cnt = 0;
+  return true;
+}
+
+/// Queue a datagram for publishing, flushing the batch if it is full.
+/// @return status code
+///
+/// @param[in] ep  endpoint
+/// @param[in] f   flow index
+/// @param[in] len datagram length including padding
+static bool
+queue_datagram(endpoint* ep, const uint64_t f, const uint64_t len)
+{
+  datagram* dg;
+
+  if (bt_cnt == BATCH_LEN && !flush_batch())
+    return false;
+
+  notify(NL_TRACE, false,
+         "Publishing datagram from interface %s to multicast group %s",
+         ep->ep_iname, inet_ntoa(ep->ep_maddr));
+
+  // Zero-copy sends reuse the pinned payload of the flow once the kernel has
+  // released it, rewriting only the fields that change.
+  if (ep->ep_zc != NULL) {
+    if (!zc_wait(ep->ep_zc, ep->ep_sock, f))
+      return false;
+
+    dg = &ep->ep_zc->zs_pl[f];
+    bt_rtm[bt_cnt] = stamp_payload(dg, ep, f, len);
+  } else {
+    dg = &bt_pl[bt_cnt];
+    bt_rtm[bt_cnt] = fill_payload(dg, ep, f, len);
+  }
+
+  bt_iov[bt_cnt][0].iov_base = dg;
+  bt_iov[bt_cnt][0].iov_len  = pl_size;
+  bt_addr[bt_cnt].sin_addr.s_addr = ep->ep_maddr.s_addr;
+
+  if (op_txt)
+    tx_control(bt_ctl[bt_cnt].cc_buf, sizeof(bt_ctl[bt_cnt].cc_buf), rd_launch);
+
+  // Attach the shared padding.
+  bt_iov[bt_cnt][1].iov_len = (size_t)len - pl_size;
+  bt_msg[bt_cnt].msg_hdr.msg_iovlen = len > pl_size ? 2 : 1;
+
+  bt_ep[bt_cnt]  = ep;
+  bt_flw[bt_cnt] = f;
+  bt_ann[bt_cnt] = false;
+  bt_cnt++;
+
+  return true;
+}
+
+/// Queue the announcements of all flows of an endpoint.
+/// @return status code
+///
+/// @param[in] ep endpoint
+static bool
+queue_announce(endpoint* ep)
+{
+  uint64_t f;
+  uint64_t rt;
+  uint64_t mt;
+
+  // Announcements carry no departure time, so their transmit times are
+  // compared with the time of their hand-over.
+  rt = rd_rtime;
+  if (!op_txt)
+    tstamp_now(&rt, &mt);
+
+  for (f = 0; f < op_flws; f++) {
+    if (bt_cnt == BATCH_LEN && !flush_batch())
+      return false;
+
+    fill_announce(&bt_pl[bt_cnt].dg_an, ep, f);
+    bt_iov[bt_cnt][0].iov_base = &bt_pl[bt_cnt];
+    bt_iov[bt_cnt][0].iov_len  = sizeof(announce);
+    bt_msg[bt_cnt].msg_hdr.msg_iovlen = 1;
+    bt_addr[bt_cnt].sin_addr.s_addr = ep->ep_maddr.s_addr;
+
+    if (op_txt)
+      tx_control(bt_ctl[bt_cnt].cc_buf, sizeof(bt_ctl[bt_cnt].cc_buf),
+                 rd_launch);
+
+    bt_rtm[bt_cnt] = rt;
+    bt_ep[bt_cnt]  = ep;
+    bt_flw[bt_cnt] = f;
+    bt_ann[bt_cnt] = true;
+    bt_cnt++;
+  }
+
+  return true;
+}
+
+/// Obtain the processor time consumed by the process.
+/// @return processor time in nanoseconds
+///
+/// @param[out] usr user time in nanoseconds
+/// @param[out] sys system time in nanoseconds
+static uint64_t
+cpu_time(uint64_t* usr, uint64_t* sys)
+{
+  struct rusage ru;
+
+  if (getrusage(RUSAGE_SELF, &ru) == -1) {
+    notify(NL_WARN, true, "Unable to obtain the resource usage");
+    *usr = 0;
+    *sys = 0;
+    return 0;
+  }
+
+  *usr = (uint64_t)ru.ru_utime.tv_sec * 1000000000ULL
+       + (uint64_t)ru.ru_utime.tv_usec * 1000ULL;
+  *sys = (uint64_t)ru.ru_stime.tv_sec * 1000000000ULL
+       + (uint64_t)ru.ru_stime.tv_usec * 1000ULL;
+  return *usr + *sys;
+}
+
+/// Report the processor time spent per gigabyte of published data, so that
+/// copying and zero-copy sends can be compared.
+///
+/// @param[in] eps endpoint list
+/// @param[in] usr user time at the start of publishing
+/// @param[in] sys system time at the start of publishing
+static void
+report_cpu(endpoint* eps, const uint64_t usr, const uint64_t sys)
+{
+  uint64_t nusr;
+  uint64_t nsys;
+  uint64_t done;
+  uint64_t copy;
+  double cpu;
+  endpoint* e;
+
+  // Include the time spent waiting for the outstanding completions.
+  done = 0;
+  copy = 0;
+  for (e = eps; e != NULL; e = e->ep_next) {
+    if (e->ep_zc == NULL)
+      continue;
+
+    zc_drain(e->ep_zc, e->ep_sock);
+    done += e->ep_zc->zs_done;
+    copy += e->ep_zc->zs_copy;
+  }
+
+  cpu_time(&nusr, &nsys);
+  nusr -= usr;
+  nsys -= sys;
+  cpu = (double)(nusr + nsys) / 1e9;
+
+  notify(NL_INFO, false, "CPU time %.3fs (user %.3fs, system %.3fs), "
+         "%.3fs per GB with %s sends", cpu, (double)nusr / 1e9,
+         (double)nsys / 1e9, st_bytes > 0 ? cpu / ((double)st_bytes / 1e9) : 0.0,
+         op_zc ? "zero-copy" : "copying");
+
+  if (!op_zc)
+    return;
+
+  notify(NL_INFO, false, "Zero-copy completions: %" PRIu64 ", copied by the "
+         "kernel: %" PRIu64, done, copy);
+
+  // The kernel silently falls back to copying, e.g. for looped datagrams or
+  // devices without scatter-gather support.
+  if (copy > 0)
+    notify(NL_WARN, false, "Kernel copied %" PRIu64 " of %" PRIu64
+           " zero-copy sends", copy, done);
+}
+
+/// Wait until a round is due to be queued, which is the lead time ahead of its
+/// launch, and translate its launch time to the clocks used in the payload.
+/// @return status code
+///
+/// @param[in] launch launch time of the round
+static bool
+schedule_round(const uint64_t launch)
+{
+  struct timespec ltv;
+  uint64_t lnow;
+  uint64_t rnow;
+  uint64_t mnow;
+  int ret;
+
+  if (launch > op_lead) {
+    from_nanos(&ltv, launch - op_lead);
+    do {
+      ret = clock_nanosleep(op_tclk, TIMER_ABSTIME, &ltv, NULL);
+    } while (ret == EINTR);
+
+    if (ret != 0) {
+      errno = ret;
+      notify(NL_ERROR, true, "Unable to wait for the next round");
+      return false;
+    }
+  }
+
+  // Read all clocks at once, so that the offsets between them are current.
+  clock_gettime(op_tclk, &ltv);
+  tstamp_now(&rnow, &mnow);
+  to_nanos(&lnow, ltv);
+
+  rd_launch = launch;
+  rd_rtime  = launch - lnow + rnow;
+  rd_mtime  = launch - lnow + mnow;
+
+  return true;
+}
+
+/// Report the deviation of the transmit timestamps from the launch times, or
+/// from the departure times in the payloads without launch times.
+///
+/// @param[in] eps endpoint list
+static void
+report_transmit(endpoint* eps)
+{
+  endpoint* e;
+  tx_state* ts;
+  histogram hg;
+  uint64_t cnt;
+  uint64_t late;
+  uint64_t miss;
+  uint64_t inv;
+  uint64_t lost;
+  int64_t sum;
+  int64_t min;
+  int64_t max;
+  unsigned int i;
+
+  memset(&hg, 0, sizeof(hg));
+  cnt  = 0;
+  late = 0;
+  miss = 0;
+  inv  = 0;
+  lost = 0;
+  sum  = 0;
+  min  = INT64_MAX;
+  max  = INT64_MIN;
+
+  for (e = eps; e != NULL; e = e->ep_next) {
+    ts = e->ep_tx;
+    if (ts == NULL)
+      continue;
+
+    // Wait for the datagrams that are still held by the queueing discipline.
+    tx_drain(ts, e->ep_sock, op_lead + 1000000000ULL);
+
+    cnt  += ts->ts_cnt;
+    late += ts->ts_late;
+    miss += ts->ts_miss;
+    inv  += ts->ts_inv;
+    lost += ts->ts_lost;
+    sum  += ts->ts_sum;
+    if (ts->ts_min < min)
+      min = ts->ts_min;
+    if (ts->ts_max > max)
+      max = ts->ts_max;
+
+    for (i = 0; i < HIST_LEN; i++)
+      hg.hg_cnt[i] += ts->ts_hist.hg_cnt[i];
+    hg.hg_sum += ts->ts_hist.hg_sum;
+    if (ts->ts_hist.hg_max > hg.hg_max)
+      hg.hg_max = ts->ts_hist.hg_max;
+  }
+
+  if (cnt == 0) {
+    notify(NL_WARN, false, "No transmit timestamps were reported");
+  } else if (!op_txt) {
+    notify(NL_INFO, false, "Transmit delay of %" PRIu64 " datagrams: mean "
+           "%" PRIi64 " ns, min %" PRIi64 " ns, max %" PRIi64 " ns",
+           cnt, sum / (int64_t)cnt, min, max);
+    notify(NL_INFO, false, "Transmit delay: p50 %" PRIu64 " ns, p99 %" PRIu64
+           " ns, max %" PRIu64 " ns",
+           hist_percentile(&hg, 50.0), hist_percentile(&hg, 99.0), hg.hg_max);
+  } else {
+    notify(NL_INFO, false, "Launch deviation of %" PRIu64 " datagrams: mean "
+           "%" PRIi64 " ns, min %" PRIi64 " ns, max %" PRIi64 " ns, %" PRIu64
+           " late", cnt, sum / (int64_t)cnt, min, max, late);
+    notify(NL_INFO, false, "Absolute launch deviation: p50 %" PRIu64
+           " ns, p99 %" PRIu64 " ns, max %" PRIu64 " ns",
+           hist_percentile(&hg, 50.0), hist_percentile(&hg, 99.0), hg.hg_max);
+  }
+
+  if (miss > 0 || inv > 0)
+    notify(NL_WARN, false, "Dropped %" PRIu64 " datagrams that missed their "
+           "launch time and %" PRIu64 " with invalid launch time", miss, inv);
+
+  if (lost > 0)
+    notify(NL_WARN, false, "Unable to match %" PRIu64 " transmit timestamps "
+           "with their launch time", lost);
+}
+
+/// Adapt the additional delay between rounds: double it after a round with
+/// congestion, reduce it linearly after a round without.
+static void
+adapt_delay(void)
+{
+  if (st_cong) {
+    st_delay = st_delay == 0 ? AIMD_MIN : st_delay * 2;
+    if (st_delay > AIMD_MAX)
+      st_delay = AIMD_MAX;
+
+    st_backs++;
+    notify(NL_DEBUG, false, "Increasing the delay between rounds to %" PRIu64
+           " ns", st_delay);
+  } else if (st_delay > 0) {
+    st_delay = st_delay > AIMD_STEP ? st_delay - AIMD_STEP : 0;
+  }
+
+  st_cong = false;
+}
+
+/// Report the outcome of all sends and the achieved publishing rate.
+///
+/// @param[in] eps endpoint list
+/// @param[in] dur publishing duration in nanoseconds
+static void
+report_sends(endpoint* eps, const uint64_t dur)
+{
+  endpoint* e;
+  double req;
+  double ach;
+
+  for (e = eps; e != NULL; e = e->ep_next) {
+    notify(e->ep_wblk + e->ep_nobuf + e->ep_fail > 0 ? NL_INFO : NL_DEBUG,
+           false, "Endpoint %s on %s: %" PRIu64 " sent, %" PRIu64 " would "
+           "block, %" PRIu64 " no buffers, %" PRIu64 " other errors",
+           inet_ntoa(e->ep_maddr), e->ep_iname, e->ep_dgrams, e->ep_wblk,
+           e->ep_nobuf, e->ep_fail);
+  }
+
+  // Each round consists of all published and dropped datagrams, while the
+  // announcements are not part of the requested rate.
+  ach = dur > 0 ? (double)(st_dgrams - st_anns) / ((double)dur / 1e9) : 0.0;
+  if (op_slp > 0) {
+    req = (double)(st_dgrams - st_anns + st_drops) / (double)op_cnt
+        * (1e9 / (double)op_slp);
+    notify(NL_INFO, false, "Requested rate %.1f datagrams/s, achieved %.1f "
+           "datagrams/s (%.1f%%)", req, ach, req > 0 ? ach / req * 100.0 : 0.0);
+  } else {
+    notify(NL_INFO, false, "Requested rate unlimited, achieved %.1f "
+           "datagrams/s", ach);
+  }
+
+  if (op_bp == BP_AIMD)
+    notify(NL_INFO, false, "Reduced the rate %" PRIu64 " times, final "
+           "additional delay %" PRIu64 " ns", st_backs, st_delay);
+
+  if (st_drops > 0)
+    notify(NL_WARN, false, "Dropped %" PRIu64 " datagrams before they left "
+           "the host", st_drops);
 }
 
 /// Publish datagrams to all requested multicast groups.
@@ -370,12 +1838,17 @@ static bool
 publish_datagrams(endpoint* eps)
 {
   uint64_t c;
-  ssize_t ret;
-  payload pl;
+  uint64_t f;
+  uint64_t len;
+  uint64_t start;
+  uint64_t dur;
+  uint64_t usr;
+  uint64_t sys;
+  uint64_t launch;
+  uint64_t mnow;
+  uint64_t tm_ann;
   struct timespec ts;
-  struct sockaddr_in addr;
-  struct msghdr msg;
-  struct iovec data;
+  struct timespec now;
   endpoint* e;
 
   notify(NL_DEBUG, false, "Process ID is %" PRIiMAX, (intmax_t)getpid());
@@ -387,59 +1860,85 @@ publish_datagrams(endpoint* eps)
   notify(NL_INFO, false, "Starting to publish %" PRIu64 " datagram%s",
          op_cnt, (op_cnt > 1 ? "s" : ""));
 
-  from_nanos(&ts, op_slp);
+  create_batch();
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  to_nanos(&start, now);
+  cpu_time(&usr, &sys);
 
-  // Prepare the address structure.
-  addr.sin_port   = htons((uint16_t)op_port);
-  addr.sin_family = AF_INET;
+  // The first round is launched after the lead time.
+  clock_gettime(op_tclk, &now);
+  to_nanos(&launch, now);
+  launch += op_lead;
+  tm_ann = 0;
 
   // Publish the requested number of datagrams.
   for (c = 0; c < op_cnt; c++) {
     notify(NL_DEBUG, false, "Round %" PRIu64 "/%" PRIu64 " of datagrams",
            c + 1 + op_off, op_cnt + op_off);
 
-    for (e = eps; e != NULL; e = e->ep_next) {
-      fill_payload(&pl, e, c + op_off);
-
-      // Set the multicast address.
-      addr.sin_addr.s_addr = e->ep_maddr.s_addr;
+    // Queue the round ahead of its launch time.
+    if (op_txt && !schedule_round(launch + c * op_slp))
+      return false;
 
-      // Prepare payload data.
-      data.iov_base = &pl;
-      data.iov_len  = sizeof(pl);
+    // Announce the names of all flows ahead of the first round and then
+    // periodically, so that subscribers that join later learn them too.
+    if (op_fver != MBEAT_PAYLOAD_FULL && (c == 0 || op_aint > 0)) {
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      to_nanos(&mnow, now);
+      if (c == 0 || mnow >= tm_ann) {
+        for (e = eps; e != NULL; e = e->ep_next)
+          if (!queue_announce(e))
+            return false;
+        tm_ann = mnow + op_aint;
+      }
+    }
 
-      // Prepare the message.
-      msg.msg_name       = &addr;
-      msg.msg_namelen    = sizeof(addr);
-      msg.msg_iov        = &data;
-      msg.msg_iovlen     = 1;
-      msg.msg_control    = NULL;
-      msg.msg_controllen = 0;
+    // Interleave the flows of each endpoint, so that consecutive datagrams
+    // share the socket and can be published in a single batch.
+    len = round_size(c);
+    for (e = eps; e != NULL; e = e->ep_next)
+      for (f = 0; f < op_flws; f++)
+        if (!queue_datagram(e, f, len))
+          return false;
 
-      // Publish the payload.
-      notify(NL_TRACE, false,
-             "Publishing datagram from interface %s to multicast group %s",
-             e->ep_iname, inet_ntoa(e->ep_maddr));
+    if (!flush_batch())
+      return false;
 
-      ret = sendmsg(e->ep_sock, &msg, MSG_DONTWAIT);
-      if (ret == 0) {
-        notify(op_err ? NL_ERROR : NL_WARN, true,
-               "Unable to publish datagram from interface %s to "
-               "multicast group %s", e->ep_iname, inet_ntoa(e->ep_maddr));
+    for (f = 0; f < op_flws; f++)
+      flows[f].pf_snum++;
 
-        if (op_err)
-          return false;
-      }
-    }
+    // Slow down after a congested round.
+    if (op_bp == BP_AIMD)
+      adapt_delay();
 
-    // Do not sleep after the last round of datagrams.
-    if (op_slp > 0 && c != (op_cnt - 1)) {
-      notify(NL_TRACE, false, "Sleeping for %" PRIu64 " nanoseconds", op_slp);
+    // Do not sleep after the last round of datagrams. With launch times, the
+    // pacing is performed by the kernel.
+    if (!op_txt && op_slp + st_delay > 0 && c != (op_cnt - 1)) {
+      notify(NL_TRACE, false, "Sleeping for %" PRIu64 " nanoseconds",
+             op_slp + st_delay);
+      from_nanos(&ts, op_slp + st_delay);
       nanosleep(&ts, NULL);
     }
   }
 
   notify(NL_INFO, false, "Finished publishing of all datagrams");
+
+  // Report the achieved bandwidth.
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  to_nanos(&dur, now);
+  dur -= start;
+  notify(NL_INFO, false, "Published %" PRIu64 " datagrams and %" PRIu64
+         " bytes in %.3fs (%.3f MB/s)", st_dgrams, st_bytes, (double)dur / 1e9,
+         dur > 0 ? ((double)st_bytes / 1e6) / ((double)dur / 1e9) : 0.0);
+  if (st_anns > 0)
+    notify(NL_INFO, false, "Published %" PRIu64 " announcements", st_anns);
+  report_sends(eps, dur);
+  report_cpu(eps, usr, sys);
+  tstamp_report();
+  if (op_txt || op_fup)
+    report_transmit(eps);
+
   return true;
 }
 
@@ -470,14 +1969,44 @@ main(int argc, char* argv[])
     return EXIT_FAILURE;
 
   // Initialise the sockets based on selected interfaces.
-  if (!create_sockets(eps))
+  if (!create_sockets(&eps))
+    return EXIT_FAILURE;
+
+  // Create the simulated publisher flows.
+  if (!create_flows())
+    return EXIT_FAILURE;
+
+  // Derive the publisher IDs of the flows.
+  if (!create_ids(eps))
     return EXIT_FAILURE;
 
+  // Create the padding of large datagrams.
+  if (!create_padding())
+    return EXIT_FAILURE;
+
+  // Create the pinned payloads for zero-copy sends.
+  if (!create_zerocopy(eps))
+    return EXIT_FAILURE;
+
+  // Create the launch time state.
+  if (!create_txtime(eps))
+    return EXIT_FAILURE;
+
+  // Tune the host for low latency once all buffers exist.
+  if (op_pin)
+    (void)tune_pin(op_cpu);
+  if (op_lat > 0)
+    tune_latency(op_lat);
+
   // Publish datagrams to selected multicast groups.
   if (!publish_datagrams(eps))
     return EXIT_FAILURE;
 
+  free_zerocopy(eps);
+  free_txtime(eps);
   free_endpoints(eps);
+  free(flows);
+  free(padding);
 
   return EXIT_SUCCESS;
 }
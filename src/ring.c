@@ -0,0 +1,384 @@
+// Copyright (c) 2017-2018 Two Sigma Open Source, LLC.
+// All Rights Reserved
+//
+// Distributed under the terms of the 2-clause BSD License. The full
+// license is in the file LICENSE, distributed as part of this software.
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <stdlib.h>
+#include <limits.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#include "ring.h"
+#include "common.h"
+
+
+/// Normalise the name of the shared memory object, so that it always starts
+/// with a slash.
+///
+/// @param[out] rg   ring
+/// @param[in]  name user-supplied name
+static bool
+ring_name(ring* rg, const char* name)
+{
+  int len;
+
+  if (name == NULL || name[0] == '\0') {
+    notify(NL_ERROR, false, "Empty ring name");
+    return false;
+  }
+
+  len = snprintf(rg->rg_name, sizeof(rg->rg_name), "%s%s",
+                 name[0] == '/' ? "" : "/", name);
+  if (len < 0 || (size_t)len >= sizeof(rg->rg_name)) {
+    notify(NL_ERROR, false, "Ring name %s is too long", name);
+    return false;
+  }
+
+  return true;
+}
+
+/// Maximal number of slots of a ring, so that the length of its mapping fits
+/// both the size of the mapping and the size of the shared memory object.
+/// @return number of slots
+uint64_t
+ring_max_cnt(void)
+{
+  uint64_t max;
+  uint64_t off;
+
+  off = ((uint64_t)1 << (sizeof(off_t) * CHAR_BIT - 1)) - 1;
+  max = (uint64_t)SIZE_MAX < off ? (uint64_t)SIZE_MAX : off;
+  return (max - sizeof(ring_header)) / sizeof(ring_slot);
+}
+
+/// Map the shared memory object into the address space of the process.
+/// @return status code
+///
+/// @param[out] rg   ring
+/// @param[in]  fd   shared memory file descriptor
+/// @param[in]  prot memory protection flags
+static bool
+ring_map(ring* rg, const int fd, const int prot)
+{
+  void* addr;
+
+  addr = mmap(NULL, rg->rg_len, prot, MAP_SHARED, fd, 0);
+  if (addr == MAP_FAILED) {
+    notify(NL_ERROR, true, "Unable to map ring %s", rg->rg_name);
+    return false;
+  }
+
+  rg->rg_hdr   = addr;
+  rg->rg_slots = (ring_slot*)((char*)addr + sizeof(ring_header));
+  return true;
+}
+
+/// Decide whether an existing ring object is abandoned by its writer.
+/// @return decision
+///
+/// @param[in] fd shared memory file descriptor
+static bool
+ring_abandoned(const int fd)
+{
+  ring_header hdr;
+  ssize_t nbs;
+
+  nbs = pread(fd, &hdr, sizeof(hdr), 0);
+  if (nbs != (ssize_t)sizeof(hdr))
+    return true;
+
+  if (hdr.rh_magic != MBEAT_RING_MAGIC || hdr.rh_closed != 0)
+    return true;
+
+  // The writer process no longer exists.
+  if (kill((pid_t)hdr.rh_wpid, 0) == -1 && errno == ESRCH)
+    return true;
+
+  return false;
+}
+
+/// Create a new shared memory ring for a single writer.
+/// @return status code
+///
+/// @param[out] rg   ring
+/// @param[in]  name name of the shared memory object
+/// @param[in]  cnt  number of slots (power of two)
+bool
+ring_create(ring* rg, const char* name, const uint64_t cnt)
+{
+  int fd;
+
+  memset(rg, 0, sizeof(*rg));
+  if (!ring_name(rg, name))
+    return false;
+
+  // Ensure that the slot index can be computed by masking.
+  if (cnt == 0 || (cnt & (cnt - 1)) != 0) {
+    notify(NL_ERROR, false, "Ring size %" PRIu64 " is not a power of two",
+           cnt);
+    return false;
+  }
+
+  if (cnt > ring_max_cnt()) {
+    notify(NL_ERROR, false, "Ring size %" PRIu64 " exceeds the maximum of %"
+           PRIu64, cnt, ring_max_cnt());
+    return false;
+  }
+
+  rg->rg_len  = sizeof(ring_header) + cnt * sizeof(ring_slot);
+  rg->rg_mask = cnt - 1;
+
+  notify(NL_DEBUG, false, "Creating ring %s with %" PRIu64 " slots (%zu bytes)",
+         rg->rg_name, cnt, rg->rg_len);
+
+  // Create the shared memory object, replacing one left behind by a writer
+  // that did not terminate gracefully.
+  fd = shm_open(rg->rg_name, O_RDWR | O_CREAT | O_EXCL, 0644);
+  if (fd == -1 && errno == EEXIST) {
+    fd = shm_open(rg->rg_name, O_RDONLY, 0);
+    if (fd != -1 && !ring_abandoned(fd)) {
+      notify(NL_ERROR, false, "Ring %s is in use by another process",
+             rg->rg_name);
+      close(fd);
+      return false;
+    }
+
+    if (fd != -1)
+      close(fd);
+
+    notify(NL_DEBUG, false, "Replacing abandoned ring %s", rg->rg_name);
+    shm_unlink(rg->rg_name);
+    fd = shm_open(rg->rg_name, O_RDWR | O_CREAT | O_EXCL, 0644);
+  }
+
+  if (fd == -1) {
+    notify(NL_ERROR, true, "Unable to create ring %s", rg->rg_name);
+    return false;
+  }
+
+  if (ftruncate(fd, (off_t)rg->rg_len) == -1) {
+    notify(NL_ERROR, true, "Unable to resize ring %s", rg->rg_name);
+    close(fd);
+    shm_unlink(rg->rg_name);
+    return false;
+  }
+
+  if (!ring_map(rg, fd, PROT_READ | PROT_WRITE)) {
+    close(fd);
+    shm_unlink(rg->rg_name);
+    return false;
+  }
+
+  close(fd);
+
+  // The newly truncated object is zero-filled, therefore only the non-zero
+  // fields need to be set. The magic number is written last, so that readers
+  // do not attach to a partially initialised ring.
+  rg->rg_hdr->rh_fver  = MBEAT_RING_VERSION;
+  rg->rg_hdr->rh_cnt   = cnt;
+  rg->rg_hdr->rh_rsize = sizeof(raw_output);
+  rg->rg_hdr->rh_wpid  = (uint64_t)getpid();
+  __atomic_store_n(&rg->rg_hdr->rh_magic, MBEAT_RING_MAGIC, __ATOMIC_RELEASE);
+
+  rg->rg_owner = true;
+  return true;
+}
+
+/// Attach to an existing shared memory ring as a reader.
+/// @return status code
+///
+/// @param[out] rg     ring
+/// @param[in]  name   name of the shared memory object
+/// @param[in]  oldest start with the oldest available record
+bool
+ring_attach(ring* rg, const char* name, const bool oldest)
+{
+  int fd;
+  ring_header hdr;
+  struct stat st;
+  uint64_t head;
+
+  memset(rg, 0, sizeof(*rg));
+  if (!ring_name(rg, name))
+    return false;
+
+  fd = shm_open(rg->rg_name, O_RDONLY, 0);
+  if (fd == -1) {
+    notify(NL_ERROR, true, "Unable to open ring %s", rg->rg_name);
+    return false;
+  }
+
+  // Validate the header before mapping the whole ring.
+  if (pread(fd, &hdr, sizeof(hdr), 0) != (ssize_t)sizeof(hdr)
+   || hdr.rh_magic != MBEAT_RING_MAGIC) {
+    notify(NL_ERROR, false, "Object %s is not an mbeat ring", rg->rg_name);
+    close(fd);
+    return false;
+  }
+
+  if (hdr.rh_fver != MBEAT_RING_VERSION) {
+    notify(NL_ERROR, false,
+           "Unsupported ring version, expected: %u, got: %" PRIu32,
+           MBEAT_RING_VERSION, hdr.rh_fver);
+    close(fd);
+    return false;
+  }
+
+  if (hdr.rh_rsize != sizeof(raw_output)) {
+    notify(NL_ERROR, false,
+           "Unsupported ring record size, expected: %zu, got: %" PRIu64,
+           sizeof(raw_output), hdr.rh_rsize);
+    close(fd);
+    return false;
+  }
+
+  // The slot index is computed by masking, and the whole ring has to be
+  // backed by the object, as accesses beyond its end raise SIGBUS.
+  if (hdr.rh_cnt == 0 || (hdr.rh_cnt & (hdr.rh_cnt - 1)) != 0
+   || hdr.rh_cnt > ring_max_cnt()) {
+    notify(NL_ERROR, false, "Ring %s has an invalid size of %" PRIu64
+           " slots", rg->rg_name, hdr.rh_cnt);
+    close(fd);
+    return false;
+  }
+
+  rg->rg_len  = sizeof(ring_header) + hdr.rh_cnt * sizeof(ring_slot);
+  rg->rg_mask = hdr.rh_cnt - 1;
+
+  if (fstat(fd, &st) == -1) {
+    notify(NL_ERROR, true, "Unable to get the size of ring %s", rg->rg_name);
+    close(fd);
+    return false;
+  }
+
+  if (st.st_size < 0 || (uint64_t)st.st_size < (uint64_t)rg->rg_len) {
+    notify(NL_ERROR, false, "Ring %s is truncated, expected: %zu bytes, "
+           "got: %jd", rg->rg_name, rg->rg_len, (intmax_t)st.st_size);
+    close(fd);
+    return false;
+  }
+  if (!ring_map(rg, fd, PROT_READ)) {
+    close(fd);
+    return false;
+  }
+
+  close(fd);
+
+  // Select the starting position of the reader cursor.
+  head = __atomic_load_n(&rg->rg_hdr->rh_head, __ATOMIC_ACQUIRE);
+  if (oldest && head > hdr.rh_cnt)
+    rg->rg_cur = head - hdr.rh_cnt;
+  else if (oldest)
+    rg->rg_cur = 0;
+  else
+    rg->rg_cur = head;
+
+  notify(NL_DEBUG, false, "Attached to ring %s at record %" PRIu64,
+         rg->rg_name, rg->rg_cur);
+  return true;
+}
+
+/// Append a record to the ring. Readers that fall behind by more than the
+/// ring size lose the overwritten records.
+///
+/// @param[in] rg ring
+/// @param[in] ro record
+void
+ring_write(ring* rg, const raw_output* ro)
+{
+  ring_slot* slot;
+  uint64_t n;
+
+  // Only the writer modifies the head, hence no atomic read is required.
+  n = rg->rg_hdr->rh_head;
+  slot = &rg->rg_slots[n & rg->rg_mask];
+
+  // Invalidate the slot for the duration of the copy, so that a concurrent
+  // reader is able to detect the torn record.
+  __atomic_store_n(&slot->rs_seq, 0, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  memcpy(&slot->rs_rec, ro, sizeof(*ro));
+  __atomic_store_n(&slot->rs_seq, n + 1, __ATOMIC_RELEASE);
+  __atomic_store_n(&rg->rg_hdr->rh_head, n + 1, __ATOMIC_RELEASE);
+}
+
+/// Read the next record from the ring.
+/// @return RING_EMPTY, RING_READ or RING_CLOSED
+///
+/// @param[in]  rg ring
+/// @param[out] ro record
+int
+ring_read(ring* rg, raw_output* ro)
+{
+  ring_slot* slot;
+  uint64_t head;
+  uint64_t cnt;
+  uint64_t seq;
+
+  cnt = rg->rg_mask + 1;
+  while (1) {
+    head = __atomic_load_n(&rg->rg_hdr->rh_head, __ATOMIC_ACQUIRE);
+    if (rg->rg_cur >= head) {
+      if (__atomic_load_n(&rg->rg_hdr->rh_closed, __ATOMIC_ACQUIRE) != 0
+       && __atomic_load_n(&rg->rg_hdr->rh_head, __ATOMIC_ACQUIRE) == head)
+        return RING_CLOSED;
+      return RING_EMPTY;
+    }
+
+    // Skip the records that were already overwritten by the writer. The
+    // oldest slot might be just being rewritten, so skip it as well.
+    if (head - rg->rg_cur >= cnt) {
+      rg->rg_lost += head - cnt + 1 - rg->rg_cur;
+      rg->rg_cur   = head - cnt + 1;
+    }
+
+    // Copy the record and verify that the writer did not touch the slot in
+    // the meantime.
+    slot = &rg->rg_slots[rg->rg_cur & rg->rg_mask];
+    seq = __atomic_load_n(&slot->rs_seq, __ATOMIC_ACQUIRE);
+    if (seq == rg->rg_cur + 1) {
+      memcpy(ro, &slot->rs_rec, sizeof(*ro));
+      __atomic_thread_fence(__ATOMIC_ACQUIRE);
+      if (__atomic_load_n(&slot->rs_seq, __ATOMIC_RELAXED) == seq) {
+        rg->rg_cur++;
+        return RING_READ;
+      }
+    }
+
+    // The slot was overwritten, retry with a fresh view of the writer head.
+    rg->rg_lost++;
+    rg->rg_cur++;
+  }
+}
+
+/// Release the resources held by the ring. The writer marks the ring as
+/// closed and removes the shared memory object.
+///
+/// @param[in] rg ring
+void
+ring_close(ring* rg)
+{
+  if (rg->rg_hdr == NULL)
+    return;
+
+  if (rg->rg_owner) {
+    __atomic_store_n(&rg->rg_hdr->rh_closed, 1, __ATOMIC_RELEASE);
+    if (shm_unlink(rg->rg_name) == -1)
+      notify(NL_WARN, true, "Unable to remove ring %s", rg->rg_name);
+  }
+
+  munmap(rg->rg_hdr, rg->rg_len);
+  rg->rg_hdr = NULL;
+}
@@ -0,0 +1,62 @@
+// Copyright (c) 2017-2018 Two Sigma Open Source, LLC.
+// All Rights Reserved
+//
+// Distributed under the terms of the 2-clause BSD License. The full
+// license is in the file LICENSE, distributed as part of this software.
+
+#ifndef MBEAT_RING_H
+#define MBEAT_RING_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "types.h"
+
+
+// Ring-related constants.
+#define MBEAT_RING_MAGIC   0x6d72696e
+#define MBEAT_RING_VERSION          1
+
+/// Header of the shared memory ring.
+typedef struct _ring_header {
+  uint32_t rh_magic;   ///< Magic identifier.
+  uint32_t rh_fver;    ///< Format version.
+  uint64_t rh_cnt;     ///< Number of slots (power of two).
+  uint64_t rh_rsize;   ///< Size of a single record in bytes.
+  uint64_t rh_head;    ///< Number of records ever written.
+  uint64_t rh_wpid;    ///< Process ID of the writer.
+  uint64_t rh_closed;  ///< Writer has finished publishing.
+  uint8_t  rh_pad[16]; ///< Padding (unused).
+} ring_header;
+
+/// Single slot of the shared memory ring.
+typedef struct _ring_slot {
+  uint64_t   rs_seq; ///< Sequence number of the stored record (one-based).
+  raw_output rs_rec; ///< Stored record.
+} ring_slot;
+
+/// Handle of a mapped shared memory ring.
+typedef struct _ring {
+  ring_header* rg_hdr;       ///< Mapped header.
+  ring_slot*   rg_slots;     ///< Mapped slots.
+  uint64_t     rg_mask;      ///< Slot index mask.
+  uint64_t     rg_cur;       ///< Reader cursor.
+  uint64_t     rg_lost;      ///< Records lost due to overruns.
+  size_t       rg_len;       ///< Length of the mapping.
+  char         rg_name[256]; ///< Name of the shared memory object.
+  bool         rg_owner;     ///< Mapping was created by this process.
+} ring;
+
+// Result of a single ring read attempt.
+#define RING_EMPTY   0 // No new record is available.
+#define RING_READ    1 // A record was read.
+#define RING_CLOSED  2 // The writer finished and all records were read.
+
+uint64_t ring_max_cnt(void);
+bool ring_create(ring* rg, const char* name, const uint64_t cnt);
+bool ring_attach(ring* rg, const char* name, const bool oldest);
+void ring_write(ring* rg, const raw_output* ro);
+int  ring_read(ring* rg, raw_output* ro);
+void ring_close(ring* rg);
+
+#endif
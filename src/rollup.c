@@ -0,0 +1,413 @@
+// Copyright (c) 2017-2018 Two Sigma Open Source, LLC.
+// All Rights Reserved
+//
+// Distributed under the terms of the 2-clause BSD License. The full
+// license is in the file LICENSE, distributed as part of this software.
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+
+#include "rollup.h"
+#include "common.h"
+
+
+/// Allocate the aggregates of both buffers for all flows of the flow table,
+/// and the parks for as many removed flows at once.
+/// @return status code
+///
+/// @param[out] ru   rollup
+/// @param[in]  ft   flow table
+/// @param[in]  sink writer of the rows
+/// @param[in]  bkt  write the latency buckets
+/// @param[in]  now  system time of the start of the first interval
+bool
+rollup_init(rollup* ru,
+            const flow_table* ft,
+            rollup_sink sink,
+            const bool bkt,
+            const uint64_t now)
+{
+  unsigned int i;
+  bool ok;
+
+  memset(ru, 0, sizeof(*ru));
+  ru->ru_ft       = ft;
+  ru->ru_sink     = sink;
+  ru->ru_bkt      = bkt ? 1 : 0;
+  ru->ru_start[0] = now;
+  ok = true;
+
+  // As with the flow table, pages of flows that are never used do not
+  // contribute to the resident memory.
+  for (i = 0; i < 2; i++) {
+    ru->ru_agg[i]          = calloc(ft->ft_cap, sizeof(rollup_agg));
+    ru->ru_park[i].rp_agg  = calloc(ft->ft_cap, sizeof(rollup_agg));
+    ru->ru_park[i].rp_next = calloc(ft->ft_cap, sizeof(uint64_t));
+    ru->ru_park[i].rp_bkts = calloc(ft->ft_nbkts, sizeof(uint64_t));
+    ok = ok && ru->ru_agg[i] != NULL && ru->ru_park[i].rp_agg != NULL
+       && ru->ru_park[i].rp_next != NULL && ru->ru_park[i].rp_bkts != NULL;
+  }
+
+  if (!ok) {
+    notify(NL_ERROR, true, "Unable to allocate memory for the rollups of %"
+           PRIu64 " flows", ft->ft_cap);
+    rollup_free(ru);
+    return false;
+  }
+
+  return true;
+}
+
+/// Release the memory held by the aggregates.
+///
+/// @param[in] ru rollup
+void
+rollup_free(rollup* ru)
+{
+  unsigned int i;
+
+  for (i = 0; i < 2; i++) {
+    free(ru->ru_agg[i]);
+    free(ru->ru_park[i].rp_agg);
+    free(ru->ru_park[i].rp_next);
+    free(ru->ru_park[i].rp_bkts);
+    ru->ru_agg[i]          = NULL;
+    ru->ru_park[i].rp_agg  = NULL;
+    ru->ru_park[i].rp_next = NULL;
+    ru->ru_park[i].rp_bkts = NULL;
+  }
+}
+
+/// Find the parked aggregate of a flow.
+/// @return link that holds the index of the aggregate plus one, or zero at the
+///         end of the hash chain if the flow is not parked
+///
+/// @param[in] ru rollup
+/// @param[in] rp park
+/// @param[in] fl flow
+static uint64_t*
+park_find(const rollup* ru, rollup_park* rp, const flow* fl)
+{
+  rollup_agg* ra;
+  uint64_t* link;
+
+  link = &rp->rp_bkts[fl->fl_hash & (ru->ru_ft->ft_nbkts - 1)];
+  while (*link != 0) {
+    ra = &rp->rp_agg[*link - 1];
+    if (ra->ra_hash == fl->fl_hash && ra->ra_ep == fl->fl_ep
+     && ra->ra_pid == fl->fl_pid)
+      break;
+    link = &rp->rp_next[*link - 1];
+  }
+
+  return link;
+}
+
+/// Add the aggregate of a flow to another one of the same flow.
+///
+/// @param[out] dst target aggregate
+/// @param[in]  src source aggregate
+static void
+merge_agg(rollup_agg* dst, const rollup_agg* src)
+{
+  unsigned int i;
+
+  if (dst->ra_recv == 0) {
+    memcpy(dst, src, sizeof(*dst));
+    return;
+  }
+
+  if (!dst->ra_named && src->ra_named) {
+    memcpy(dst->ra_iname, src->ra_iname, sizeof(dst->ra_iname));
+    memcpy(dst->ra_hname, src->ra_hname, sizeof(dst->ra_hname));
+    dst->ra_named = 1;
+  }
+
+  dst->ra_recv  += src->ra_recv;
+  dst->ra_bytes += src->ra_bytes;
+  dst->ra_lost  += src->ra_lost;
+  dst->ra_gaps  += src->ra_gaps;
+  dst->ra_dups  += src->ra_dups;
+  dst->ra_reord += src->ra_reord;
+  dst->ra_lsum  += src->ra_lsum;
+  if (src->ra_lmin < dst->ra_lmin)
+    dst->ra_lmin = src->ra_lmin;
+
+  for (i = 0; i < HIST_LEN; i++)
+    dst->ra_hist.hg_cnt[i] += src->ra_hist.hg_cnt[i];
+  dst->ra_hist.hg_sum += src->ra_hist.hg_sum;
+  if (src->ra_hist.hg_max > dst->ra_hist.hg_max)
+    dst->ra_hist.hg_max = src->ra_hist.hg_max;
+}
+
+/// Add a datagram to the active aggregates of its flow.
+///
+/// @param[in] ru   rollup
+/// @param[in] fl   flow of the datagram
+/// @param[in] anom anomalies detected by the sequence accounting
+/// @param[in] lost change of the missing datagrams of the flow
+/// @param[in] len  number of received bytes
+/// @param[in] lat  one-way latency in nanoseconds
+void
+rollup_add(rollup* ru,
+           const flow* fl,
+           const uint8_t anom,
+           const int64_t lost,
+           const uint64_t len,
+           const uint64_t lat)
+{
+  rollup_park* rp;
+  rollup_agg* ra;
+  uint64_t* link;
+  uint64_t i;
+
+  ra = &ru->ru_agg[ru->ru_cur][fl - ru->ru_ft->ft_pool];
+
+  // A flow that returns within the interval continues its parked aggregate,
+  // whose entry goes to the free list of the park.
+  if (fl->fl_tot.fs_recv == 1) {
+    rp = &ru->ru_park[ru->ru_cur];
+    link = park_find(ru, rp, fl);
+    if (*link != 0) {
+      i = *link - 1;
+      memcpy(ra, &rp->rp_agg[i], sizeof(*ra));
+      memset(&rp->rp_agg[i], 0, sizeof(*ra));
+      *link = rp->rp_next[i];
+      rp->rp_next[i] = rp->rp_free;
+      rp->rp_free = i + 1;
+    }
+  }
+
+  if (ra->ra_recv == 0) {
+    ra->ra_ep   = fl->fl_ep;
+    ra->ra_pid  = fl->fl_pid;
+    ra->ra_hash = fl->fl_hash;
+    ra->ra_key  = fl->fl_key;
+    ra->ra_lmin = UINT64_MAX;
+  }
+
+  // Compact payloads learn the names of their publisher from announcements,
+  // which can arrive at any time during the interval.
+  if (!ra->ra_named && fl->fl_named) {
+    memcpy(ra->ra_iname, fl->fl_iname, sizeof(ra->ra_iname));
+    memcpy(ra->ra_hname, fl->fl_hname, sizeof(ra->ra_hname));
+    ra->ra_named = 1;
+  }
+
+  ra->ra_recv++;
+  ra->ra_bytes += len;
+  ra->ra_lost  += lost;
+  if (anom & FLOW_GAP)
+    ra->ra_gaps++;
+  if (anom & FLOW_DUP)
+    ra->ra_dups++;
+  if (anom & FLOW_REORD)
+    ra->ra_reord++;
+
+  if (lat < ra->ra_lmin)
+    ra->ra_lmin = lat;
+  ra->ra_lsum += lat;
+  hist_add(&ra->ra_hist, lat);
+}
+
+/// Sum the histogram into buckets of powers of two of nanoseconds.
+///
+/// @param[out] bkt buckets
+/// @param[in]  hg  histogram
+static void
+sum_buckets(uint32_t* bkt, const histogram* hg)
+{
+  unsigned int i;
+  unsigned int e;
+
+  memset(bkt, 0, ROLLUP_BUCKETS * sizeof(*bkt));
+  for (i = 0; i < HIST_LEN; i++) {
+    if (hg->hg_cnt[i] == 0)
+      continue;
+
+    // Values below HIST_SUB have a bucket each, the rest is split into
+    // HIST_SUB buckets per power of two.
+    if (i < HIST_SUB)
+      e = i < 2 ? 0 : 1;
+    else
+      e = i / HIST_SUB + HIST_SUB_BITS - 1;
+    bkt[e] += hg->hg_cnt[i];
+  }
+}
+
+/// Write the row of an aggregate.
+///
+/// @param[in] ru    rollup
+/// @param[in] ra    aggregate
+/// @param[in] start system time of the start of the row
+/// @param[in] dur   duration of the row (ns)
+/// @param[in] drops kernel drops of the endpoint within the row
+static void
+write_row(rollup* ru, const rollup_agg* ra, const uint64_t start,
+          const uint64_t dur, const uint64_t drops)
+{
+  raw_rollup rr;
+  uint32_t bkt[ROLLUP_BUCKETS];
+
+  memset(&rr, 0, sizeof(rr));
+  rr.rr_start = start;
+  rr.rr_dur   = dur;
+  rr.rr_key   = ra->ra_key;
+  rr.rr_maddr = ra->ra_ep->ep_maddr.s_addr;
+  rr.rr_nbkt  = ru->ru_bkt ? ROLLUP_BUCKETS : 0;
+  memcpy(rr.rr_piname, ra->ra_iname, sizeof(rr.rr_piname));
+  memcpy(rr.rr_phname, ra->ra_hname, sizeof(rr.rr_phname));
+  memcpy(rr.rr_iname, ra->ra_ep->ep_iname, sizeof(rr.rr_iname));
+  memcpy(rr.rr_hname, hname, sizeof(rr.rr_hname));
+
+  // Late arrivals of datagrams that were missing in a previous interval
+  // reduce the count below zero.
+  rr.rr_recv  = ra->ra_recv;
+  rr.rr_bytes = ra->ra_bytes;
+  rr.rr_lost  = ra->ra_lost > 0 ? (uint64_t)ra->ra_lost : 0;
+  rr.rr_gaps  = ra->ra_gaps;
+  rr.rr_dups  = ra->ra_dups;
+  rr.rr_reord = ra->ra_reord;
+  rr.rr_lmin  = ra->ra_lmin;
+  rr.rr_lmean = ra->ra_lsum / ra->ra_recv;
+  rr.rr_lmax  = ra->ra_hist.hg_max;
+  rr.rr_lp99  = hist_percentile(&ra->ra_hist, 99.0);
+  rr.rr_drops = drops;
+
+  if (ru->ru_bkt)
+    sum_buckets(bkt, &ra->ra_hist);
+  ru->ru_sink(&rr, ru->ru_bkt ? bkt : NULL);
+  ru->ru_rows++;
+}
+
+/// Move the aggregate of a flow that is about to be removed from the flow table
+/// to the park of the active buffer, which frees its place for the next flow.
+/// If the park is full, i.e. more flows than the flow table holds are parked at
+/// the same time, the row of the flow is written right away and ends now.
+///
+/// @param[in] ru  rollup
+/// @param[in] fl  flow
+/// @param[in] now current system time
+void
+rollup_remove(rollup* ru, const flow* fl, const uint64_t now)
+{
+  rollup_park* rp;
+  rollup_agg* ra;
+  uint64_t* link;
+  uint64_t i;
+
+  ra = &ru->ru_agg[ru->ru_cur][fl - ru->ru_ft->ft_pool];
+  if (ra->ra_recv == 0)
+    return;
+
+  // Append a free entry to the end of the hash chain, unless the flow was
+  // already parked within the interval.
+  rp = &ru->ru_park[ru->ru_cur];
+  link = park_find(ru, rp, fl);
+  if (*link == 0) {
+    if (rp->rp_free != 0) {
+      i = rp->rp_free - 1;
+      rp->rp_free = rp->rp_next[i];
+    } else if (rp->rp_cnt < ru->ru_ft->ft_cap) {
+      i = rp->rp_cnt++;
+    } else {
+      write_row(ru, ra, ru->ru_start[ru->ru_cur],
+                now - ru->ru_start[ru->ru_cur], 0);
+      ru->ru_early++;
+      memset(ra, 0, sizeof(*ra));
+      return;
+    }
+
+    rp->rp_next[i] = 0;
+    *link = i + 1;
+  }
+
+  merge_agg(&rp->rp_agg[*link - 1], ra);
+  memset(ra, 0, sizeof(*ra));
+}
+
+/// Close the interval of the active buffer and open the next one in the other
+/// buffer, which takes only the swap of the buffers. All rows of the previous
+/// interval have to be written before.
+///
+/// @param[in] ru  rollup
+/// @param[in] now system time of the end of the interval
+void
+rollup_close(rollup* ru, const uint64_t now)
+{
+  // Only the prefix of the pool that was ever used can hold aggregates, and
+  // the rows of the removed flows follow.
+  ru->ru_next  = 0;
+  ru->ru_slots = ru->ru_ft->ft_hwm;
+  ru->ru_end   = ru->ru_slots + ru->ru_park[ru->ru_cur].rp_cnt;
+
+  ru->ru_dur = now - ru->ru_start[ru->ru_cur];
+  ru->ru_cur ^= 1;
+  ru->ru_start[ru->ru_cur] = now;
+}
+
+/// Decide whether rows of the closed interval remain to be written.
+/// @return decision
+///
+/// @param[in] ru rollup
+bool
+rollup_pending(const rollup* ru)
+{
+  return ru->ru_next < ru->ru_end;
+}
+
+/// Write the rows of the closed interval for up to a number of flows and
+/// clear their aggregates for the interval after the next one. The park of
+/// the closed buffer is emptied together with its last row.
+///
+/// @param[in] ru  rollup
+/// @param[in] cnt number of flows
+void
+rollup_write(rollup* ru, const uint64_t cnt)
+{
+  rollup_park* rp;
+  rollup_agg* ra;
+  uint64_t i;
+  uint8_t old;
+
+  old = ru->ru_cur ^ 1;
+  rp = &ru->ru_park[old];
+  for (i = 0; i < cnt && ru->ru_next < ru->ru_end; i++) {
+    if (ru->ru_next < ru->ru_slots) {
+      ra = &ru->ru_agg[old][ru->ru_next++];
+    } else {
+      ra = &rp->rp_agg[ru->ru_next++ - ru->ru_slots];
+      rp->rp_bkts[ra->ra_hash & (ru->ru_ft->ft_nbkts - 1)] = 0;
+    }
+
+    if (ra->ra_recv == 0) {
+      memset(ra, 0, sizeof(*ra));
+      continue;
+    }
+
+    write_row(ru, ra, ru->ru_start[old], ru->ru_dur, ra->ra_ep->ep_rdrop);
+    memset(ra, 0, sizeof(*ra));
+  }
+
+  if (ru->ru_next == ru->ru_end) {
+    rp->rp_cnt  = 0;
+    rp->rp_free = 0;
+  }
+}
+
+/// Compute the memory used by the aggregates.
+/// @return number of bytes
+///
+/// @param[in] ru rollup
+size_t
+rollup_memory(const rollup* ru)
+{
+  if (ru->ru_agg[0] == NULL)
+    return 0;
+
+  return 2 * (ru->ru_ft->ft_cap * (2 * sizeof(rollup_agg) + sizeof(uint64_t))
+            + ru->ru_ft->ft_nbkts * sizeof(uint64_t));
+}
@@ -0,0 +1,97 @@
+// Copyright (c) 2017-2018 Two Sigma Open Source, LLC.
+// All Rights Reserved
+//
+// Distributed under the terms of the 2-clause BSD License. The full
+// license is in the file LICENSE, distributed as part of this software.
+
+#ifndef MBEAT_ROLLUP_H
+#define MBEAT_ROLLUP_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "types.h"
+#include "flow.h"
+
+
+// Number of latency buckets of a rollup row, one per power of two of
+// nanoseconds. The first bucket also counts zero latencies.
+#define ROLLUP_BUCKETS 64
+
+/// Aggregates of a flow over one rollup interval. The identity of the flow is
+/// copied, so that the row can be written even after the flow was evicted.
+typedef struct _rollup_agg {
+  const endpoint* ra_ep;               ///< Receiving endpoint.
+  uint64_t        ra_pid;              ///< Publisher ID.
+  uint64_t        ra_hash;             ///< Hash of the identity of the flow.
+  uint64_t        ra_key;              ///< Publisher key.
+  char            ra_iname[INAME_LEN]; ///< Publisher's interface name.
+  char            ra_hname[HNAME_LEN]; ///< Publisher's hostname.
+  uint64_t        ra_recv;             ///< Received datagrams.
+  uint64_t        ra_bytes;            ///< Received bytes.
+  int64_t         ra_lost;             ///< Change of the missing datagrams.
+  uint64_t        ra_gaps;             ///< Gaps in the sequence.
+  uint64_t        ra_dups;             ///< Duplicate datagrams.
+  uint64_t        ra_reord;            ///< Datagrams that arrived out of order.
+  uint64_t        ra_lmin;             ///< Minimal latency (ns).
+  uint64_t        ra_lsum;             ///< Sum of the latencies (ns).
+  uint8_t         ra_named;            ///< Names of the publisher are known.
+  uint8_t         ra_pad[7];           ///< Padding (unused).
+  histogram       ra_hist;             ///< Latency histogram.
+} rollup_agg;
+
+/// Aggregates of the flows that were removed from the flow table during one
+/// interval, kept until the rows of the interval are written. They are looked
+/// up by the identity of the flow, so that a flow that returns within the
+/// interval continues its aggregate.
+typedef struct _rollup_park {
+  rollup_agg* rp_agg;  ///< Parked aggregates.
+  uint64_t*   rp_next; ///< Next aggregate in the hash chain, plus one.
+  uint64_t*   rp_bkts; ///< First aggregate of each hash bucket, plus one.
+  uint64_t    rp_free; ///< First aggregate of the free list, plus one.
+  uint64_t    rp_cnt;  ///< Aggregates that were used in the interval.
+} rollup_park;
+
+/// Writer of a rollup row, followed by the latency buckets if requested.
+typedef void (*rollup_sink)(const raw_rollup* rr, const uint32_t* bkt);
+
+/// Double-buffered aggregates of all flows, indexed by their place in the pool
+/// of the flow table. Datagrams are added to the active buffer, while the rows
+/// of the closed buffer are written a slice at a time. The aggregate of a flow
+/// that is removed from the flow table moves to the park of its buffer.
+typedef struct _rollup {
+  const flow_table* ru_ft;       ///< Flow table.
+  rollup_agg*       ru_agg[2];   ///< Aggregates of each buffer.
+  rollup_park       ru_park[2];  ///< Aggregates of the removed flows.
+  uint64_t          ru_start[2]; ///< System time of the start of each buffer.
+  uint64_t          ru_dur;      ///< Duration of the closed interval (ns).
+  uint64_t          ru_next;     ///< Next row to write from the closed buffer.
+  uint64_t          ru_slots;    ///< End of the flows of the closed buffer.
+  uint64_t          ru_end;      ///< End of the rows of the closed buffer.
+  uint64_t          ru_rows;     ///< Rows written in total.
+  uint64_t          ru_early;    ///< Rows written early due to a full park.
+  rollup_sink       ru_sink;     ///< Writer of the rows.
+  uint8_t           ru_cur;      ///< Index of the active buffer.
+  uint8_t           ru_bkt;      ///< Write the latency buckets.
+  uint8_t           ru_pad[6];   ///< Padding (unused).
+} rollup;
+
+bool   rollup_init(rollup* ru,
+                   const flow_table* ft,
+                   rollup_sink sink,
+                   const bool bkt,
+                   const uint64_t now);
+void   rollup_free(rollup* ru);
+void   rollup_add(rollup* ru,
+                  const flow* fl,
+                  const uint8_t anom,
+                  const int64_t lost,
+                  const uint64_t len,
+                  const uint64_t lat);
+void   rollup_remove(rollup* ru, const flow* fl, const uint64_t now);
+void   rollup_close(rollup* ru, const uint64_t now);
+bool   rollup_pending(const rollup* ru);
+void   rollup_write(rollup* ru, const uint64_t cnt);
+size_t rollup_memory(const rollup* ru);
+
+#endif
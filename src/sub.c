@@ -4,9 +4,17 @@
 // Distributed under the terms of the 2-clause BSD License. The full
 // license is in the file LICENSE, distributed as part of this software.
 
+// The recvmmsg(2) function is a GNU extension on Linux.
+#if defined(__linux__) && !defined(MBEAT_FORCE_POSIX)
+  #define _GNU_SOURCE
+#endif
+
+#include "platform.h"
+
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/time.h>
+#include <sys/resource.h>
 #include <sys/uio.h>
 
 #include <net/if.h>
@@ -28,22 +36,86 @@
 #include <string.h>
 #include <err.h>
 #include <getopt.h>
+#include <fcntl.h>
 
 #include "types.h"
 #include "common.h"
 #include "parse.h"
+#include "flow.h"
+#include "output.h"
+#include "ring.h"
+#include "tstamp.h"
+#include "decode.h"
+#include "tune.h"
+#include "numa.h"
+#include "link.h"
+#include "rollup.h"
 #include "sub.h"
 
 
 // Default values for optional arguments.
-#define DEF_BUFFER_SIZE  0 // Zero denotes the system default.
-#define DEF_KEY          0 // Zero denotes no key filtering.
-#define DEF_OFFSET       0 // Sequence numbers have no offset by default.
-#define DEF_ERROR        0 // Do not stop the process on receiving error.
-#define DEF_RAW_OUTPUT   0 // Raw binary output is disabled by default.
-#define DEF_UNBUFFERED   0 // Unbuffered output is disabled by default.
-#define DEF_NOTIFY_LEVEL 1 // Log errors and warnings by default.
-#define DEF_NOTIFY_COLOR 1 // Colors in the notification output.
+#define DEF_BUFFER_SIZE             0 // Zero denotes the system default.
+#define DEF_KEY                     0 // Zero denotes no key filtering.
+#define DEF_OFFSET                  0 // Sequence numbers have no offset.
+#define DEF_ERROR                   0 // Do not stop the process on error.
+#define DEF_RAW_OUTPUT              0 // Raw binary output is disabled.
+#define DEF_UNBUFFERED              0 // Unbuffered output is disabled.
+#define DEF_NOTIFY_LEVEL            1 // Log errors and warnings by default.
+#define DEF_NOTIFY_COLOR            1 // Colors in the notification output.
+#define DEF_RING_SIZE           65536 // Records in the shared memory ring.
+#define DEF_DAEMON                  0 // Stay in the foreground by default.
+#define DEF_STATS_INTERVAL          0 // Only report statistics upon exit.
+#define DEF_FLOW_LIMIT          16384 // Maximal number of tracked flows.
+#define DEF_FLOW_IDLE     60000000000 // Evict flows idle for one minute.
+#define DEF_SAMPLE                  0 // Output the record of every datagram.
+#define DEF_PATH_SHIFT          10000 // Smallest latency shift of a path.
+#define DEF_ROLLUP_INTERVAL 1000000000 // Rollup rows every second.
+
+// Period of the internal housekeeping, such as the eviction of idle flows.
+#define HOUSEKEEPING_PERIOD 1000000000
+
+// Longest interval between the wakeups of the event queue in throughput mode.
+#define COALESCE_MAX 1000000000
+
+// Number of datagrams of a flow between updates of its latency percentile.
+#define ANOMALY_REFRESH 128
+
+// Number of flows whose rollup rows are written per wakeup of the event queue.
+#define ROLLUP_SLICE 256
+
+// Output shards and the size of the buffer of each of them.
+#define OUTPUT_SHARDS_MAX 64
+#define OUTPUT_BUFFER     1048576
+
+// Routing of the records among the output shards.
+#define OUTPUT_BY_FLOW     0 // Hash of the flow of the datagram.
+#define OUTPUT_BY_ENDPOINT 1 // Receiving endpoint.
+
+// Long-only command-line options.
+#define LO_RING_SIZE      256
+#define LO_PID_FILE       257
+#define LO_LOG_FILE       258
+#define LO_STATS_INTERVAL 259
+#define LO_FLOW_LIMIT     260
+#define LO_FLOW_IDLE      261
+#define LO_CLOCK          262
+#define LO_SAMPLE         263
+#define LO_ANOMALIES      264
+#define LO_ANOMALY_LAT    265
+#define LO_COLUMNS        266
+#define LO_LATENCY        267
+#define LO_CPU            268
+#define LO_HUGEPAGES      269
+#define LO_NUMA           270
+#define LO_EVENT          271
+#define LO_COALESCE       272
+#define LO_NO_REJOIN      273
+#define LO_PATH           274
+#define LO_ROLLUP         275
+#define LO_ROLLUP_BKT     276
+#define LO_OUT_SHARDS     277
+#define LO_OUT_PREFIX     278
+#define LO_OUT_BY         279
 
 // Command-line options.
 static uint64_t op_buf;  ///< Socket receive buffer size in bytes.
@@ -55,9 +127,143 @@ static uint8_t  op_raw;  ///< Output received datagrams in raw binary format.
 static uint8_t  op_unb;  ///< Turn off buffering on the output stream.
 static uint8_t  op_nlvl; ///< Notification verbosity level.
 static uint8_t  op_ncol; ///< Notification coloring policy.
+static char*    op_ring; ///< Name of the shared memory ring.
+static uint64_t op_rcnt; ///< Number of records in the shared memory ring.
+static uint8_t  op_dmn;  ///< Detach from the terminal and run in background.
+static char*    op_pidf; ///< Path to the process ID file.
+static char*    op_logf; ///< Path to the log file.
+static uint64_t op_sint; ///< Interval between statistics reports.
+static uint64_t op_flim; ///< Maximal number of tracked flows.
+static uint64_t op_fidl; ///< Idle duration after which a flow is evicted.
+static uint64_t op_smp;  ///< Output every Nth datagram of each flow.
+static uint8_t  op_anom; ///< Output the datagrams with anomalies.
+static uint64_t op_alim; ///< Latency above which a datagram is an anomaly.
+static double   op_apct; ///< Flow latency percentile of anomalies.
+static char*    op_cols; ///< Selection of output columns.
+static uint64_t op_lat;  ///< Real-time priority of the latency mode.
+static uint64_t op_cpu;  ///< CPU of the process.
+static uint8_t  op_pin;  ///< Pin the process to a CPU.
+static uint8_t  op_huge; ///< Back large buffers with huge pages.
+static uint8_t  op_numa; ///< Place the process near the traffic.
+static const event_queue* op_evq; ///< Event queue.
+static uint64_t op_coal; ///< Interval between the wakeups of the event queue.
+static uint8_t  op_rjn;  ///< Join the groups again after link changes.
+static uint8_t  op_path; ///< Detect changes of the paths of the flows.
+static uint64_t op_pshf; ///< Smallest latency shift of a path.
+static uint8_t  op_roll; ///< Output the rollup rows of the flows.
+static uint8_t  op_rbkt; ///< Add the latency buckets to the rollup rows.
+static uint64_t op_oshd; ///< Number of output shards.
+static char*    op_opfx; ///< Path prefix of the output shards.
+static uint8_t  op_oby;  ///< Routing of the records among the output shards.
 
 // Object lists.
 static endpoint* eps;
+static endpoint  link_ep; ///< Link monitor in place of an endpoint socket.
+
+/// Shared memory ring for the local fan-out of records.
+static ring rng;
+
+/// Table of all publishers seen by the subscriber.
+static flow_table flows;
+
+/// Per-interval aggregates of the flows.
+static rollup rlp;
+
+// Output shards, each with its own stream and buffer.
+static FILE*    out_files[OUTPUT_SHARDS_MAX]; ///< Streams of the shards.
+static char*    out_bufs[OUTPUT_SHARDS_MAX];  ///< Buffers of the streams.
+static uint64_t out_recs[OUTPUT_SHARDS_MAX];  ///< Records of each shard.
+
+// Statistics.
+static flow_stats st_ivl;   ///< Counters of the current interval.
+static flow_stats st_tot;   ///< Counters of all finished intervals.
+static histogram  st_hist;  ///< Latency histogram of the current interval.
+static uint64_t   st_start; ///< Steady time of the interval start.
+static uint64_t   st_anns;  ///< Received announcements.
+static uint64_t   st_anon;  ///< Compact payloads of unannounced publishers.
+static histogram  st_chist; ///< Corrected latency histogram of the interval.
+static uint64_t   st_dsum;  ///< Sum of the publisher transmit delays.
+static uint64_t   st_dmax;  ///< Maximal publisher transmit delay.
+static uint64_t   st_outs;  ///< Output records.
+static uint64_t   st_supp;  ///< Records suppressed by the output policy.
+static uint64_t   st_xnode; ///< Datagrams delivered on another NUMA node.
+static uint64_t   st_dnode[NUMA_NODE_MAX]; ///< Datagrams per delivery node.
+static bool       st_placed; ///< The process was placed on a NUMA node.
+static uint64_t   st_wake;  ///< Wakeups of the event queue in the interval.
+static uint64_t   st_twake; ///< Wakeups of the event queue in total.
+static uint64_t   st_rcnt;  ///< Endpoints recovered from link changes.
+static uint64_t   st_rsum;  ///< Sum of the recovery times.
+static uint64_t   st_rmax;  ///< Maximal recovery time.
+static uint64_t   st_trcnt; ///< Endpoints recovered in total.
+static uint64_t   st_trsum; ///< Sum of all recovery times.
+static uint64_t   st_trmax; ///< Maximal recovery time in total.
+static uint64_t   st_phops; ///< Changes of the hop counts of paths.
+static uint64_t   st_plvl;  ///< Shifts of the latency levels of paths.
+
+/// Event queues compiled in for the platform, the first one being the default.
+static const event_queue* event_queues[] = {
+#if defined(MBEAT_HAVE_EPOLL)
+  &eq_epoll,
+#endif
+#if defined(MBEAT_HAVE_KQUEUE)
+  &eq_kqueue,
+#endif
+  &eq_poll,
+  &eq_pselect,
+  NULL
+};
+
+// Timers.
+static uint64_t tm_stats; ///< Steady time of the next statistics report.
+static uint64_t tm_house; ///< Steady time of the next housekeeping.
+static uint64_t tm_wake;  ///< Steady time of the last wait for datagrams.
+
+/// Filter of received payloads.
+/// @return decision
+typedef bool (*payload_filter)(payload* pl);
+
+/// Output policy of records.
+/// @return decision
+typedef bool (*record_policy)(flow* fl, const uint8_t anom, const uint64_t lat);
+
+/// Sink of output records.
+typedef void (*record_sink)(const flow* fl, const raw_output* ro);
+
+/// Format of output records written to a stream.
+typedef void (*record_format)(FILE* out, const raw_output* ro);
+
+// Receive path specialised for the configuration upon start, so that the
+// processing of each datagram does not test the options of disabled features.
+static payload_filter rx_filter; ///< Key and sequence number offset filter.
+static record_policy  rx_policy; ///< Output policy.
+static record_sink    rx_sink;   ///< Output method.
+static record_format  rx_format; ///< Output format of the streams.
+
+#if !defined(MBEAT_HAVE_RECVMMSG)
+/// Message entry of a batch, as defined by the recvmmsg(2) interface.
+struct mmsghdr {
+  struct msghdr msg_hdr; ///< Message.
+  unsigned int  msg_len; ///< Number of received bytes.
+};
+#endif
+
+/// List the names of the event queues compiled in for the platform.
+/// @return comma-separated names
+static const char*
+event_queue_names(void)
+{
+  static char names[64];
+  size_t len;
+  int i;
+
+  len = 0;
+  names[0] = '\0';
+  for (i = 0; event_queues[i] != NULL; i++)
+    len += (size_t)snprintf(names + len, sizeof(names) - len, "%s%s",
+                            i > 0 ? ", " : "", event_queues[i]->eq_name);
+
+  return names;
+}
 
 /// Print the utility usage information to the standard output.
 static void
@@ -72,6 +278,7 @@ print_usage(void)
 
     "Options:\n"
     "  -b, --buffer-size BSZ      Receive buffer size in bytes.\n"
+    "  -d, --daemon               Detach and run in the background.\n"
     "  -e, --exit-on-error        Stop the process on receiving error.\n"
     "  -h, --help                 Print this help message.\n"
     "  -k, --key KEY              Only report datagrams with this key.\n"
@@ -80,13 +287,99 @@ print_usage(void)
       " (def=%d)\n"
     "  -p, --port NUM             UDP port for all endpoints. (def=%d)\n"
     "  -r, --raw-output           Output the data in raw binary format.\n"
+    "  -R, --ring NAME            Publish records to a shared memory ring.\n"
+    "      --ring-size CNT        Number of records in the ring. (def=%d)\n"
     "  -u, --disable-buffering    Disable output buffering.\n"
-    "  -v, --verbose              Increase the logging verbosity.\n",
+    "  -v, --verbose              Increase the logging verbosity.\n"
+    "      --pid-file PATH        Write the process ID to a file.\n"
+    "      --log-file PATH        Append logging messages to a file.\n"
+    "      --stats-interval DUR   Report statistics periodically. (def=off)\n"
+    "      --flow-limit CNT       Maximal number of tracked flows. (def=%d)\n"
+    "      --flow-idle DUR        Evict flows idle for this long. (def=60s)\n"
+    "      --clock SRC            Timestamp source: realtime, tai,\n"
+    "                             monotonic_raw or tsc. (def=realtime)\n"
+    "      --sample CNT           Output every CNT-th datagram of each flow.\n"
+    "      --anomalies            Output datagrams with anomalies.\n"
+    "      --anomaly-latency LIM  Latency anomaly as duration or percentile\n"
+    "                             of the flow, e.g. 5ms or p99.9.\n"
+    "      --columns LIST         Comma-separated list of output columns.\n"
+    "      --latency-mode[=PRIO]  Lock memory, run with the real-time priority\n"
+    "                             PRIO and keep the CPUs awake. (def=%d)\n"
+    "      --cpu CPU              Pin the process to CPU.\n"
+    "      --hugepages            Back the flow table with huge pages.\n"
+    "      --numa                 Receive on the NUMA node of the traffic.\n"
+    "      --event-backend NAME   Event queue: %s. (def=%s)\n"
+    "      --coalesce DUR         Wake up at most once per DUR and drain all\n"
+    "                             sockets at once. (def=off)\n"
+    "      --no-rejoin            Ignore the changes of the interfaces.\n"
+    "      --path-changes[=SHF]   Detect path changes from the hop count and\n"
+    "                             latency shifts above SHF. (def=10us)\n"
+    "      --rollup               Output a row per flow and statistics\n"
+    "                             interval instead of the records. The\n"
+    "                             interval follows --stats-interval, which\n"
+    "                             defaults to 1s with --rollup.\n"
+    "      --rollup-buckets       Add the latency buckets to the rollup rows.\n"
+    "      --output-shards CNT    Spread the records over CNT output files.\n"
+    "      --output-prefix PATH   Path prefix of the output files. (def=msub)\n"
+    "      --output-by MODE       Route the records by flow or endpoint.\n"
+    "                             (def=flow)\n",
     MBEAT_VERSION_MAJOR,
     MBEAT_VERSION_MINOR,
     MBEAT_VERSION_PATCH,
     DEF_OFFSET,
-    MBEAT_PORT);
+    MBEAT_PORT,
+    DEF_RING_SIZE,
+    DEF_FLOW_LIMIT,
+    TUNE_PRIORITY,
+    event_queue_names(),
+    event_queues[0]->eq_name);
+}
+
+/// Parse the latency limit of anomalies, either as a duration or as a
+/// percentile of the latencies of the flow prefixed with the letter p.
+/// @return status code
+///
+/// @param[in] str string
+static bool
+parse_latency_limit(const char* str)
+{
+  char* end;
+  double pct;
+
+  if (str[0] != 'p')
+    return parse_scalar(&op_alim, str, parse_time_unit);
+
+  errno = 0;
+  pct = strtod(str + 1, &end);
+  if (errno != 0 || end == str + 1 || *end != '\0'
+   || !(pct > 0.0 && pct < 100.0)) {
+    notify(NL_ERROR, false, "Invalid latency percentile '%s'", str);
+    return false;
+  }
+
+  op_apct = pct;
+  return true;
+}
+
+/// Select an event queue by its name.
+/// @return status code
+///
+/// @param[in] str string
+static bool
+parse_event_queue(const char* str)
+{
+  int i;
+
+  for (i = 0; event_queues[i] != NULL; i++) {
+    if (strcmp(str, event_queues[i]->eq_name) == 0) {
+      op_evq = event_queues[i];
+      return true;
+    }
+  }
+
+  notify(NL_ERROR, false, "Event backend %s is not available, choose from: %s",
+         str, event_queue_names());
+  return false;
 }
 
 /// Parse the command-line options.
@@ -102,14 +395,40 @@ parse_args(int* ep_cnt, int* ep_idx, int argc, char* argv[])
   int opt;
   struct option lopts[] = {
     {"buffer-size",       required_argument, NULL, 'b'},
+    {"daemon",            no_argument,       NULL, 'd'},
     {"exit-on-error",     no_argument,       NULL, 'e'},
     {"help",              no_argument,       NULL, 'h'},
     {"no-color",          no_argument,       NULL, 'n'},
     {"offset",            required_argument, NULL, 'o'},
     {"port",              required_argument, NULL, 'p'},
     {"raw-output",        no_argument,       NULL, 'r'},
+    {"ring",              required_argument, NULL, 'R'},
+    {"ring-size",         required_argument, NULL, LO_RING_SIZE},
     {"disable-buffering", no_argument,       NULL, 'u'},
     {"verbose",           no_argument,       NULL, 'v'},
+    {"pid-file",          required_argument, NULL, LO_PID_FILE},
+    {"log-file",          required_argument, NULL, LO_LOG_FILE},
+    {"stats-interval",    required_argument, NULL, LO_STATS_INTERVAL},
+    {"flow-limit",        required_argument, NULL, LO_FLOW_LIMIT},
+    {"flow-idle",         required_argument, NULL, LO_FLOW_IDLE},
+    {"clock",             required_argument, NULL, LO_CLOCK},
+    {"sample",            required_argument, NULL, LO_SAMPLE},
+    {"anomalies",         no_argument,       NULL, LO_ANOMALIES},
+    {"anomaly-latency",   required_argument, NULL, LO_ANOMALY_LAT},
+    {"columns",           required_argument, NULL, LO_COLUMNS},
+    {"latency-mode",      optional_argument, NULL, LO_LATENCY},
+    {"cpu",               required_argument, NULL, LO_CPU},
+    {"hugepages",         no_argument,       NULL, LO_HUGEPAGES},
+    {"numa",              no_argument,       NULL, LO_NUMA},
+    {"event-backend",     required_argument, NULL, LO_EVENT},
+    {"coalesce",          required_argument, NULL, LO_COALESCE},
+    {"no-rejoin",         no_argument,       NULL, LO_NO_REJOIN},
+    {"path-changes",      optional_argument, NULL, LO_PATH},
+    {"rollup",            no_argument,       NULL, LO_ROLLUP},
+    {"rollup-buckets",    no_argument,       NULL, LO_ROLLUP_BKT},
+    {"output-shards",     required_argument, NULL, LO_OUT_SHARDS},
+    {"output-prefix",     required_argument, NULL, LO_OUT_PREFIX},
+    {"output-by",         required_argument, NULL, LO_OUT_BY},
     {NULL, 0, NULL, 0}
   };
 
@@ -123,8 +442,36 @@ parse_args(int* ep_cnt, int* ep_idx, int argc, char* argv[])
   op_unb  = DEF_UNBUFFERED;
   op_nlvl = nlvl = DEF_NOTIFY_LEVEL;
   op_ncol = ncol = DEF_NOTIFY_COLOR;
-
-  while ((opt = getopt_long(argc, argv, "b:ehk:no:p:ruv", lopts, NULL)) != -1) {
+  op_ring = NULL;
+  op_rcnt = DEF_RING_SIZE;
+  op_dmn  = DEF_DAEMON;
+  op_pidf = NULL;
+  op_logf = NULL;
+  op_sint = DEF_STATS_INTERVAL;
+  op_flim = DEF_FLOW_LIMIT;
+  op_fidl = DEF_FLOW_IDLE;
+  op_smp  = DEF_SAMPLE;
+  op_anom = 0;
+  op_alim = 0;
+  op_apct = 0.0;
+  op_cols = NULL;
+  op_lat  = 0;
+  op_cpu  = 0;
+  op_pin  = 0;
+  op_huge = 0;
+  op_numa = 0;
+  op_evq  = event_queues[0];
+  op_coal = 0;
+  op_rjn  = 1;
+  op_path = 0;
+  op_pshf = DEF_PATH_SHIFT;
+  op_roll = 0;
+  op_rbkt = 0;
+  op_oshd = 0;
+  op_opfx = "msub";
+  op_oby  = OUTPUT_BY_FLOW;
+
+  while ((opt = getopt_long(argc, argv, "b:dehk:no:p:rR:uv", lopts, NULL)) != -1) {
     switch (opt) {
 
       // Receive buffer size.
@@ -133,6 +480,11 @@ parse_args(int* ep_cnt, int* ep_idx, int argc, char* argv[])
           return false;
         break;
 
+      // Run in the background.
+      case 'd':
+        op_dmn = 1;
+        break;
+
       // Process exit on receiving error.
       case 'e':
         op_err = 1;
@@ -171,6 +523,17 @@ parse_args(int* ep_cnt, int* ep_idx, int argc, char* argv[])
         op_raw = 1;
         break;
 
+      // Shared memory ring name.
+      case 'R':
+        op_ring = optarg;
+        break;
+
+      // Number of records in the shared memory ring.
+      case LO_RING_SIZE:
+        if (parse_uint64(&op_rcnt, optarg, 1, ring_max_cnt()) == 0)
+          return false;
+        break;
+
       // Unbuffered output option.
       case 'u':
         op_unb = 1;
@@ -182,6 +545,150 @@ parse_args(int* ep_cnt, int* ep_idx, int argc, char* argv[])
           op_nlvl++;
         break;
 
+      // Process ID file.
+      case LO_PID_FILE:
+        op_pidf = optarg;
+        break;
+
+      // Log file.
+      case LO_LOG_FILE:
+        op_logf = optarg;
+        break;
+
+      // Interval between statistics reports.
+      case LO_STATS_INTERVAL:
+        if (parse_scalar(&op_sint, optarg, parse_time_unit) == 0)
+          return false;
+        break;
+
+      // Maximal number of tracked flows.
+      case LO_FLOW_LIMIT:
+        if (parse_uint64(&op_flim, optarg, 1, UINT64_MAX) == 0)
+          return false;
+        break;
+
+      // Idle duration of flows.
+      case LO_FLOW_IDLE:
+        if (parse_scalar(&op_fidl, optarg, parse_time_unit) == 0)
+          return false;
+        break;
+
+      // Timestamp source.
+      case LO_CLOCK:
+        if (!tstamp_select(optarg))
+          return false;
+        break;
+
+      // Output every Nth datagram of each flow.
+      case LO_SAMPLE:
+        if (parse_uint64(&op_smp, optarg, 1, UINT64_MAX) == 0)
+          return false;
+        break;
+
+      // Output the datagrams with anomalies.
+      case LO_ANOMALIES:
+        op_anom = 1;
+        break;
+
+      // Latency limit of anomalies.
+      case LO_ANOMALY_LAT:
+        if (!parse_latency_limit(optarg))
+          return false;
+        op_anom = 1;
+        break;
+
+      // Selection of output columns.
+      case LO_COLUMNS:
+        op_cols = optarg;
+        break;
+
+      // Low-latency tuning of the host.
+      case LO_LATENCY:
+        op_lat = TUNE_PRIORITY;
+        if (optarg != NULL && parse_uint64(&op_lat, optarg, 1, 99) == 0)
+          return false;
+        break;
+
+      // CPU of the process.
+      case LO_CPU:
+        op_pin = 1;
+        if (parse_uint64(&op_cpu, optarg, 0, TUNE_CPU_MAX) == 0)
+          return false;
+        break;
+
+      // Huge pages for the flow table.
+      case LO_HUGEPAGES:
+        op_huge = 1;
+        break;
+
+      // Placement near the traffic.
+      case LO_NUMA:
+        op_numa = 1;
+        break;
+
+      // Event queue.
+      case LO_EVENT:
+        if (!parse_event_queue(optarg))
+          return false;
+        break;
+
+      // Interval between the wakeups of the event queue.
+      case LO_COALESCE:
+        if (parse_scalar(&op_coal, optarg, parse_time_unit) == 0)
+          return false;
+        if (op_coal > COALESCE_MAX) {
+          notify(NL_ERROR, false, "Coalescing interval must not exceed 1s");
+          return false;
+        }
+        break;
+
+      // Changes of the interfaces.
+      case LO_NO_REJOIN:
+        op_rjn = 0;
+        break;
+
+      // Changes of the paths of the flows.
+      case LO_PATH:
+        op_path = 1;
+        if (optarg != NULL
+         && parse_scalar(&op_pshf, optarg, parse_time_unit) == 0)
+          return false;
+        break;
+
+      // Rollup rows of the flows.
+      case LO_ROLLUP:
+        op_roll = 1;
+        break;
+
+      // Latency buckets of the rollup rows.
+      case LO_ROLLUP_BKT:
+        op_roll = 1;
+        op_rbkt = 1;
+        break;
+
+      // Number of output shards.
+      case LO_OUT_SHARDS:
+        if (parse_uint64(&op_oshd, optarg, 1, OUTPUT_SHARDS_MAX) == 0)
+          return false;
+        break;
+
+      // Path prefix of the output shards.
+      case LO_OUT_PREFIX:
+        op_opfx = optarg;
+        break;
+
+      // Routing of the records among the output shards.
+      case LO_OUT_BY:
+        if (strcmp(optarg, "flow") == 0)
+          op_oby = OUTPUT_BY_FLOW;
+        else if (strcmp(optarg, "endpoint") == 0)
+          op_oby = OUTPUT_BY_ENDPOINT;
+        else {
+          notify(NL_ERROR, false, "Unknown output routing %s", optarg);
+          return false;
+        }
+        break;
+
       // Unknown option.
       case '?':
         fprintf(stderr, "Invalid option '%c'", optopt);
@@ -199,6 +706,45 @@ parse_args(int* ep_cnt, int* ep_idx, int argc, char* argv[])
   nlvl = op_nlvl;
   ncol = op_ncol;
 
+  // The ring always carries full records, which its readers project.
+  if (op_cols != NULL && op_ring != NULL) {
+    notify(NL_ERROR, false, "Column selection does not apply to the ring");
+    return false;
+  }
+
+  // The rollup rows have a fixed layout and are written at the end of each
+  // statistics interval.
+  if (op_roll) {
+    if (op_cols != NULL) {
+      notify(NL_ERROR, false, "Column selection does not apply to the rollup");
+      return false;
+    }
+
+    if (op_sint == 0)
+      op_sint = DEF_ROLLUP_INTERVAL;
+  }
+
+  // Compile the selection of output columns into the formatting plan.
+  if (!output_columns(op_cols))
+    return false;
+
+  // The output shards replace the standard output, and are merged into the
+  // global order by the sequence number of the records, which is not among
+  // the default columns.
+  if (op_oshd > 0) {
+    if (op_ring != NULL || op_roll) {
+      notify(NL_ERROR, false, "Output shards apply to the standard output "
+             "records only");
+      return false;
+    }
+
+    if (!output_has_column("RecSeq")) {
+      notify(NL_ERROR, false, "Output shards need the RecSeq column, select "
+             "it with --columns");
+      return false;
+    }
+  }
+
   *ep_cnt = argc - optind;
   *ep_idx = optind;
 
@@ -241,6 +787,13 @@ create_sockets(void)
                    &enable, sizeof(enable)) == -1)
       notify(NL_WARN, true, "Unable to request Time-To-Live information");
 
+#if defined(MBEAT_HAVE_RXQ_OVFL)
+    // Request the number of datagrams dropped by the kernel for the rollup.
+    if (op_roll && setsockopt(ep->ep_sock, SOL_SOCKET, SO_RXQ_OVFL,
+                              &enable, sizeof(enable)) == -1)
+      notify(NL_WARN, true, "Unable to request the drop counter of the socket");
+#endif
+
     // Set the socket receive buffer size to the requested value.
     if (op_buf != 0) {
       buf_size = (int)op_buf;
@@ -285,154 +838,404 @@ add_socket_events(void)
   endpoint* ep;
 
   for (ep = eps; ep != NULL; ep = ep->ep_next)
-    if (add_socket_event(ep) == false)
+    if (op_evq->eq_add_socket(ep) == false)
       return false;
 
   return true;
 }
 
-/// Print the payload content as a CSV-formatted line to the standard output.
+/// Add the link monitor to the event queue, so that the endpoints recover
+/// from the changes of their interfaces.
+/// @return status code
+static bool
+create_link_monitor(void)
+{
+  if (!op_rjn)
+    return true;
+
+  // Receiving continues without the monitor where it is not available.
+  link_ep.ep_sock = link_open();
+  if (link_ep.ep_sock == -1)
+    return true;
+
+  notify(NL_DEBUG, false, "Monitoring the changes of the interfaces");
+  return op_evq->eq_add_link(&link_ep);
+}
+
+/// Obtain the current steady time.
+/// @return nanoseconds
+static uint64_t
+steady_time(void)
+{
+  struct timespec mtv;
+  uint64_t ns;
+
+  #ifdef __linux__
+    clock_gettime(CLOCK_MONOTONIC_RAW, &mtv);
+  #else
+    clock_gettime(CLOCK_MONOTONIC, &mtv);
+  #endif
+
+  to_nanos(&ns, mtv);
+  return ns;
+}
+
+/// Accept all payloads.
+/// @return decision
+///
+/// @param[in] pl payload
+static bool
+filter_none(payload* pl)
+{
+  (void)pl;
+  return true;
+}
+
+/// Accept only payloads with the selected key.
+/// @return decision
+///
+/// @param[in] pl payload
+static bool
+filter_key(payload* pl)
+{
+  return pl->pl_key == op_key;
+}
+
+/// Accept only payloads at or above the sequence number offset, and apply the
+/// offset to the accepted ones.
+/// @return decision
+///
+/// @param[in] pl payload
+static bool
+filter_offset(payload* pl)
+{
+  if (pl->pl_snum < op_off)
+    return false;
+
+  pl->pl_snum -= op_off;
+  return true;
+}
+
+/// Accept only payloads with the selected key at or above the sequence number
+/// offset, and apply the offset to the accepted ones.
+/// @return decision
+///
+/// @param[in] pl payload
+static bool
+filter_key_offset(payload* pl)
+{
+  return filter_key(pl) && filter_offset(pl);
+}
+
+/// Select the records of all datagrams.
+/// @return decision
+///
+/// @param[in] fl   flow of the datagram
+/// @param[in] anom anomalies detected by the sequence accounting
+/// @param[in] lat  one-way latency in nanoseconds
+static bool
+select_all(flow* fl, const uint8_t anom, const uint64_t lat)
+{
+  (void)fl;
+  (void)anom;
+  (void)lat;
+  return true;
+}
+
+/// Select the records of no datagrams.
+/// @return decision
+///
+/// @param[in] fl   flow of the datagram
+/// @param[in] anom anomalies detected by the sequence accounting
+/// @param[in] lat  one-way latency in nanoseconds
+static bool
+select_none(flow* fl, const uint8_t anom, const uint64_t lat)
+{
+  (void)fl;
+  (void)anom;
+  (void)lat;
+  return false;
+}
+
+/// Publish the record to the shared memory ring.
+///
+/// @param[in] fl flow of the datagram
+/// @param[in] ro record
+static void
+write_ring(const flow* fl, const raw_output* ro)
+{
+  (void)fl;
+  ring_write(&rng, ro);
+}
+
+/// Write the record to the standard output.
+///
+/// @param[in] fl flow of the datagram
+/// @param[in] ro record
+static void
+write_stream(const flow* fl, const raw_output* ro)
+{
+  (void)fl;
+  rx_format(stdout, ro);
+}
+
+/// Write the record to its output shard, selected by the hash of its flow or
+/// by its receiving endpoint. Either way, all records of a flow end up in the
+/// same shard in the order of their arrival.
+///
+/// @param[in] fl flow of the datagram
+/// @param[in] ro record
+static void
+write_shard(const flow* fl, const raw_output* ro)
+{
+  uint64_t idx;
+
+  if (op_oby == OUTPUT_BY_FLOW)
+    idx = fl->fl_hash % op_oshd;
+  else
+    idx = fl->fl_ep->ep_oshd;
+
+  rx_format(out_files[idx], ro);
+  out_recs[idx]++;
+}
+
+/// Decide whether the output policy selects the record of a datagram.
+/// @return decision
+///
+/// @param[in] fl   flow of the datagram
+/// @param[in] anom anomalies detected by the sequence accounting
+/// @param[in] lat  one-way latency in nanoseconds
+static bool
+select_record(flow* fl, const uint8_t anom, const uint64_t lat)
+{
+  // Sample the first datagram of each flow and every Nth one after it.
+  if (op_smp > 0 && (fl->fl_tot.fs_recv - 1) % op_smp == 0)
+    return true;
+
+  if (!op_anom)
+    return false;
+
+  if (anom != 0)
+    return true;
+
+  if (op_alim > 0 && lat > op_alim)
+    return true;
+
+  // The percentile of the flow is refreshed only periodically, as it takes a
+  // traversal of the whole histogram. Flows with too few datagrams have no
+  // meaningful percentile yet.
+  if (op_apct > 0.0) {
+    if (fl->fl_tot.fs_recv % ANOMALY_REFRESH == 0)
+      fl->fl_llim = hist_percentile(&fl->fl_hist, op_apct);
+
+    if (fl->fl_tot.fs_recv > ANOMALY_REFRESH && lat > fl->fl_llim)
+      return true;
+  }
+
+  return false;
+}
+
+/// Report a change of the path of a flow.
 ///
-/// @param[in] pl  payload
-/// @param[in] ep  connection endpoint
-/// @param[in] rtv packet system arrival time
-/// @param[in] mtv packet steady arrival time
-/// @param[in] ttl Time-To-Live value upon arrival
+/// @param[in] fl  flow
+/// @param[in] chg detected changes (FLOW_HOPS and FLOW_LEVEL flags)
+/// @param[in] pc  path change
 static void
-print_payload_csv(const payload* pl,
-                  const endpoint* ep,
-                  const struct timespec* rtv,
-                  const struct timespec* mtv,
-                  const int ttl)
-{
-  uint64_t rtime;
-  uint64_t mtime;
-  char ttl_str[8];
-
-  // Destination Time-To-Live string, depending on it's availability.
-  if (0 <= ttl && ttl <= 255)
-    snprintf(ttl_str, sizeof(ttl_str), "%d", ttl);
+report_path(const flow* fl, const uint8_t chg, const path_change* pc)
+{
+  char hops[32];
+  char lvl[64];
+
+  if (chg & FLOW_HOPS) {
+    st_phops++;
+    snprintf(hops, sizeof(hops), "%u -> %u", pc->pc_hops0, pc->pc_hops1);
+  } else if (pc->pc_hopa)
+    snprintf(hops, sizeof(hops), "%u", pc->pc_hops1);
   else
-    strcpy(ttl_str, "N/A");
-
-  to_nanos(&rtime, *rtv);
-  to_nanos(&mtime, *mtv);
-
-  printf("%" PRIu64 ","   // Key
-         "%" PRIu64 ","   // SeqNum
-         "%" PRIu64 ","   // SeqLen
-         "%s,"            // McastAddr
-         "%" PRIu16 ","   // McastPort
-         "%" PRIu8  ","   // SrcTTL
-         "%s,"            // DstTTL
-         "%.*s,"          // PubIf
-         "%.*s,"          // PubHost
-         "%.*s,"          // SubIf
-         "%.*s,"          // SubHost
-         "%" PRIu64 ","   // RealDep
-         "%" PRIu64 ","   // RealArr
-         "%" PRIu64 ","   // MonoDep
-         "%" PRIu64 "\n", // MonoArr
-    pl->pl_key,
-    pl->pl_snum,
-    pl->pl_slen,
-    inet_ntoa(ep->ep_maddr),
-    pl->pl_mport,
-    pl->pl_ttl,
-    ttl_str,
-    (int)sizeof(pl->pl_iname), pl->pl_iname,
-    (int)sizeof(pl->pl_hname), pl->pl_hname,
-    (int)sizeof(ep->ep_iname), ep->ep_iname,
-    (int)sizeof(hname), hname,
-    pl->pl_rtime, rtime,
-    pl->pl_mtime, mtime);
-}
-
-/// Print the payload content in the raw binary format (big-endian) to the
-/// standard output.
-///
-/// @param[in] pl  payload
-/// @param[in] ep  connection endpoint
-/// @param[in] rtv packet system arrival time
-/// @param[in] mtv packet steady arrival time
-/// @param[in] ttl Time-To-Live value upon arrival
+    snprintf(hops, sizeof(hops), "unknown");
+
+  if (chg & FLOW_LEVEL) {
+    st_plvl++;
+    snprintf(lvl, sizeof(lvl), "%" PRIu64 " ns -> %" PRIu64 " ns",
+             pc->pc_lvl0, pc->pc_lvl1);
+  } else
+    snprintf(lvl, sizeof(lvl), "%" PRIu64 " ns", pc->pc_lvl1);
+
+  notify(NL_WARN, false, "Path change of key %" PRIu64 " from %.*s on %.*s "
+         "to %s on %s: hops %s, latency level %s", fl->fl_key,
+         (int)sizeof(fl->fl_iname), fl->fl_named ? fl->fl_iname : "unknown",
+         (int)sizeof(fl->fl_hname), fl->fl_named ? fl->fl_hname : "unknown",
+         inet_ntoa(fl->fl_ep->ep_maddr), fl->fl_ep->ep_iname, hops, lvl);
+}
+
+/// Detect a change of the path of a flow from the hop count and the latency
+/// of a datagram.
+/// @return FLOW_HOPS and FLOW_LEVEL flags of the detected changes
+///
+/// @param[in] fl   flow
+/// @param[in] pl   payload
+/// @param[in] ro   received record
+/// @param[in] lata availability of the latency
+/// @param[in] lat  one-way latency in nanoseconds
+static uint8_t
+detect_path(flow* fl,
+            const payload* pl,
+            const raw_output* ro,
+            const bool lata,
+            const uint64_t lat)
+{
+  path_change pc;
+  uint8_t chg;
+  int hops;
+
+  // The hop count does not depend on the initial Time-To-Live value of the
+  // publisher.
+  hops = -1;
+  if (ro->ro_ttla && ro->ro_ttl <= pl->pl_ttl)
+    hops = pl->pl_ttl - ro->ro_ttl;
+
+  chg = flow_path(fl, hops, lata, lat, op_pshf, &pc);
+  if (chg != 0)
+    report_path(fl, chg, &pc);
+
+  return chg;
+}
+
+/// Determine whether to print the payload and choose the method based on the
+/// user-selected options.
+///
+/// @param[in] pl    payload
+/// @param[in] pid   publisher ID
+/// @param[in] ttime transmit time of the previous datagram (zero if unknown)
+/// @param[in] ep    endpoint
+/// @param[in] ttl   Time-To-Live value upon arrival
+/// @param[in] len   datagram length including padding
 static void
-print_payload_raw(const payload* pl,
-                  const endpoint* ep,
-                  const struct timespec* rtv,
-                  const struct timespec* mtv,
-                  const int ttl)
+print_payload(payload* pl,
+              const uint64_t pid,
+              const uint64_t ttime,
+              endpoint* ep,
+              const int ttl,
+              const size_t len)
 {
   raw_output ro;
+  flow* fl;
+  uint64_t lat;
+  uint64_t dly;
+  uint64_t clat;
+  uint64_t lost;
+  bool cok;
+  uint8_t anom;
+
+  // Filter out non-matching keys and payloads below the offset threshold, and
+  // apply the sequence number offset.
+  if (!rx_filter(pl))
+    return;
 
+  tstamp_now(&ro.ro_rtime, &ro.ro_mtime);
+  fl = flow_lookup(&flows, ep, pid, pl->pl_key, ro.ro_mtime);
+
+  // Payloads with names refresh the cache of the flow, while compact payloads
+  // take the names from it. Compact payloads that arrive before the first
+  // announcement of their publisher have empty names.
+  if (pl->pl_fver == MBEAT_PAYLOAD_FULL)
+    flow_name(fl, pl->pl_iname, pl->pl_hname);
+  else if (fl->fl_named) {
+    memcpy(pl->pl_iname, fl->fl_iname, sizeof(pl->pl_iname));
+    memcpy(pl->pl_hname, fl->fl_hname, sizeof(pl->pl_hname));
+  } else
+    st_anon++;
+
+  // Assemble the output record.
   memcpy(&ro.ro_pl, pl, sizeof(*pl));
   memcpy(ro.ro_iname, ep->ep_iname, sizeof(ep->ep_iname));
   memcpy(ro.ro_hname, hname, sizeof(hname));
-  ro.ro_rtime = (uint64_t)rtv->tv_nsec
-              + (1000000000ULL * (uint64_t)rtv->tv_sec);
-  ro.ro_mtime = (uint64_t)mtv->tv_nsec
-              + (1000000000ULL * (uint64_t)mtv->tv_sec);
   ro.ro_ttla = (0 <= ttl && ttl <= 255) ? 1 : 0;
   ro.ro_ttl  = (uint8_t)ttl;
   memset(ro.ro_pad, 0, sizeof(ro.ro_pad));
 
-  fwrite(&ro, sizeof(ro), 1, stdout);
+  // The follow-up timestamp removes the delays within the publisher host from
+  // the latency of the previous datagram of the flow.
+  cok = flow_follow_up(fl, pl->pl_snum, ttime, &clat, &dly);
+  if (cok) {
+    hist_add(&st_chist, clat);
+    st_dsum += dly;
+    if (dly > st_dmax)
+      st_dmax = dly;
+  }
+
+  // Account the datagram in the state of its flow. Negative latencies caused
+  // by unsynchronised clocks are clamped to zero.
+  lat = ro.ro_rtime > pl->pl_rtime ? ro.ro_rtime - pl->pl_rtime : 0;
+  lost = fl->fl_tot.fs_lost;
+  anom = flow_update(fl, &st_ivl, &ro, len, lat);
+  hist_add(&st_hist, lat);
+  if (op_roll)
+    rollup_add(&rlp, fl, anom, (int64_t)fl->fl_tot.fs_lost - (int64_t)lost,
+               len, lat);
+
+  // Flows with follow-ups are tracked by their corrected latency, which is
+  // free of the delays within the publisher host.
+  if (op_path)
+    anom |= ttime != 0 ? detect_path(fl, pl, &ro, cok, clat)
+                       : detect_path(fl, pl, &ro, true, lat);
+  ep->ep_dgrams++;
+  ep->ep_bytes += len;
+
+  // Apply the output policy. All counters above include every datagram,
+  // regardless of whether its record is output.
+  if (!rx_policy(fl, anom, lat)) {
+    st_supp++;
+    return;
+  }
+  st_outs++;
+
+  // Perform the user-selected type of output.
+  rx_sink(fl, &ro);
 }
 
-/// Determine whether to print the payload and choose the method based on the
-/// user-selected options.
+/// Cache the names of a publisher in its flow.
 ///
-/// @param[in] pl  payload
-/// @param[in] ep  endpoint
-/// @param[in] ttl Time-To-Live value upon arrival
+/// @param[in] an announcement
+/// @param[in] ep endpoint
 static void
-print_payload(payload* pl, const endpoint* ep, const int ttl)
+learn_names(const announce* an, endpoint* ep)
 {
-  struct timespec rtv;
-  struct timespec mtv;
-
-  // Filter out non-matching keys.
-  if (op_key != 0 && op_key != pl->pl_key)
-    return;
+  flow* fl;
+  uint64_t rt;
+  uint64_t mt;
 
-  // Filter out payloads below the offset threshold.
-  if (op_off > pl->pl_snum)
+  // Flows of filtered keys are never created.
+  if (op_key != 0 && op_key != an->an_key)
     return;
 
-  // Apply the sequence number offset.
-  (*pl).pl_snum -= op_off;
-
-  // Get the system clock value.
-  clock_gettime(CLOCK_REALTIME, &rtv);
-
-  // Get the steady clock value.
-  #ifdef __linux__
-    clock_gettime(CLOCK_MONOTONIC_RAW, &mtv);
-  #else
-    clock_gettime(CLOCK_MONOTONIC, &mtv);
-  #endif
-
-  // Perform the user-selected type of output.
-  if (op_raw)
-    print_payload_raw(pl, ep, &rtv, &mtv, ttl);
-  else
-    print_payload_csv(pl, ep, &rtv, &mtv, ttl);
+  tstamp_now(&rt, &mt);
+  fl = flow_lookup(&flows, ep, an->an_pid, an->an_key, mt);
+  flow_name(fl, an->an_iname, an->an_hname);
+  st_anns++;
 }
 
-/// Convert all integers from the network to host byte order.
+/// Expand the decoded compact payload to a payload, without the names of the
+/// publisher.
 ///
-/// @param[in] pl payload
+/// @param[out] pl payload
+/// @param[in]  cp compact payload
 static void
-convert_payload(payload* pl)
+expand_compact(payload* pl, const compact* cp)
 {
-  pl->pl_magic = ntohl(pl->pl_magic);
-  pl->pl_mport = ntohs(pl->pl_mport);
-  pl->pl_maddr = ntohl(pl->pl_maddr);
-  pl->pl_key   = ntohll(pl->pl_key);
-  pl->pl_snum  = ntohll(pl->pl_snum);
-  pl->pl_slen  = ntohll(pl->pl_slen);
-  pl->pl_rtime = ntohll(pl->pl_rtime);
-  pl->pl_mtime = ntohll(pl->pl_mtime);
+  pl->pl_magic = cp->cp_magic;
+  pl->pl_fver  = cp->cp_fver;
+  pl->pl_ttl   = cp->cp_ttl;
+  pl->pl_mport = cp->cp_mport;
+  pl->pl_maddr = cp->cp_maddr;
+  pl->pl_plen  = cp->cp_plen;
+  pl->pl_key   = cp->cp_key;
+  pl->pl_snum  = cp->cp_snum;
+  pl->pl_slen  = cp->cp_slen;
+  pl->pl_rtime = cp->cp_rtime;
+  pl->pl_mtime = cp->cp_mtime;
+  memset(pl->pl_iname, 0, sizeof(pl->pl_iname));
+  memset(pl->pl_hname, 0, sizeof(pl->pl_hname));
 }
 
 /// Traverse the control messages and obtain the received Time-To-Live value.
@@ -467,37 +1270,312 @@ retrieve_ttl(int* ttl, struct msghdr* msg)
   return false;
 }
 
-/// Verify the payload suitability.
-/// @return decision
+/// Account the datagrams that the kernel dropped on a socket to its endpoint.
+/// The counter of the socket is only reported once it is not zero.
+///
+/// @param[in] ep  endpoint
+/// @param[in] msg last received message
+static void
+account_drops(endpoint* ep, struct msghdr* msg)
+{
+#if defined(MBEAT_HAVE_RXQ_OVFL)
+  struct cmsghdr* cmsg;
+  uint32_t ovfl;
+
+  for (cmsg = CMSG_FIRSTHDR(msg); cmsg != NULL; cmsg = CMSG_NXTHDR(msg, cmsg)) {
+    if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_RXQ_OVFL) {
+      memcpy(&ovfl, CMSG_DATA(cmsg), sizeof(ovfl));
+
+      // The counter wraps around.
+      ep->ep_drops += (uint32_t)(ovfl - ep->ep_ovfl);
+      ep->ep_ovfl = ovfl;
+      return;
+    }
+  }
+#else
+  (void)ep;
+  (void)msg;
+#endif
+}
+
+/// Receive a batch of datagrams from the socket of an endpoint.
+/// @return number of received datagrams, or -1 on error
+///
+/// @param[in]  ep endpoint
+/// @param[out] rb batch
+static int
+receive_batch(endpoint* ep, rx_batch* rb)
+{
+  struct mmsghdr msgs[DECODE_BATCH];
+  struct iovec data[DECODE_BATCH];
+  char cdata[DECODE_BATCH][128];
+  int cnt;
+  int i;
+#if !defined(MBEAT_HAVE_RECVMMSG)
+  ssize_t nbs;
+#endif
+
+  // Only the payload is copied from the socket, while the padding is
+  // truncated.
+  for (i = 0; i < DECODE_BATCH; i++) {
+    data[i].iov_base = &rb->rb_dg[i];
+    data[i].iov_len  = sizeof(rb->rb_dg[i]);
+
+    msgs[i].msg_hdr.msg_name       = NULL;
+    msgs[i].msg_hdr.msg_namelen    = 0;
+    msgs[i].msg_hdr.msg_iov        = &data[i];
+    msgs[i].msg_hdr.msg_iovlen     = 1;
+    msgs[i].msg_hdr.msg_control    = cdata[i];
+    msgs[i].msg_hdr.msg_controllen = sizeof(cdata[i]);
+    msgs[i].msg_hdr.msg_flags      = 0;
+  }
+
+#if defined(MBEAT_HAVE_RECVMMSG)
+  cnt = recvmmsg(ep->ep_sock, msgs, DECODE_BATCH, MSG_TRUNC | MSG_DONTWAIT,
+                 NULL);
+  if (cnt == -1)
+    return -1;
+#else
+  // Emulate the batch with a system call per datagram. An error is reported
+  // only if no datagram was received before it.
+  for (cnt = 0; cnt < DECODE_BATCH; cnt++) {
+    nbs = recvmsg(ep->ep_sock, &msgs[cnt].msg_hdr, MSG_TRUNC | MSG_DONTWAIT);
+    if (nbs == -1)
+      break;
+
+    msgs[cnt].msg_len = (unsigned int)nbs;
+  }
+
+  if (cnt == 0)
+    return -1;
+#endif
+
+  for (i = 0; i < cnt; i++) {
+    rb->rb_nbs[i] = msgs[i].msg_len;
+    rb->rb_flg[i] = msgs[i].msg_hdr.msg_flags;
+    retrieve_ttl(&rb->rb_ttl[i], &msgs[i].msg_hdr);
+  }
+
+  if (op_roll)
+    account_drops(ep, &msgs[cnt - 1].msg_hdr);
+
+  rb->rb_cnt = (size_t)cnt;
+  return cnt;
+}
+
+/// Account a batch to the NUMA node of the CPU that delivered it, as far as
+/// the kernel reports the CPU that last processed the traffic of the socket.
+///
+/// @param[in] ep  endpoint
+/// @param[in] cnt number of datagrams
+static void
+account_delivery(endpoint* ep, const uint64_t cnt)
+{
+#if defined(MBEAT_HAVE_NUMA) && defined(SO_INCOMING_CPU)
+  socklen_t len;
+  int dnode;
+  int rnode;
+
+  len = sizeof(ep->ep_cpu);
+  if (getsockopt(ep->ep_sock, SOL_SOCKET, SO_INCOMING_CPU,
+                 &ep->ep_cpu, &len) == -1)
+    return;
+
+  dnode = numa_cpu_node(ep->ep_cpu);
+  if (dnode == -1)
+    return;
+  st_dnode[dnode] += cnt;
+
+  rnode = numa_cpu_node(numa_current_cpu());
+  if (rnode != -1 && rnode != dnode) {
+    st_xnode     += cnt;
+    ep->ep_xnode += cnt;
+  }
+#else
+  (void)ep;
+  (void)cnt;
+#endif
+}
+
+/// Record the time from the change of the interface of an endpoint to its
+/// first datagram after its group was joined again.
+///
+/// @param[in] ep endpoint
+static void
+record_recovery(endpoint* ep)
+{
+  uint64_t dur;
+
+  dur = steady_time() - ep->ep_flap;
+  st_rcnt++;
+  st_rsum += dur;
+  if (dur > st_rmax)
+    st_rmax = dur;
+
+  notify(NL_DEBUG, false, "Multicast group %s on interface %s recovered "
+         "%" PRIu64 " ns after the interface changed", inet_ntoa(ep->ep_maddr),
+         ep->ep_iname, dur);
+
+  ep->ep_flap = 0;
+  ep->ep_rjn  = 0;
+}
+
+/// Record a change of a network interface reported by the link monitor. The
+/// endpoints of the interface are checked once all pending changes are
+/// received, as a single change usually comes with several messages.
+///
+/// @param[in] iname interface name, or NULL for all interfaces
+/// @param[in] kind  kind of change
+static void
+note_link_change(const char* iname, const uint8_t kind)
+{
+  endpoint* ep;
+  uint64_t now;
+  uint64_t cnt;
+  uint64_t lost;
+
+  now = steady_time();
+  cnt = 0;
+  lost = 0;
+  for (ep = eps; ep != NULL; ep = ep->ep_next) {
+    if (iname != NULL && strcmp(ep->ep_iname, iname) != 0)
+      continue;
+    cnt++;
+
+    // The membership is lost or unusable until the interface recovers.
+    if (kind == LINK_DOWN) {
+      if (ep->ep_flap == 0) {
+        ep->ep_flap = now;
+        lost++;
+      }
+      ep->ep_rjn = 0;
+      ep->ep_chk = 0;
+      continue;
+    }
+
+    // Links that come up without going down first only changed settings
+    // unrelated to the endpoints, such as the promiscuous mode.
+    if (kind != LINK_UP || ep->ep_flap != 0)
+      ep->ep_chk = 1;
+  }
+
+  // A link usually goes down in several steps, which are warned about once.
+  if (cnt > 0 && iname != NULL)
+    notify(lost > 0 ? NL_WARN : NL_DEBUG, false, "Interface %s %s, affecting "
+           "%" PRIu64 " endpoints", iname, link_kind(kind), cnt);
+}
+
+/// Join the multicast group of a socket again through the current address of
+/// its interface. The membership may have survived the change of the
+/// interface, in which case the kernel reports it as present.
+/// @return status code
 ///
-/// @param[in] pl  payload
-/// @param[in] nbs number of received bytes
+/// @param[in] ep  endpoint
+/// @param[in] old previous address of the interface
 static bool
-verify_payload(const payload* pl, const ssize_t nbs)
+rejoin_group(endpoint* ep, const struct in_addr old)
 {
-  // Verify the size of the received payload.
-  if ((size_t)nbs != sizeof(*pl)) {
-    notify(NL_WARN, false, "Wrong payload size, expected: %zu, got: %zd",
-           sizeof(pl), nbs);
+  struct ip_mreq req;
+
+  // The membership through the previous address may be gone already.
+  req.imr_multiaddr.s_addr = ep->ep_maddr.s_addr;
+  req.imr_interface.s_addr = old.s_addr;
+  (void)setsockopt(ep->ep_sock, IPPROTO_IP, IP_DROP_MEMBERSHIP,
+                   &req, sizeof(req));
+
+  req.imr_interface.s_addr = ep->ep_iaddr.s_addr;
+  if (setsockopt(ep->ep_sock, IPPROTO_IP, IP_ADD_MEMBERSHIP,
+                 &req, sizeof(req)) == -1 && errno != EADDRINUSE) {
+    notify(NL_WARN, true, "Unable to join multicast group %s again on "
+           "interface %s", inet_ntoa(ep->ep_maddr), ep->ep_iname);
     return false;
   }
 
-  // Verify the magic number of the payload.
-  if (pl->pl_magic != MBEAT_PAYLOAD_MAGIC) {
-    notify(NL_WARN, false,
-           "Payload magic number invalid, expected: %u, got: %u",
-           MBEAT_PAYLOAD_MAGIC, pl->pl_magic);
-    return false;
+  return true;
+}
+
+/// Resolve the interfaces of the changed endpoints again and join their
+/// groups again once the interfaces are usable.
+static void
+check_links(void)
+{
+  struct ifaddrs* ifaces;
+  struct in_addr addr;
+  struct in_addr old;
+  endpoint* ep;
+  endpoint* prev;
+  uint64_t now;
+  uint64_t cnt;
+  bool ok;
+
+  for (ep = eps; ep != NULL; ep = ep->ep_next)
+    if (ep->ep_chk)
+      break;
+
+  if (ep == NULL)
+    return;
+
+  // The endpoints stay marked and are checked again upon the next change.
+  if (getifaddrs(&ifaces) == -1) {
+    notify(NL_WARN, true, "Unable to populate the list of network interfaces");
+    return;
   }
 
-  // Ensure that the format version is up-to-date.
-  if (pl->pl_fver != MBEAT_PAYLOAD_VERSION) {
-    notify(NL_WARN, false,
-           "Unsupported payload version, expected: %u, got: %u",
-           MBEAT_PAYLOAD_VERSION, pl->pl_fver);
-    return false;
+  now = steady_time();
+  cnt = 0;
+  prev = NULL;
+  ok = false;
+  addr.s_addr = 0;
+  for (ep = eps; ep != NULL; ep = ep->ep_next) {
+    if (!ep->ep_chk)
+      continue;
+    ep->ep_chk = 0;
+
+    // Endpoints of the same interface are usually adjacent, which saves the
+    // lookup and repeated warnings.
+    if (prev == NULL || strcmp(prev->ep_iname, ep->ep_iname) != 0)
+      ok = parse_refresh(&addr, ep, ifaces);
+    prev = ep;
+
+    // The interface is not usable yet, and its next change is awaited.
+    if (!ok) {
+      if (ep->ep_flap == 0)
+        ep->ep_flap = now;
+      ep->ep_rjn = 0;
+      continue;
+    }
+
+    // Changes that keep the address of a working interface need no action.
+    if (ep->ep_flap == 0 && addr.s_addr == ep->ep_iaddr.s_addr)
+      continue;
+    if (ep->ep_flap == 0)
+      ep->ep_flap = now;
+
+    old = ep->ep_iaddr;
+    ep->ep_iaddr = addr;
+    if (!rejoin_group(ep, old))
+      continue;
+
+    ep->ep_rjn = 1;
+    cnt++;
   }
 
+  freeifaddrs(ifaces);
+
+  if (cnt > 0)
+    notify(NL_INFO, false, "Joined %" PRIu64 " multicast groups again", cnt);
+}
+
+/// Receive the changes of the network interfaces and recover the affected
+/// endpoints.
+/// @return status code
+static bool
+handle_links(void)
+{
+  if (!link_receive(link_ep.ep_sock, note_link_change) && op_err)
+    return false;
+
+  check_links();
   return true;
 }
 
@@ -508,35 +1586,22 @@ verify_payload(const payload* pl, const ssize_t nbs)
 bool
 handle_event(endpoint* ep)
 {
+  rx_batch rb;
+  datagram* dg;
   payload pl;
-  int ttl;
-  ssize_t nbs;
-  struct sockaddr_in addr;
-  struct msghdr msg;
-  struct iovec data;
-  char cdata[128];
+  uint64_t pid;
+  uint64_t ttime;
+  size_t i;
+  int cnt;
 
-  // Prepare the address for the ingress loop.
-  addr.sin_port   = htons((uint16_t)op_port);
-  addr.sin_family = AF_INET;
+  // Changes of the network interfaces.
+  if (ep == &link_ep)
+    return handle_links();
 
   // Loop through all available datagrams on the socket.
   while (1) {
-    // Prepare payload data.
-    data.iov_base = &pl;
-    data.iov_len  = sizeof(pl);
-
-    // Prepare the message.
-    msg.msg_name       = &addr;
-    msg.msg_namelen    = sizeof(addr);
-    msg.msg_iov        = &data;
-    msg.msg_iovlen     = 1;
-    msg.msg_control    = cdata;
-    msg.msg_controllen = sizeof(cdata);
-
-    // Read an incoming datagram.
-    nbs = recvmsg(ep->ep_sock, &msg, MSG_TRUNC | MSG_DONTWAIT);
-    if (nbs == -1) {
+    cnt = receive_batch(ep, &rb);
+    if (cnt == -1) {
       // Exit the reading loop if there are no more datagrams to process.
       if (errno == EAGAIN)
         break;
@@ -548,14 +1613,46 @@ handle_event(endpoint* ep)
 
       if (op_err)
         return false;
+
+      // Leave the remaining datagrams for the next event.
+      break;
     }
 
-    convert_payload(&pl);
-    if (verify_payload(&pl, nbs) == false)
-      continue;
+    if (op_numa)
+      account_delivery(ep, (uint64_t)cnt);
+
+    // First datagram since the group was joined again.
+    if (ep->ep_rjn)
+      record_recovery(ep);
+
+    // Drop the invalid datagrams and convert the rest to host byte order.
+    decode_batch(&rb);
+
+    for (i = 0; i < rb.rb_cnt; i++) {
+      dg = &rb.rb_dg[i];
+
+      // Payloads with names identify the publisher by the same ID that
+      // compact payloads carry.
+      if (dg->dg_pl.pl_fver == MBEAT_PAYLOAD_FULL) {
+        memcpy(&pl, &dg->dg_pl, sizeof(pl));
+        pid = publisher_id(pl.pl_key, pl.pl_iname, pl.pl_hname);
+        ttime = 0;
+      } else if (dg->dg_cp.cp_type == MBEAT_TYPE_ANNOUNCE) {
+        learn_names(&dg->dg_an, ep);
+        continue;
+      } else {
+        expand_compact(&pl, &dg->dg_cp);
+        pid = dg->dg_cp.cp_pid;
+        ttime = dg->dg_cp.cp_ttime;
+      }
+
+      print_payload(&pl, pid, ttime, ep, rb.rb_ttl[i], rb.rb_len[i]);
+    }
 
-    retrieve_ttl(&ttl, &msg);
-    print_payload(&pl, ep, ttl);
+    // A partial batch drained the socket, which saves the system call that
+    // would only report that no datagrams are left.
+    if (cnt < DECODE_BATCH)
+      break;
   }
 
   return true;
@@ -587,6 +1684,534 @@ create_signal_mask(sigset_t* mask)
     return false;
   }
 
+  // Add the SIGTERM signal to the set, to allow for a graceful termination of
+  // the process running in the background.
+  if (sigaddset(mask, SIGTERM) != 0) {
+    notify(NL_ERROR, true, "Unable to add %s to the signal set", "SIGTERM");
+    return false;
+  }
+
+  return true;
+}
+
+/// Report the memory usage of all state structures.
+static void
+report_memory(void)
+{
+  size_t epm;
+  endpoint* ep;
+
+  epm = 0;
+  for (ep = eps; ep != NULL; ep = ep->ep_next)
+    epm += sizeof(*ep);
+
+  // The histogram of each flow is part of the flow, only the histograms of
+  // the interval are counted separately.
+  notify(NL_INFO, false, "Memory: flows %zu/%zu bytes (%" PRIu64 "/%" PRIu64
+         " flows), histograms %zu bytes, ring %zu bytes, endpoints %zu bytes, "
+         "rollups %zu bytes",
+         flow_table_memory(&flows, true), flow_table_memory(&flows, false),
+         flows.ft_used, flows.ft_cap, sizeof(st_hist) + sizeof(st_chist),
+         rng.rg_len, epm, rollup_memory(&rlp));
+}
+
+/// Report the CPU and the NIC queue that delivered the traffic of an endpoint.
+///
+/// @param[in] ep endpoint
+static void
+report_delivery(endpoint* ep)
+{
+#if defined(SO_INCOMING_NAPI_ID)
+  socklen_t len;
+
+  len = sizeof(ep->ep_napi);
+  if (getsockopt(ep->ep_sock, SOL_SOCKET, SO_INCOMING_NAPI_ID,
+                 &ep->ep_napi, &len) == -1)
+    ep->ep_napi = 0;
+#endif
+
+  // Unknown nodes and CPUs are reported as -1.
+  if (ep->ep_cpu == -1)
+    notify(NL_INFO, false, "Delivery of %s on %s: interface node %d, "
+           "delivering CPU not reported", inet_ntoa(ep->ep_maddr),
+           ep->ep_iname, ep->ep_node);
+  else
+    notify(NL_INFO, false, "Delivery of %s on %s: interface node %d, CPU %d "
+           "on node %d, NAPI ID %u, %" PRIu64 " datagrams from another node",
+           inet_ntoa(ep->ep_maddr), ep->ep_iname, ep->ep_node, ep->ep_cpu,
+           numa_cpu_node(ep->ep_cpu), ep->ep_napi, ep->ep_xnode);
+}
+
+/// Keep the rollup aggregate of a flow that is removed from the flow table.
+///
+/// @param[in] fl flow
+static void
+park_rollup(const flow* fl)
+{
+  uint64_t rt;
+  uint64_t mt;
+
+  tstamp_now(&rt, &mt);
+  rollup_remove(&rlp, fl, rt);
+}
+
+/// Close the rollup interval of the flows. The rows of the previous interval
+/// that were not written yet are written first, as the kernel drops of the
+/// endpoints move on with the interval.
+static void
+close_rollup(void)
+{
+  endpoint* ep;
+  uint64_t rt;
+  uint64_t mt;
+
+  rollup_write(&rlp, UINT64_MAX);
+  for (ep = eps; ep != NULL; ep = ep->ep_next) {
+    ep->ep_rdrop = ep->ep_drops;
+    ep->ep_drops = 0;
+  }
+
+  tstamp_now(&rt, &mt);
+  rollup_close(&rlp, rt);
+}
+
+/// Report the counters of the current interval and start a new one. All
+/// interval state is reset, so that the memory usage does not depend on the
+/// uptime of the process.
+///
+/// @param[in] now current steady time
+static void
+rollover_stats(const uint64_t now)
+{
+  flow* fl;
+  endpoint* ep;
+  double dur;
+  uint64_t wait;
+
+  if (op_roll)
+    close_rollup();
+
+  // Avoid division by zero for intervals shorter than the clock resolution.
+  dur = (double)(now - st_start) / 1e9;
+  if (dur <= 0.0)
+    dur = 1e-9;
+
+  notify(NL_INFO, false, "Interval of %.3fs: %" PRIu64 " datagrams, %" PRIu64
+         " bytes (%.3f MB/s), %" PRIu64 " lost, %" PRIu64 " duplicated, %"
+         PRIu64 " reordered",
+         dur, st_ivl.fs_recv, st_ivl.fs_bytes,
+         ((double)st_ivl.fs_bytes / 1e6) / dur,
+         st_ivl.fs_lost, st_ivl.fs_dups, st_ivl.fs_reord);
+
+  // Report the goodput of each multicast group that received traffic.
+  wait = 0;
+  for (ep = eps; ep != NULL; ep = ep->ep_next) {
+    if (ep->ep_flap != 0)
+      wait++;
+
+    if (ep->ep_dgrams > 0)
+      notify(NL_INFO, false, "Goodput of %s on %s: %" PRIu64 " datagrams, %"
+             PRIu64 " bytes (%.3f MB/s)", inet_ntoa(ep->ep_maddr),
+             ep->ep_iname, ep->ep_dgrams, ep->ep_bytes,
+             ((double)ep->ep_bytes / 1e6) / dur);
+
+    if (op_numa && ep->ep_dgrams > 0)
+      report_delivery(ep);
+
+    ep->ep_dgrams = 0;
+    ep->ep_bytes  = 0;
+    ep->ep_xnode  = 0;
+  }
+  notify(NL_INFO, false, "Latency: p50 %" PRIu64 " ns, p99 %" PRIu64
+         " ns, max %" PRIu64 " ns",
+         hist_percentile(&st_hist, 50.0), hist_percentile(&st_hist, 99.0),
+         st_hist.hg_max);
+  if (st_chist.hg_sum > 0)
+    notify(NL_INFO, false, "Corrected latency of %" PRIu64 " datagrams: p50 %"
+           PRIu64 " ns, p99 %" PRIu64 " ns, max %" PRIu64 " ns, publisher "
+           "delay mean %" PRIu64 " ns, max %" PRIu64 " ns", st_chist.hg_sum,
+           hist_percentile(&st_chist, 50.0), hist_percentile(&st_chist, 99.0),
+           st_chist.hg_max, st_dsum / st_chist.hg_sum, st_dmax);
+  notify(NL_INFO, false, "Flows: %" PRIu64 " active, %" PRIu64 " created, %"
+         PRIu64 " evicted as idle, %" PRIu64 " evicted as oldest",
+         flows.ft_used, flows.ft_new, flows.ft_evict, flows.ft_force);
+  notify(NL_INFO, false, "Publishers: %" PRIu64 " announcements, %" PRIu64
+         " datagrams of unannounced publishers", st_anns, st_anon);
+  if (op_smp > 0 || op_anom)
+    notify(NL_INFO, false, "Output: %" PRIu64 " records, %" PRIu64
+           " suppressed by the output policy", st_outs, st_supp);
+  if (op_numa)
+    notify(NL_INFO, false, "NUMA: %" PRIu64 " datagrams delivered on another "
+           "node than the receiving one", st_xnode);
+  if (st_rcnt > 0 || wait > 0)
+    notify(NL_INFO, false, "Recovery: %" PRIu64 " endpoints received again "
+           "after interface changes, mean %" PRIu64 " ns, max %" PRIu64 " ns, %"
+           PRIu64 " endpoints awaiting recovery", st_rcnt,
+           st_rcnt > 0 ? st_rsum / st_rcnt : 0, st_rmax, wait);
+  if (op_path)
+    notify(NL_INFO, false, "Paths: %" PRIu64 " hop count changes, %" PRIu64
+           " latency level shifts", st_phops, st_plvl);
+  notify(NL_INFO, false, "Events: %" PRIu64 " wakeups of the %s event queue, "
+         "%.1f datagrams per wakeup", st_wake, op_evq->eq_name,
+         st_wake > 0 ? (double)st_ivl.fs_recv / (double)st_wake : 0.0);
+  report_memory();
+
+  // Accumulate the interval counters.
+  st_tot.fs_recv  += st_ivl.fs_recv;
+  st_tot.fs_bytes += st_ivl.fs_bytes;
+  st_tot.fs_lost  += st_ivl.fs_lost;
+  st_tot.fs_dups  += st_ivl.fs_dups;
+  st_tot.fs_reord += st_ivl.fs_reord;
+
+  // Start a new interval and let older latencies of each flow fade out.
+  memset(&st_ivl, 0, sizeof(st_ivl));
+  memset(&st_hist, 0, sizeof(st_hist));
+  memset(&st_chist, 0, sizeof(st_chist));
+  st_dsum = 0;
+  st_dmax = 0;
+  for (fl = flows.ft_oldest; fl != NULL; fl = fl->fl_next_idle)
+    hist_decay(&fl->fl_hist);
+
+  st_anns  = 0;
+  st_anon  = 0;
+  st_outs  = 0;
+  st_supp  = 0;
+  st_xnode = 0;
+  st_twake += st_wake;
+  st_wake  = 0;
+  st_trcnt += st_rcnt;
+  st_trsum += st_rsum;
+  if (st_rmax > st_trmax)
+    st_trmax = st_rmax;
+  st_rcnt  = 0;
+  st_rsum  = 0;
+  st_rmax  = 0;
+  st_phops = 0;
+  st_plvl  = 0;
+  st_start = now;
+}
+
+/// Report the processor time spent by the process per received datagram, so
+/// that the event queues can be compared on the same traffic.
+static void
+report_cpu(void)
+{
+  struct rusage ru;
+  uint64_t usr;
+  uint64_t sys;
+
+  if (getrusage(RUSAGE_SELF, &ru) == -1) {
+    notify(NL_WARN, true, "Unable to obtain the processor time");
+    return;
+  }
+
+  usr = (uint64_t)ru.ru_utime.tv_sec * 1000000000
+      + (uint64_t)ru.ru_utime.tv_usec * 1000;
+  sys = (uint64_t)ru.ru_stime.tv_sec * 1000000000
+      + (uint64_t)ru.ru_stime.tv_usec * 1000;
+
+  notify(NL_INFO, false, "Processor: %" PRIu64 " ns user, %" PRIu64 " ns "
+         "system, %" PRIu64 " ns per datagram, %" PRIu64 " wakeups of the %s "
+         "event queue", usr, sys,
+         st_tot.fs_recv > 0 ? (usr + sys) / st_tot.fs_recv : 0,
+         st_twake, op_evq->eq_name);
+}
+
+/// Report the counters accumulated over the whole run of the process.
+static void
+report_totals(void)
+{
+  rollover_stats(steady_time());
+  if (op_roll) {
+    rollup_write(&rlp, UINT64_MAX);
+    notify(NL_INFO, false, "Rollup: %" PRIu64 " rows", rlp.ru_rows);
+    if (rlp.ru_early > 0)
+      notify(NL_WARN, false, "Rollup: %" PRIu64 " rows of removed flows were "
+             "written before the end of their interval, as more flows than "
+             "--flow-limit were parked at once", rlp.ru_early);
+  }
+
+  notify(NL_INFO, false, "Total: %" PRIu64 " datagrams, %" PRIu64
+         " bytes, %" PRIu64 " lost, %" PRIu64 " duplicated, %" PRIu64
+         " reordered",
+         st_tot.fs_recv, st_tot.fs_bytes,
+         st_tot.fs_lost, st_tot.fs_dups, st_tot.fs_reord);
+  if (st_trcnt > 0)
+    notify(NL_INFO, false, "Total recovery: %" PRIu64 " endpoints, mean %"
+           PRIu64 " ns, max %" PRIu64 " ns", st_trcnt, st_trsum / st_trcnt,
+           st_trmax);
+  report_cpu();
+  tstamp_report();
+}
+
+/// Place the process on the NUMA node of the network devices of most
+/// endpoints before the state structures are allocated, so that the memory
+/// they touch first is local to the node. Pinning to a CPU takes precedence.
+static void
+place_process(void)
+{
+  uint64_t cnt[NUMA_NODE_MAX];
+  uint64_t known;
+  endpoint* ep;
+  endpoint* prev;
+  int best;
+  int i;
+
+  if (op_pin)
+    (void)tune_pin(op_cpu);
+
+  if (!op_numa)
+    return;
+
+  numa_init();
+  memset(cnt, 0, sizeof(cnt));
+  known = 0;
+
+  // Endpoints of the same interface are usually adjacent, which saves the
+  // lookup of the node.
+  prev = NULL;
+  for (ep = eps; ep != NULL; ep = ep->ep_next) {
+    if (prev != NULL && strcmp(prev->ep_iname, ep->ep_iname) == 0)
+      ep->ep_node = prev->ep_node;
+    else
+      ep->ep_node = numa_iface_node(ep->ep_iname);
+    ep->ep_cpu = -1;
+    prev = ep;
+
+    if (ep->ep_node != -1) {
+      cnt[ep->ep_node]++;
+      known++;
+    }
+  }
+
+  best = -1;
+  for (i = 0; i < NUMA_NODE_MAX; i++)
+    if (cnt[i] > 0 && (best == -1 || cnt[i] > cnt[best]))
+      best = i;
+
+  if (best == -1) {
+    notify(NL_INFO, false, "NUMA nodes of the interfaces are unknown, the "
+           "process follows the delivering CPUs");
+    return;
+  }
+
+  if (known > cnt[best])
+    notify(NL_WARN, false, "%" PRIu64 " endpoints are attached to other NUMA "
+           "nodes than node %d", known - cnt[best], best);
+
+  st_placed = true;
+  if (op_pin)
+    notify(NL_INFO, false, "Pinning to CPU %" PRIu64 " takes precedence over "
+           "NUMA node %d", op_cpu, best);
+  else
+    (void)numa_place(best);
+}
+
+/// Place the process on the NUMA node that delivered most datagrams so far,
+/// when the nodes of the interfaces are unknown. The placement happens only
+/// once, so that the process does not migrate back and forth.
+static void
+follow_delivery(void)
+{
+  int best;
+  int i;
+
+  if (st_placed || op_pin)
+    return;
+
+  best = -1;
+  for (i = 0; i < NUMA_NODE_MAX; i++)
+    if (st_dnode[i] > 0 && (best == -1 || st_dnode[i] > st_dnode[best]))
+      best = i;
+
+  // Wait for the first traffic.
+  if (best == -1)
+    return;
+
+  st_placed = true;
+  notify(NL_DEBUG, false, "Most datagrams were delivered on NUMA node %d",
+         best);
+  (void)numa_place(best);
+}
+
+/// Find the expiration of the nearest timer.
+/// @return steady time, or UINT64_MAX if no timer is armed
+///
+/// @param[in] now current steady time
+static uint64_t
+next_timer(const uint64_t now)
+{
+  uint64_t next;
+
+  next = UINT64_MAX;
+  if (op_fidl > 0 || op_numa)
+    next = tm_house;
+  if (op_sint > 0 && tm_stats < next)
+    next = tm_stats;
+
+  // Rows of the closed rollup interval remain to be written.
+  if (op_roll && rollup_pending(&rlp))
+    next = now;
+
+  return next;
+}
+
+/// Compute the time remaining until the expiration of the nearest timer.
+/// @return true if a timer is armed, false otherwise
+///
+/// @param[out] ts remaining time
+bool
+timer_timeout(struct timespec* ts)
+{
+  uint64_t next;
+  uint64_t now;
+
+  now = steady_time();
+  next = next_timer(now);
+  if (next == UINT64_MAX)
+    return false;
+
+  from_nanos(ts, next > now ? next - now : 0);
+  return true;
+}
+
+/// Decide whether the next wait of the event queue falls into the coalescing
+/// delay, which lasts until a full coalescing interval has passed since the
+/// previous wait for the datagrams. Datagrams meanwhile accumulate in the
+/// socket buffers, so that the next wait reports all busy sockets at once and
+/// each of them is drained in full batches. During the delay, the event queue
+/// waits only for the signals, the link monitor and the timers.
+/// @return true if the wait is a coalescing delay, false otherwise
+///
+/// @param[out] ts remaining time of the delay, bounded by the nearest timer
+bool
+coalesce_timeout(struct timespec* ts)
+{
+  uint64_t next;
+  uint64_t now;
+
+  if (op_coal == 0)
+    return false;
+
+  now = steady_time();
+  if (now >= tm_wake + op_coal) {
+    tm_wake = now;
+    return false;
+  }
+
+  next = next_timer(now);
+  if (next > tm_wake + op_coal)
+    next = tm_wake + op_coal;
+
+  from_nanos(ts, next > now ? next - now : 0);
+  return true;
+}
+
+/// Run all expired timers. Every event queue calls this function once after
+/// each wait, which makes it the place to count the wakeups.
+void
+handle_timers(void)
+{
+  uint64_t now;
+
+  st_wake++;
+  now = steady_time();
+
+  // Evict flows that became idle and follow the traffic to its node.
+  if ((op_fidl > 0 || op_numa) && now >= tm_house) {
+    if (op_fidl > 0)
+      flow_evict(&flows, now);
+    if (op_numa)
+      follow_delivery();
+    tm_house = now + HOUSEKEEPING_PERIOD;
+  }
+
+  // Report the statistics of the finished interval.
+  if (op_sint > 0 && now >= tm_stats) {
+    rollover_stats(now);
+    tm_stats += op_sint;
+    if (tm_stats <= now)
+      tm_stats = now + op_sint;
+  }
+
+  // Write the rollup rows of the closed interval a slice at a time, so that
+  // the sockets are drained in between.
+  if (op_roll && rollup_pending(&rlp))
+    rollup_write(&rlp, ROLLUP_SLICE);
+}
+
+/// Allocate the flow table and arm the timers.
+/// @return status code
+static bool
+create_state(void)
+{
+  uint64_t now;
+  uint64_t rt;
+  uint64_t mt;
+
+  if (!flow_table_init(&flows, op_flim, op_fidl, op_huge == 1))
+    return false;
+
+  // The rollup rows are stamped with the system time of their interval.
+  tstamp_now(&rt, &mt);
+  if (op_roll && !rollup_init(&rlp, &flows,
+                              op_raw ? print_rollup_raw : print_rollup_csv,
+                              op_rbkt == 1, rt))
+    return false;
+
+  // Flows removed from the flow table keep their rows of the interval.
+  if (op_roll)
+    flows.ft_gone = park_rollup;
+
+  now = steady_time();
+  st_start = now;
+  tm_house = now + HOUSEKEEPING_PERIOD;
+  tm_stats = now + op_sint;
+
+  // The first wait is for the datagrams.
+  tm_wake = 0;
+
+  if (op_coal > 0)
+    notify(NL_DEBUG, false, "Coalescing the wakeups of the event queue to one "
+           "per %" PRIu64 " ns", op_coal);
+
+  return true;
+}
+
+/// Detach the process from the terminal based on user settings.
+/// @return status code
+static bool
+detach_process(void)
+{
+  int logfd;
+
+  if (op_dmn && !daemonize(op_logf))
+    return false;
+
+  // Without detaching, the log file still replaces the standard error stream.
+  // The file is opened first, so that an error can still be reported.
+  if (!op_dmn && op_logf != NULL) {
+    logfd = open(op_logf, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (logfd == -1) {
+      notify(NL_ERROR, true, "Unable to open the log file %s", op_logf);
+      return false;
+    }
+
+    fflush(stderr);
+    if (dup2(logfd, STDERR_FILENO) == -1) {
+      notify(NL_ERROR, true, "Unable to redirect the standard error stream "
+             "to %s", op_logf);
+      close(logfd);
+      return false;
+    }
+
+    close(logfd);
+    ncol = 0;
+  }
+
+  if (op_pidf != NULL && !create_pidfile(op_pidf))
+    return false;
+
   return true;
 }
 
@@ -594,14 +2219,141 @@ create_signal_mask(sigset_t* mask)
 static void
 print_header(void)
 {
-  // No header is printed for the raw binary output.
+  uint64_t i;
+
+  // No header is printed for the raw binary output and the ring.
   if (op_raw)
     return;
 
-  printf("Key,SeqNum,SeqLen,"
-         "McastAddr,McastPort,SrcTTL,DstTTL,"
-         "PubIf,PubHost,SubIf,SubHost,"
-         "RealDep,RealArr,MonoDep,MonoArr\n");
+  // The rollup rows take the place of the records on the standard output.
+  if (op_roll) {
+    print_rollup_header(op_rbkt ? ROLLUP_BUCKETS : 0);
+    return;
+  }
+
+  if (op_ring != NULL)
+    return;
+
+  if (op_oshd > 0) {
+    for (i = 0; i < op_oshd; i++)
+      print_csv_header(out_files[i]);
+    return;
+  }
+
+  print_csv_header(stdout);
+}
+
+/// Specialise the receive path for the user-selected options.
+static void
+specialise_receive(void)
+{
+  static const payload_filter filters[4] = {
+    filter_none, filter_key, filter_offset, filter_key_offset
+  };
+
+  rx_filter = filters[(op_key != 0 ? 1 : 0) | (op_off != 0 ? 2 : 0)];
+  rx_policy = (op_smp > 0 || op_anom) ? select_record : select_all;
+
+  rx_format = op_raw ? print_record_raw : print_record_csv;
+  if (op_ring != NULL)
+    rx_sink = write_ring;
+  else if (op_roll)
+    rx_policy = select_none;
+  else if (op_oshd > 0)
+    rx_sink = write_shard;
+  else
+    rx_sink = write_stream;
+}
+
+/// Create the shared memory ring based on user settings.
+/// @return status code
+static bool
+create_ring(void)
+{
+  if (op_ring == NULL)
+    return true;
+
+  notify(NL_INFO, false, "Publishing records to ring %s", op_ring);
+  return ring_create(&rng, op_ring, op_rcnt);
+}
+
+/// Open the output shards, each with its own stream and buffer, and assign the
+/// endpoints to them in turns.
+/// @return status code
+static bool
+create_output_shards(void)
+{
+  char path[PATH_MAX];
+  endpoint* ep;
+  uint64_t i;
+
+  if (op_oshd == 0)
+    return true;
+
+  for (i = 0; i < op_oshd; i++) {
+    snprintf(path, sizeof(path), "%s.%" PRIu64, op_opfx, i);
+    out_files[i] = fopen(path, "w");
+    if (out_files[i] == NULL) {
+      notify(NL_ERROR, true, "Unable to open the output shard %s", path);
+      return false;
+    }
+
+    // Unbuffered output applies to the shards as well.
+    if (op_unb) {
+      if (setvbuf(out_files[i], NULL, _IONBF, 0) != 0)
+        notify(NL_WARN, true, "Unable to disable the buffering of %s", path);
+      continue;
+    }
+
+    out_bufs[i] = malloc(OUTPUT_BUFFER);
+    if (out_bufs[i] == NULL
+     || setvbuf(out_files[i], out_bufs[i], _IOFBF, OUTPUT_BUFFER) != 0)
+      notify(NL_WARN, false, "Unable to set the buffer of %s", path);
+  }
+
+  i = 0;
+  for (ep = eps; ep != NULL; ep = ep->ep_next)
+    ep->ep_oshd = (uint32_t)(i++ % op_oshd);
+
+  notify(NL_INFO, false, "Writing records to %" PRIu64 " output shards %s.0 "
+         "to %s.%" PRIu64, op_oshd, op_opfx, op_opfx, op_oshd - 1);
+  return true;
+}
+
+/// Close the output shards and report the share of the records of each.
+static void
+close_output_shards(void)
+{
+  uint64_t i;
+  uint64_t min;
+  uint64_t max;
+
+  if (op_oshd == 0)
+    return;
+
+  min = UINT64_MAX;
+  max = 0;
+  for (i = 0; i < op_oshd; i++) {
+    if (out_files[i] == NULL)
+      continue;
+
+    notify(NL_DEBUG, false, "Output shard %s.%" PRIu64 ": %" PRIu64
+           " records", op_opfx, i, out_recs[i]);
+    if (out_recs[i] < min)
+      min = out_recs[i];
+    if (out_recs[i] > max)
+      max = out_recs[i];
+
+    if (fclose(out_files[i]) != 0)
+      notify(NL_WARN, true, "Unable to write the output shard %s.%" PRIu64,
+             op_opfx, i);
+    out_files[i] = NULL;
+    free(out_bufs[i]);
+    out_bufs[i] = NULL;
+  }
+
+  notify(NL_INFO, false, "Output shards: %" PRIu64 " to %" PRIu64 " records "
+         "per shard", min == UINT64_MAX ? 0 : min, max);
 }
 
 /// Disable the standard output stream buffering based on user settings.
@@ -642,8 +2394,19 @@ main(int argc, char* argv[])
   if (!parse_endpoints(&eps, ep_idx, argv, ep_cnt))
     return EXIT_FAILURE;
 
+  // Run in the background and redirect the logging output.
+  if (!detach_process())
+    return EXIT_FAILURE;
+
+  // Place the process near the traffic before its state is allocated.
+  place_process();
+
+  // Allocate the bounded state structures.
+  if (!create_state())
+    return EXIT_FAILURE;
+
   // Create the event queue.
-  if (!create_event_queue())
+  if (!op_evq->eq_create())
     return EXIT_FAILURE;
 
   // Initialise the sockets based on selected interfaces.
@@ -654,18 +2417,51 @@ main(int argc, char* argv[])
   if (!add_socket_events())
     return EXIT_FAILURE;
 
+  // Follow the changes of the interfaces.
+  if (!create_link_monitor())
+    return EXIT_FAILURE;
+
   // Create a signal event and add it to the event queue.
-  if (!add_signal_events())
+  if (!op_evq->eq_add_signals())
+    return EXIT_FAILURE;
+
+  // Create the shared memory ring for local consumers.
+  if (!create_ring())
+    return EXIT_FAILURE;
+
+  // Open the output shards of the records.
+  if (!create_output_shards())
     return EXIT_FAILURE;
 
+  // Select the receive path for the options.
+  specialise_receive();
+  decode_init();
+  notify(NL_DEBUG, false, "Decoding datagrams with the %s byte order "
+         "conversion", decode_method());
+
+  // Tune the host for low latency once all buffers exist.
+  if (op_lat > 0)
+    tune_latency(op_lat);
+
   // Print the CSV header to the standard output.
   print_header();
 
   // Start receiving datagrams.
-  if (!receive_events(eps))
+  if (!op_evq->eq_receive(eps)) {
+    close_output_shards();
+    ring_close(&rng);
+    remove_pidfile();
     return EXIT_FAILURE;
+  }
+
+  report_totals();
 
+  close_output_shards();
   fflush(stdout);
+  ring_close(&rng);
+  remove_pidfile();
+  rollup_free(&rlp);
+  flow_table_free(&flows);
   free_endpoints(eps);
 
   return EXIT_SUCCESS;
@@ -9,18 +9,38 @@
 
 #include <stdbool.h>
 #include <signal.h>
+#include <time.h>
 
+#include "platform.h"
 #include "types.h"
 
 
-// The following four functions have to be implemented by every event queue.
-bool create_event_queue(void);
-bool add_socket_event(endpoint* ep);
-bool add_signal_events(void);
-bool receive_events(endpoint* eps);
+/// Event queue that waits for datagrams on the endpoint sockets and for the
+/// signals that stop the process. Every event queue supported on the platform
+/// is compiled in, and one of them is selected at runtime.
+typedef struct _event_queue {
+  const char* eq_name;                 ///< Name of the event queue.
+  bool (*eq_create)(void);             ///< Create the event queue.
+  bool (*eq_add_socket)(endpoint* ep); ///< Register the socket of an endpoint.
+  bool (*eq_add_link)(endpoint* ep);   ///< Register the link monitor.
+  bool (*eq_add_signals)(void);        ///< Register SIGINT, SIGHUP and SIGTERM.
+  bool (*eq_receive)(endpoint* eps);   ///< Process events until a signal.
+} event_queue;
+
+#if defined(MBEAT_HAVE_EPOLL)
+extern const event_queue eq_epoll;
+#endif
+#if defined(MBEAT_HAVE_KQUEUE)
+extern const event_queue eq_kqueue;
+#endif
+extern const event_queue eq_poll;
+extern const event_queue eq_pselect;
 
 // The following functions are used by the event queues.
 bool create_signal_mask(sigset_t* mask);
 bool handle_event(endpoint* ep);
+bool timer_timeout(struct timespec* ts);
+bool coalesce_timeout(struct timespec* ts);
+void handle_timers(void);
 
 #endif
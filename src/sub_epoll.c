@@ -7,35 +7,60 @@
 #include "platform.h"
 
 // This check has to be preceded by the "platform.h" include, as it defines
-// the MBEAT_EVENT_* macros based on the operating system.
-#if (MBEAT_EVENT == MBEAT_EVENT_EPOLL)
+// the availability of the event queues.
+#if defined(MBEAT_HAVE_EPOLL)
 
 #include <sys/epoll.h>
 #include <sys/signalfd.h>
+#include <sys/timerfd.h>
 
 #include <unistd.h>
 #include <string.h>
+#include <stdint.h>
+#include <errno.h>
 
 #include "sub.h"
 #include "common.h"
 
 
 static int eqfd;  ///< Event queue.
+static int ctlfd; ///< Event queue of the coalescing delay.
 static int sigfd; ///< Signal event.
+static int tmrfd; ///< Timer of the coalescing delay.
 
-/// Create a new event queue.
+/// Create a new event queue, together with a second one that waits only for
+/// the signals, the link monitor and the timer of the coalescing delay.
 /// @return status code
-bool
+static bool
 create_event_queue(void)
 {
+  struct epoll_event ev;
+
   notify(NL_DEBUG, false, "Using the %s event queue", "epoll");
 
   eqfd = epoll_create(ENDPOINT_MAX);
-  if (eqfd < 0) {
+  ctlfd = epoll_create(3);
+  if (eqfd < 0 || ctlfd < 0) {
     notify(NL_ERROR, true, "Unable to create event queue");
     return false;
   }
 
+  // The timeout of epoll_wait(2) has a resolution of milliseconds, while the
+  // coalescing delay can be shorter.
+  tmrfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+  if (tmrfd == -1) {
+    notify(NL_ERROR, true, "Unable to create the coalescing timer");
+    return false;
+  }
+
+  ev.events = EPOLLIN;
+  ev.data.fd = tmrfd;
+  if (epoll_ctl(ctlfd, EPOLL_CTL_ADD, tmrfd, &ev) == -1) {
+    notify(NL_ERROR, true, "Unable to add the coalescing timer to the event "
+           "queue");
+    return false;
+  }
+
   return true;
 }
 
@@ -43,7 +68,7 @@ create_event_queue(void)
 /// @return status code
 ///
 /// @param[in] ep endpoint
-bool
+static bool
 add_socket_event(endpoint* ep)
 {
   struct epoll_event ev;
@@ -62,9 +87,31 @@ add_socket_event(endpoint* ep)
   return true;
 }
 
-/// Register events for signals SIGINT and SIGHUP.
+/// Register the link monitor with both event queues.
 /// @return status code
-bool
+///
+/// @param[in] ep link monitor
+static bool
+add_link_event(endpoint* ep)
+{
+  struct epoll_event ev;
+
+  if (!add_socket_event(ep))
+    return false;
+
+  ev.events = EPOLLIN;
+  ev.data.ptr = ep;
+  if (epoll_ctl(ctlfd, EPOLL_CTL_ADD, ep->ep_sock, &ev) == -1) {
+    notify(NL_ERROR, true, "Unable to add a socket to the event queue");
+    return false;
+  }
+
+  return true;
+}
+
+/// Register events for signals SIGINT, SIGHUP and SIGTERM.
+/// @return status code
+static bool
 add_signal_events(void)
 {
   struct epoll_event ev;
@@ -76,6 +123,13 @@ add_signal_events(void)
     return false;
   }
 
+  // Block the default handling of the signals, so that they are delivered
+  // only through the signal file descriptor.
+  if (sigprocmask(SIG_BLOCK, &mask, NULL) == -1) {
+    notify(NL_ERROR, true, "Unable to block the signals");
+    return false;
+  }
+
   // Create a new signal file descriptor.
   notify(NL_TRACE, false, "Creating a signal file descriptor");
   sigfd = signalfd(-1, &mask, 0);
@@ -88,7 +142,8 @@ add_signal_events(void)
   notify(NL_TRACE, false, "Adding a signal to the event queue");
   ev.events = EPOLLIN;
   ev.data.fd = sigfd;
-  if (epoll_ctl(eqfd, EPOLL_CTL_ADD, sigfd, &ev) == -1) {
+  if (epoll_ctl(eqfd, EPOLL_CTL_ADD, sigfd, &ev) == -1
+   || epoll_ctl(ctlfd, EPOLL_CTL_ADD, sigfd, &ev) == -1) {
     notify(NL_ERROR, true, "Unable to add a signal to the event queue");
     return false;
   }
@@ -118,14 +173,55 @@ report_signal(void)
   return true;
 }
 
+/// Arm the timer of the coalescing delay.
+/// @return status code
+///
+/// @param[in] ts remaining time of the delay
+static bool
+arm_timer(const struct timespec* ts)
+{
+  struct itimerspec its;
+
+  // A zero expiration would disarm the timer instead.
+  memset(&its, 0, sizeof(its));
+  its.it_value = *ts;
+  if (its.it_value.tv_sec == 0 && its.it_value.tv_nsec == 0)
+    its.it_value.tv_nsec = 1;
+
+  if (timerfd_settime(tmrfd, 0, &its, NULL) == -1) {
+    notify(NL_ERROR, true, "Unable to arm the coalescing timer");
+    return false;
+  }
+
+  return true;
+}
+
+/// Consume the expiration of the timer of the coalescing delay.
+/// @return status code
+static bool
+clear_timer(void)
+{
+  uint64_t exp;
+
+  if (read(tmrfd, &exp, sizeof(exp)) == -1 && errno != EAGAIN) {
+    notify(NL_ERROR, true, "Unable to read the coalescing timer");
+    return false;
+  }
+
+  return true;
+}
+
 /// Process the incoming network datagrams and process signals.
 /// @return status code
 ///
 /// @param[in] eps endpoints list
-bool
+static bool
 receive_events(endpoint* eps)
 {
   struct epoll_event evs[64];
+  struct timespec ts;
+  int timeout;
+  int qfd;
   int cnt;
   int i;
 
@@ -136,8 +232,24 @@ receive_events(endpoint* eps)
   while (1) {
     notify(NL_DEBUG, false, "Waiting for events");
 
+    // Let the datagrams accumulate until the end of the coalescing delay,
+    // which the timer bounds with a resolution of nanoseconds.
+    if (coalesce_timeout(&ts)) {
+      if (!arm_timer(&ts))
+        return false;
+      qfd = ctlfd;
+      timeout = -1;
+    } else {
+      // Wait no longer than until the next timer expiration, rounding up to
+      // whole milliseconds.
+      qfd = eqfd;
+      timeout = -1;
+      if (timer_timeout(&ts))
+        timeout = (int)(ts.tv_sec * 1000 + (ts.tv_nsec + 999999) / 1000000);
+    }
+
     // Read events from the event queue.
-    cnt = epoll_wait(eqfd, evs, 64, -1);
+    cnt = epoll_wait(qfd, evs, 64, timeout);
     if (cnt < 0) {
       notify(NL_ERROR, true, "Event queue reading failed");
       return false;
@@ -146,17 +258,36 @@ receive_events(endpoint* eps)
     for (i = 0; i < cnt; i++) {
       notify(NL_TRACE, false, "Received event %d/%d", i + 1, cnt);
 
-      // Handle the signal event for SIGINT and SIGHUP.
+      // Handle the signal event for SIGINT, SIGHUP and SIGTERM.
       if (evs[i].data.fd == sigfd)
         return report_signal();
 
+      // Handle the end of the coalescing delay.
+      if (evs[i].data.fd == tmrfd) {
+        if (!clear_timer())
+          return false;
+        continue;
+      }
+
       // Handle socket events.
       if (!handle_event(evs[i].data.ptr))
         return false;
     }
+
+    handle_timers();
   }
 
   return true;
 }
 
+/// Event queue based on the epoll(7) interface.
+const event_queue eq_epoll = {
+  "epoll",
+  create_event_queue,
+  add_socket_event,
+  add_link_event,
+  add_signal_events,
+  receive_events
+};
+
 #endif
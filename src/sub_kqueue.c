@@ -6,7 +6,9 @@
 
 #include "platform.h"
 
-#if (MBEAT_EVENT == MBEAT_EVENT_KQUEUE)
+// This check has to be preceded by the "platform.h" include, as it defines
+// the availability of the event queues.
+#if defined(MBEAT_HAVE_KQUEUE)
 
 #include <sys/event.h>
 
@@ -17,17 +19,20 @@
 #include "sub.h"
 
 
-static int epfd; ///< Event queue.
+static int eqfd;  ///< Event queue.
+static int ctlfd; ///< Event queue of the coalescing delay.
 
-/// Create a new event queue.
+/// Create a new event queue, together with a second one that waits only for
+/// the signals and the link monitor during the coalescing delay.
 /// @return status code
-bool
+static bool
 create_event_queue(void)
 {
   notify(NL_DEBUG, false, "Using the %s event queue", "kqueue");
 
   eqfd = kqueue();
-  if (eqfd < 0) {
+  ctlfd = kqueue();
+  if (eqfd < 0 || ctlfd < 0) {
     notify(NL_ERROR, true, "Unable to create event queue");
     return false;
   }
@@ -39,7 +44,7 @@ create_event_queue(void)
 /// @return status code
 ///
 /// @param[in] ep endpoint
-bool
+static bool
 add_socket_event(endpoint* ep)
 {
   struct kevent ev;
@@ -55,31 +60,73 @@ add_socket_event(endpoint* ep)
   return true;
 }
 
-bool
+/// Add the link monitor to both event queues.
+/// @return status code
+///
+/// @param[in] ep link monitor
+static bool
+add_link_event(endpoint* ep)
+{
+  struct kevent ev;
+
+  EV_SET(&ev, ep->ep_sock, EVFILT_READ, EV_ADD, 0, 0, ep);
+  if (kevent(eqfd, &ev, 1, NULL, 0, NULL) == -1
+   || kevent(ctlfd, &ev, 1, NULL, 0, NULL) == -1) {
+    notify(NL_ERROR, true, "Unable to add a socket to the event queue");
+    return false;
+  }
+
+  return true;
+}
+
+/// Register events for signals SIGINT, SIGHUP and SIGTERM.
+/// @return status code
+static bool
 add_signal_events(void)
 {
+  sigset_t mask;
   struct kevent ev;
 
+  // Block the default handling of the signals, so that they are delivered
+  // only through the event queue.
+  if (create_signal_mask(&mask) == false
+   || sigprocmask(SIG_BLOCK, &mask, NULL) == -1) {
+    notify(NL_ERROR, true, "Unable to block the signals");
+    return false;
+  }
+
   // Add SIGINT to the event queue.
   EV_SET(&ev, SIGINT, EVFILT_SIGNAL, EV_ADD, 0, 0, NULL);
-  if (kevent(eqfd, &ev, 1, NULL, 0, NULL) == -1) {
+  if (kevent(eqfd, &ev, 1, NULL, 0, NULL) == -1
+   || kevent(ctlfd, &ev, 1, NULL, 0, NULL) == -1) {
     notify(NL_ERROR, true, "Unable to add SIGINT to the event queue");
     return false;
   }
 
   // Add SIGHUP to the event queue.
   EV_SET(&ev, SIGHUP, EVFILT_SIGNAL, EV_ADD, 0, 0, NULL);
-  if (kevent(eqfd, &ev, 1, NULL, 0, NULL) == -1) {
+  if (kevent(eqfd, &ev, 1, NULL, 0, NULL) == -1
+   || kevent(ctlfd, &ev, 1, NULL, 0, NULL) == -1) {
     notify(NL_ERROR, true, "Unable to add SIGHUP to the event queue");
     return false;
   }
+
+  // Add SIGTERM to the event queue.
+  EV_SET(&ev, SIGTERM, EVFILT_SIGNAL, EV_ADD, 0, 0, NULL);
+  if (kevent(eqfd, &ev, 1, NULL, 0, NULL) == -1
+   || kevent(ctlfd, &ev, 1, NULL, 0, NULL) == -1) {
+    notify(NL_ERROR, true, "Unable to add SIGTERM to the event queue");
+    return false;
+  }
+
+  return true;
 }
 
 /// Notify the user the type of the received signal.
 static bool
 report_signal(struct kevent* ev)
 {
-  notify(NL_INFO, false, "Received the %s signal", strsignal(ev.data));
+  notify(NL_INFO, false, "Received the %s signal", strsignal((int)ev->ident));
   return true;
 }
 
@@ -87,10 +134,11 @@ report_signal(struct kevent* ev)
 /// @return status code
 ///
 /// @param[in] eps endpoints list
-bool
+static bool
 receive_events(endpoint* eps)
 {
   struct kevent evs[64];
+  struct timespec ts;
   int cnt;
   int i;
 
@@ -98,25 +146,45 @@ receive_events(endpoint* eps)
   // warning for an unused function argument.
   (void)eps;
 
-  cnt = kevent(eqfd, NULL, 0, evs, 64, NULL);
-  if (cnt < 0) {
-    notify(NL_ERROR, true, "Unable to retrieve events");
-    return false;
-  }
+  while (1) {
+    // Let the datagrams accumulate until the end of the coalescing delay,
+    // waiting only for the signals and the link monitor. Otherwise wait no
+    // longer than until the next timer expiration.
+    if (coalesce_timeout(&ts))
+      cnt = kevent(ctlfd, NULL, 0, evs, 64, &ts);
+    else
+      cnt = kevent(eqfd, NULL, 0, evs, 64, timer_timeout(&ts) ? &ts : NULL);
+    if (cnt < 0) {
+      notify(NL_ERROR, true, "Unable to retrieve events");
+      return false;
+    }
 
-  for (i = 0; i < cnt; i++) {
-    notify(NL_TRACE, false, "Received event %d/%d", i + 1, cnt);
+    for (i = 0; i < cnt; i++) {
+      notify(NL_TRACE, false, "Received event %d/%d", i + 1, cnt);
 
-    // Handle the signal event for SIGINT and SIGHUP.
-    if (evs[i].filter == EVFILT_SIGNAL)
-      return report_signal(&ev[i]);
+      // Handle the signal event for SIGINT, SIGHUP and SIGTERM.
+      if (evs[i].filter == EVFILT_SIGNAL)
+        return report_signal(&evs[i]);
 
-    // Handle socket events.
-    if (!handle_event(evs[i].udata))
-      return false;
+      // Handle socket events.
+      if (!handle_event(evs[i].udata))
+        return false;
+    }
+
+    handle_timers();
   }
 
   return true;
 }
 
+/// Event queue based on the kqueue(2) interface.
+const event_queue eq_kqueue = {
+  "kqueue",
+  create_event_queue,
+  add_socket_event,
+  add_link_event,
+  add_signal_events,
+  receive_events
+};
+
 #endif
@@ -0,0 +1,284 @@
+// Copyright (c) 2017-2018 Two Sigma Open Source, LLC.
+// All Rights Reserved
+//
+// Distributed under the terms of the 2-clause BSD License. The full
+// license is in the file LICENSE, distributed as part of this software.
+
+#include "platform.h"
+
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <signal.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+
+#include "types.h"
+#include "common.h"
+#include "sub.h"
+
+
+// Initial number of slots of the descriptor array.
+#define POLL_SLOTS 64
+
+static struct pollfd* pfds;     ///< Descriptors, with the self-pipe first.
+static endpoint**     peps;     ///< Endpoints of the descriptors.
+static nfds_t         pcnt;     ///< Number of used slots.
+static nfds_t         pctl;     ///< Slots of the signals and the link monitor.
+static nfds_t         pcap;     ///< Number of allocated slots.
+static int            spipe[2]; ///< Self-pipe of the signal handler.
+
+/// Forward the signal number to the event loop through the self-pipe. The
+/// write is the only async-signal-safe way to wake up the poll(2) call
+/// without a race between checking a flag and starting to wait.
+///
+/// @param[in] sig signal number
+static void
+signal_pipe(int sig)
+{
+  unsigned char num;
+  int err;
+  ssize_t ret;
+
+  err = errno;
+  num = (unsigned char)sig;
+  ret = write(spipe[1], &num, sizeof(num));
+  (void)ret;
+  errno = err;
+}
+
+/// Append a descriptor to the array, growing it as necessary.
+/// @return status code
+///
+/// @param[in] fd descriptor
+/// @param[in] ep endpoint (NULL for the self-pipe)
+static bool
+append_slot(const int fd, endpoint* ep)
+{
+  struct pollfd* npfds;
+  endpoint** neps;
+  nfds_t ncap;
+
+  if (pcnt == pcap) {
+    ncap = pcap == 0 ? POLL_SLOTS : pcap * 2;
+
+    npfds = realloc(pfds, ncap * sizeof(*pfds));
+    if (npfds == NULL) {
+      notify(NL_ERROR, true, "Unable to allocate the event queue");
+      return false;
+    }
+    pfds = npfds;
+
+    neps = realloc(peps, ncap * sizeof(*peps));
+    if (neps == NULL) {
+      notify(NL_ERROR, true, "Unable to allocate the event queue");
+      return false;
+    }
+    peps = neps;
+
+    pcap = ncap;
+  }
+
+  pfds[pcnt].fd      = fd;
+  pfds[pcnt].events  = POLLIN;
+  pfds[pcnt].revents = 0;
+  peps[pcnt]         = ep;
+  pcnt++;
+
+  return true;
+}
+
+/// Create the poll event queue.
+/// @return status code
+static bool
+create_event_queue(void)
+{
+  notify(NL_DEBUG, false, "Using the %s event queue", "poll");
+
+  pfds = NULL;
+  peps = NULL;
+  pcnt = 0;
+  pcap = 0;
+  pctl = 1;
+
+  // Reserve the first slot for the signal pipe. Negative descriptors are
+  // ignored by poll(2) until the pipe exists.
+  return append_slot(-1, NULL);
+}
+
+/// Register a socket with the event queue.
+/// @return status code
+///
+/// @param[in] ep endpoint
+static bool
+add_socket_event(endpoint* ep)
+{
+  return append_slot(ep->ep_sock, ep);
+}
+
+/// Register the link monitor with the event queue. Its slot is moved right
+/// after the self-pipe, so that the coalescing delay waits for the leading
+/// slots only.
+/// @return status code
+///
+/// @param[in] ep link monitor
+static bool
+add_link_event(endpoint* ep)
+{
+  struct pollfd pfd;
+  endpoint* pep;
+
+  if (!append_slot(ep->ep_sock, ep))
+    return false;
+
+  pfd = pfds[pctl];
+  pep = peps[pctl];
+  pfds[pctl] = pfds[pcnt - 1];
+  peps[pctl] = peps[pcnt - 1];
+  pfds[pcnt - 1] = pfd;
+  peps[pcnt - 1] = pep;
+  pctl++;
+
+  return true;
+}
+
+/// Register events for signals SIGINT, SIGHUP and SIGTERM.
+/// @return status code
+static bool
+add_signal_events(void)
+{
+  struct sigaction sa;
+  int i;
+
+  if (pipe(spipe) == -1) {
+    notify(NL_ERROR, true, "Unable to create the signal pipe");
+    return false;
+  }
+
+  // Neither end of the pipe may block: the handler must not stall on a full
+  // pipe, and the loop drains the pipe only once it is readable.
+  for (i = 0; i < 2; i++) {
+    if (fcntl(spipe[i], F_SETFL, fcntl(spipe[i], F_GETFL) | O_NONBLOCK) == -1
+     || fcntl(spipe[i], F_SETFD, FD_CLOEXEC) == -1) {
+      notify(NL_ERROR, true, "Unable to configure the signal pipe");
+      return false;
+    }
+  }
+
+  pfds[0].fd = spipe[0];
+
+  memset(&sa, '\0', sizeof(sa));
+  sa.sa_handler = signal_pipe;
+
+  // Install signal handler for SIGINT.
+  if (sigaction(SIGINT, &sa, NULL) < 0) {
+    notify(NL_ERROR, true, "Unable to add signal handler for %s", "SIGINT");
+    return false;
+  }
+
+  // Install signal handler for SIGHUP.
+  if (sigaction(SIGHUP, &sa, NULL) < 0) {
+    notify(NL_ERROR, true, "Unable to add signal handler for %s", "SIGHUP");
+    return false;
+  }
+
+  // Install signal handler for SIGTERM.
+  if (sigaction(SIGTERM, &sa, NULL) < 0) {
+    notify(NL_ERROR, true, "Unable to add signal handler for %s", "SIGTERM");
+    return false;
+  }
+
+  return true;
+}
+
+/// Notify the user the type of the received signal.
+/// @return status code
+static bool
+report_signal(void)
+{
+  unsigned char num;
+
+  if (read(spipe[0], &num, sizeof(num)) != (ssize_t)sizeof(num)) {
+    notify(NL_ERROR, true, "Unable to retrieve the signal information");
+    return false;
+  }
+
+  notify(NL_INFO, false, "Received the %s signal", strsignal(num));
+  return true;
+}
+
+/// Process the incoming network datagrams and process signals.
+/// @return status code
+///
+/// @param[in] eps endpoints list
+static bool
+receive_events(endpoint* eps)
+{
+  struct timespec ts;
+  int timeout;
+  int cnt;
+  nfds_t n;
+  nfds_t i;
+  bool armed;
+
+  // The endpoints are looked up through the descriptor array.
+  (void)eps;
+
+  while (1) {
+    // Let the datagrams accumulate until the end of the coalescing delay,
+    // waiting only for the signals and the link monitor. Otherwise wait no
+    // longer than until the next timer expiration. Both round up to whole
+    // milliseconds.
+    n = pctl;
+    armed = coalesce_timeout(&ts);
+    if (!armed) {
+      n = pcnt;
+      armed = timer_timeout(&ts);
+    }
+
+    timeout = -1;
+    if (armed)
+      timeout = (int)(ts.tv_sec * 1000 + (ts.tv_nsec + 999999) / 1000000);
+
+    cnt = poll(pfds, n, timeout);
+    if (cnt == -1) {
+      // The signal is picked up from the pipe in the next iteration.
+      if (errno == EINTR)
+        continue;
+
+      notify(NL_ERROR, true, "Event queue reading failed");
+      return false;
+    }
+
+    // Handle the signal event for SIGINT, SIGHUP and SIGTERM.
+    if (pfds[0].revents != 0)
+      return report_signal();
+
+    // Stop the scan once all ready descriptors were found, as the count of
+    // ready descriptors is the only summary that poll(2) provides.
+    for (i = 1; i < n && cnt > 0; i++) {
+      if (pfds[i].revents == 0)
+        continue;
+
+      cnt--;
+      if (!handle_event(peps[i]))
+        return false;
+    }
+
+    handle_timers();
+  }
+
+  return true;
+}
+
+/// Event queue based on the poll(2) function.
+const event_queue eq_poll = {
+  "poll",
+  create_event_queue,
+  add_socket_event,
+  add_link_event,
+  add_signal_events,
+  receive_events
+};
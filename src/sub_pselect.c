@@ -6,7 +6,6 @@
 
 #include "platform.h"
 
-#if (MBEAT_EVENT == MBEAT_EVENT_PSELECT)
 
 #include <sys/select.h>
 
@@ -21,8 +20,12 @@
 
 static fd_set eqfd;   ///< Event queue file descriptor.
 static int nfds;      ///< Highest socket file descriptor number.
+static fd_set ctlfd;  ///< Descriptors of the coalescing delay.
+static int cnfds;     ///< Highest descriptor number of the delay.
+static endpoint* fdeps[FD_SETSIZE]; ///< Endpoint of each socket.
 static bool sint;     ///< SIGINT occurrence flag.
 static bool shup;     ///< SIGHUP occurrence flag.
+static bool sterm;    ///< SIGTERM occurrence flag.
 static sigset_t mask; ///< Signal mask.
 
 /// Trigger the signal flags based on the incoming signal.
@@ -36,19 +39,26 @@ signal_flags(int sig)
 
   if (sig == SIGHUP)
     shup = true;
+
+  if (sig == SIGTERM)
+    sterm = true;
 }
 
 /// Create the pselect event queue.
 /// @return status code
-bool
+static bool
 create_event_queue(void)
 {
   notify(NL_DEBUG, false, "Using the %s event queue", "pselect");
 
   FD_ZERO(&eqfd);
+  FD_ZERO(&ctlfd);
+  memset(fdeps, 0, sizeof(fdeps));
   nfds = 0;
+  cnfds = 0;
   sint = false;
   shup = false;
+  sterm = false;
 
   return true;
 }
@@ -57,10 +67,18 @@ create_event_queue(void)
 /// @return status code
 ///
 /// @param[in] ep endpoint
-bool
+static bool
 add_socket_event(endpoint* ep)
 {
+  // The descriptor set has a fixed capacity.
+  if (ep->ep_sock >= FD_SETSIZE) {
+    notify(NL_ERROR, false, "Socket %d exceeds the %d descriptors of the %s "
+           "event queue", ep->ep_sock, FD_SETSIZE, "pselect");
+    return false;
+  }
+
   FD_SET(ep->ep_sock, &eqfd);
+  fdeps[ep->ep_sock] = ep;
 
   // Increment the upper bound of socket numbers.
   if (ep->ep_sock > nfds)
@@ -69,15 +87,33 @@ add_socket_event(endpoint* ep)
   return true;
 }
 
-/// Register events for signals SIGINT and SIGHUP.
+/// Register the link monitor, which the coalescing delay waits for as well.
 /// @return status code
-bool
+///
+/// @param[in] ep link monitor
+static bool
+add_link_event(endpoint* ep)
+{
+  if (!add_socket_event(ep))
+    return false;
+
+  FD_SET(ep->ep_sock, &ctlfd);
+  if (ep->ep_sock > cnfds)
+    cnfds = ep->ep_sock;
+
+  return true;
+}
+
+/// Register events for signals SIGINT, SIGHUP and SIGTERM.
+/// @return status code
+static bool
 add_signal_events(void)
 {
   struct sigaction sa;
 
   sint = false;
   shup = false;
+  sterm = false;
 
   memset(&sa, '\0', sizeof(sa));
   sa.sa_handler = signal_flags;
@@ -88,12 +124,18 @@ add_signal_events(void)
     return false;
   }
 
-  // Install signal handler for SIGINT.
+  // Install signal handler for SIGHUP.
   if (sigaction(SIGHUP, &sa, NULL) < 0) {
     notify(NL_ERROR, true, "Unable to add signal handler for %s", "SIGHUP");
     return false;
   }
 
+  // Install signal handler for SIGTERM.
+  if (sigaction(SIGTERM, &sa, NULL) < 0) {
+    notify(NL_ERROR, true, "Unable to add signal handler for %s", "SIGTERM");
+    return false;
+  }
+
   return true;
 }
 
@@ -102,12 +144,17 @@ static bool
 report_signal(void)
 {
   if (sint == true) {
-    notify(NL_WARN, false, "Received the %s signal", SIGINT);
+    notify(NL_WARN, false, "Received the %s signal", strsignal(SIGINT));
     return true;
   }
 
   if (shup == true) {
-    notify(NL_WARN, false, "Received the %s signal", SIGHUP);
+    notify(NL_WARN, false, "Received the %s signal", strsignal(SIGHUP));
+    return true;
+  }
+
+  if (sterm == true) {
+    notify(NL_WARN, false, "Received the %s signal", strsignal(SIGTERM));
     return true;
   }
 
@@ -119,7 +166,7 @@ report_signal(void)
 /// @return status code
 ///
 /// @param[in] eps endpoints list
-bool
+static bool
 receive_events(endpoint* eps)
 {
   fd_set evs;
@@ -127,47 +174,80 @@ receive_events(endpoint* eps)
   int i;
   endpoint* ep;
   int cnt;
+  struct timespec ts;
+  struct timespec* tsp;
 
-  memcpy(&evs, &eqfd, sizeof(eqfd));
-  cnt = pselect(nfds + 1, &evs, NULL, NULL, NULL, &mask);
+  // The endpoints list is not used - this line serves to suppress the compiler
+  // warning for an unused function argument.
+  (void)eps;
 
-  // Possible interruption by a signal.
-  if (cnt == -1) {
-    if (errno == EINTR)
+  while (1) {
+    // Signals that arrived outside of the waiting period.
+    if (sint || shup || sterm)
       return report_signal();
-    else {
-      notify(NL_ERROR, true, "Problem while waiting for events");
-      return false;
+
+    // Let the datagrams accumulate until the end of the coalescing delay,
+    // waiting only for the signals and the link monitor. Otherwise wait no
+    // longer than until the next timer expiration.
+    if (coalesce_timeout(&ts)) {
+      tsp = &ts;
+      memcpy(&evs, &ctlfd, sizeof(ctlfd));
+      cnt = pselect(cnfds + 1, &evs, NULL, NULL, tsp, &mask);
+    } else {
+      tsp = timer_timeout(&ts) ? &ts : NULL;
+      memcpy(&evs, &eqfd, sizeof(eqfd));
+      cnt = pselect(nfds + 1, &evs, NULL, NULL, tsp, &mask);
     }
-  }
 
-  k = 0;
-  for (i = 0; i < cnt; i++) {
-    // Skip to the next
-    while (!FD_ISSET(k, &evs) && k < FD_SETSIZE)
-      k++;
+    // Possible interruption by a signal.
+    if (cnt == -1) {
+      if (errno == EINTR)
+        return report_signal();
+      else {
+        notify(NL_ERROR, true, "Problem while waiting for events");
+        return false;
+      }
+    }
 
-    // Check if the search was exhaustive.
-    if (k == FD_SETSIZE)
-      return true;
+    k = 0;
+    for (i = 0; i < cnt; i++) {
+      // Skip to the next
+      while (!FD_ISSET(k, &evs) && k < FD_SETSIZE)
+        k++;
 
-    // Find the corresponding endpoint object.
-    for (ep = eps; ep != NULL; ep = ep->ep_next)
-      if (ep->ep_sock == k)
+      // Check if the search was exhaustive.
+      if (k == FD_SETSIZE)
         break;
 
-    // Verify that a matching endpoint exists.
-    if (ep == NULL) {
-      notify(NL_WARN, false, "Unable to find endpoint with socket %d", k);
-      return false;
+      // Find the corresponding endpoint object, including the link monitor
+      // that is not part of the endpoints list.
+      ep = fdeps[k];
+
+      // Verify that a matching endpoint exists.
+      if (ep == NULL) {
+        notify(NL_WARN, false, "Unable to find endpoint with socket %d", k);
+        return false;
+      }
+
+      // Handle socket events.
+      if (!handle_event(ep))
+        return false;
+
+      k++;
     }
 
-    // Handle socket events.
-    if (!handle_event(ep))
-      return false;
+    handle_timers();
   }
 
   return true;
 }
 
-#endif
+/// Event queue based on the pselect(2) function.
+const event_queue eq_pselect = {
+  "pselect",
+  create_event_queue,
+  add_socket_event,
+  add_link_event,
+  add_signal_events,
+  receive_events
+};
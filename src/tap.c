@@ -0,0 +1,283 @@
+// Copyright (c) 2017-2018 Two Sigma Open Source, LLC.
+// All Rights Reserved
+//
+// Distributed under the terms of the 2-clause BSD License. The full
+// license is in the file LICENSE, distributed as part of this software.
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+
+#include "types.h"
+#include "common.h"
+#include "parse.h"
+#include "output.h"
+#include "ring.h"
+
+
+// Default values for optional arguments.
+#define DEF_OLDEST           0 // Start with the newest record by default.
+#define DEF_RAW_OUTPUT       0 // Raw binary output is disabled by default.
+#define DEF_UNBUFFERED       0 // Unbuffered output is disabled by default.
+#define DEF_SLEEP       100000 // Pause between polls of an empty ring.
+#define DEF_NOTIFY_LEVEL     1 // Log errors and warnings by default.
+#define DEF_NOTIFY_COLOR     1 // Colors in the notification output.
+
+// Long-only command-line options.
+#define LO_COLUMNS 256
+
+// Command-line options.
+static uint64_t op_slp;  ///< Sleep duration between polls of an empty ring.
+static uint8_t  op_old;  ///< Start with the oldest available record.
+static uint8_t  op_raw;  ///< Output records in raw binary format.
+static uint8_t  op_unb;  ///< Turn off buffering on the output stream.
+static uint8_t  op_nlvl; ///< Notification verbosity level.
+static uint8_t  op_ncol; ///< Notification coloring policy.
+static char*    op_cols; ///< Selection of output columns.
+
+/// Termination flag set by the signal handler.
+static volatile sig_atomic_t stop;
+
+/// Print the utility usage information to the standard output.
+static void
+print_usage(void)
+{
+  fprintf(stderr,
+    "Multicast heartbeat ring reader - v%d.%d.%d\n"
+    "Stream records published by msub to a shared memory ring.\n\n"
+
+    "Usage:\n"
+    "  mtap [OPTIONS] NAME\n\n"
+
+    "Options:\n"
+    "  -a, --all                  Start with the oldest available record.\n"
+    "  -h, --help                 Print this help message.\n"
+    "  -n, --no-color             Turn off colors in logging messages.\n"
+    "  -r, --raw-output           Output the data in raw binary format.\n"
+    "  -s, --sleep-time DUR       Pause between polls of an empty ring."
+      " (def=100us)\n"
+    "  -u, --disable-buffering    Disable output buffering.\n"
+    "  -v, --verbose              Increase the logging verbosity.\n"
+    "      --columns LIST         Comma-separated list of output columns.\n",
+    MBEAT_VERSION_MAJOR,
+    MBEAT_VERSION_MINOR,
+    MBEAT_VERSION_PATCH);
+}
+
+/// Parse the command-line options.
+/// @return status code
+///
+/// @param[out] name ring name
+/// @param[in]  argc argument count
+/// @param[in]  argv argument vector
+static bool
+parse_args(char** name, int argc, char* argv[])
+{
+  int opt;
+  struct option lopts[] = {
+    {"all",               no_argument,       NULL, 'a'},
+    {"help",              no_argument,       NULL, 'h'},
+    {"no-color",          no_argument,       NULL, 'n'},
+    {"raw-output",        no_argument,       NULL, 'r'},
+    {"sleep-time",        required_argument, NULL, 's'},
+    {"disable-buffering", no_argument,       NULL, 'u'},
+    {"verbose",           no_argument,       NULL, 'v'},
+    {"columns",           required_argument, NULL, LO_COLUMNS},
+    {NULL, 0, NULL, 0}
+  };
+
+  // Set optional arguments to sensible defaults.
+  op_slp  = DEF_SLEEP;
+  op_old  = DEF_OLDEST;
+  op_raw  = DEF_RAW_OUTPUT;
+  op_unb  = DEF_UNBUFFERED;
+  op_nlvl = nlvl = DEF_NOTIFY_LEVEL;
+  op_ncol = ncol = DEF_NOTIFY_COLOR;
+  op_cols = NULL;
+
+  while ((opt = getopt_long(argc, argv, "ahnrs:uv", lopts, NULL)) != -1) {
+    switch (opt) {
+
+      // Start with the oldest record.
+      case 'a':
+        op_old = 1;
+        break;
+
+      // Usage information.
+      case 'h':
+        print_usage();
+        return false;
+
+      // Turn off the notification coloring.
+      case 'n':
+        op_ncol = 0;
+        break;
+
+      // Raw binary output option.
+      case 'r':
+        op_raw = 1;
+        break;
+
+      // Sleep duration between polls.
+      case 's':
+        if (parse_scalar(&op_slp, optarg, parse_time_unit) == 0)
+          return false;
+        break;
+
+      // Unbuffered output option.
+      case 'u':
+        op_unb = 1;
+        break;
+
+      // Logging verbosity level.
+      case 'v':
+        if (op_nlvl < NL_TRACE)
+          op_nlvl++;
+        break;
+
+      // Selection of output columns.
+      case LO_COLUMNS:
+        op_cols = optarg;
+        break;
+
+      // Unknown option.
+      case '?':
+        fprintf(stderr, "Invalid option '%c'", optopt);
+        print_usage();
+        return false;
+
+      // Unknown situation.
+      default:
+        print_usage();
+        return false;
+    }
+  }
+
+  // Set the requested global logging level threshold.
+  nlvl = op_nlvl;
+  ncol = op_ncol;
+
+  if (argc - optind != 1) {
+    notify(NL_ERROR, false, "Expected exactly one ring name");
+    return false;
+  }
+
+  // Compile the selection of output columns into the formatting plan.
+  if (!output_columns(op_cols))
+    return false;
+
+  *name = argv[optind];
+  return true;
+}
+
+/// Raise the termination flag.
+///
+/// @param[in] sig signal number
+static void
+signal_stop(int sig)
+{
+  (void)sig;
+  stop = 1;
+}
+
+/// Install the signal handlers for SIGINT and SIGHUP.
+/// @return status code
+static bool
+install_signal_handlers(void)
+{
+  struct sigaction sa;
+
+  stop = 0;
+  memset(&sa, '\0', sizeof(sa));
+  sa.sa_handler = signal_stop;
+
+  if (sigaction(SIGINT, &sa, NULL) < 0) {
+    notify(NL_ERROR, true, "Unable to add signal handler for %s", "SIGINT");
+    return false;
+  }
+
+  if (sigaction(SIGHUP, &sa, NULL) < 0) {
+    notify(NL_ERROR, true, "Unable to add signal handler for %s", "SIGHUP");
+    return false;
+  }
+
+  return true;
+}
+
+/// Stream all records from the ring to the standard output.
+///
+/// @param[in] rg ring
+static void
+stream_records(ring* rg)
+{
+  raw_output ro;
+  struct timespec ts;
+  int ret;
+
+  from_nanos(&ts, op_slp);
+
+  while (stop == 0) {
+    ret = ring_read(rg, &ro);
+
+    if (ret == RING_READ) {
+      if (op_raw)
+        print_record_raw(stdout, &ro);
+      else
+        print_record_csv(stdout, &ro);
+      continue;
+    }
+
+    if (ret == RING_CLOSED) {
+      notify(NL_INFO, false, "Writer closed the ring");
+      break;
+    }
+
+    // Flush the buffered output before waiting for new records.
+    fflush(stdout);
+    nanosleep(&ts, NULL);
+  }
+
+  if (rg->rg_lost > 0)
+    notify(NL_WARN, false, "Lost %" PRIu64 " records due to ring overruns",
+           rg->rg_lost);
+}
+
+/// Multicast heartbeat ring reader.
+int
+main(int argc, char* argv[])
+{
+  char* name;
+  ring rg;
+
+  // Process the command-line arguments.
+  if (!parse_args(&name, argc, argv))
+    return EXIT_FAILURE;
+
+  // Disable buffering on the standard output.
+  if (op_unb && setvbuf(stdout, NULL, _IONBF, 0) != 0)
+    notify(NL_WARN, true, "Unable to disable stdio buffering");
+
+  if (!install_signal_handlers())
+    return EXIT_FAILURE;
+
+  // Attach to the ring published by the subscriber.
+  if (!ring_attach(&rg, name, op_old))
+    return EXIT_FAILURE;
+
+  if (!op_raw)
+    print_csv_header(stdout);
+
+  stream_records(&rg);
+
+  fflush(stdout);
+  ring_close(&rg);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,345 @@
+// Copyright (c) 2017-2018 Two Sigma Open Source, LLC.
+// All Rights Reserved
+//
+// Distributed under the terms of the 2-clause BSD License. The full
+// license is in the file LICENSE, distributed as part of this software.
+
+#include "platform.h"
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(MBEAT_HAVE_TSC)
+  #include <cpuid.h>
+#endif
+
+#include "tstamp.h"
+#include "common.h"
+
+
+// Duration of the initial calibration of the Time Stamp Counter.
+#define TSC_CALIBRATION 20000000
+
+// Number of attempts to read the counter and the steady clock back-to-back.
+#define TSC_PAIR_TRIES 5
+
+// Selected source and the clocks it is based on.
+static int       src  = TS_REALTIME; ///< Timestamp source.
+static clockid_t rclk = CLOCK_REALTIME; ///< System clock.
+#ifdef __linux__
+  static clockid_t mclk = CLOCK_MONOTONIC_RAW; ///< Steady clock.
+#else
+  static clockid_t mclk = CLOCK_MONOTONIC; ///< Steady clock.
+#endif
+
+// Anchor of the derived times.
+static uint64_t an_mt;   ///< Steady time at the anchor.
+static int64_t  an_off;  ///< Offset of the system time from the steady time.
+static uint64_t an_next; ///< Steady time of the next anchoring.
+
+#if defined(MBEAT_HAVE_TSC)
+  static uint64_t an_tsc;  ///< Counter value at the anchor.
+  static uint64_t an_mult; ///< Nanoseconds per tick (32.32 fixed point).
+  static uint64_t an_last; ///< Last reported steady time.
+
+  // Calibration baseline of the counter frequency.
+  static uint64_t cal_tsc; ///< Counter value at the start.
+  static uint64_t cal_mt;  ///< Steady time at the start.
+#endif
+
+// Drift statistics.
+static uint64_t dr_cnt;  ///< Number of re-anchorings.
+static int64_t  dr_last; ///< Last observed drift in nanoseconds.
+static uint64_t dr_max;  ///< Maximal absolute drift in nanoseconds.
+
+/// Read a clock.
+/// @return nanoseconds
+///
+/// @param[in] clk clock
+static uint64_t
+read_clock(const clockid_t clk)
+{
+  struct timespec tv;
+  uint64_t ns;
+
+  clock_gettime(clk, &tv);
+  to_nanos(&ns, tv);
+  return ns;
+}
+
+#if defined(MBEAT_HAVE_TSC)
+
+/// Read the Time Stamp Counter.
+/// @return counter value
+static inline uint64_t
+read_tsc(void)
+{
+  return __builtin_ia32_rdtsc();
+}
+
+/// Convert a number of ticks to nanoseconds.
+/// @return nanoseconds
+///
+/// @param[in] ticks number of ticks
+static inline uint64_t
+tsc_to_ns(const uint64_t ticks)
+{
+  __extension__ typedef unsigned __int128 u128;
+
+  return (uint64_t)(((u128)ticks * an_mult) >> 32);
+}
+
+/// Compute the tick length from two pairs of readings.
+/// @return nanoseconds per tick (32.32 fixed point)
+///
+/// @param[in] ticks elapsed ticks
+/// @param[in] ns    elapsed nanoseconds
+static uint64_t
+tsc_mult(const uint64_t ticks, const uint64_t ns)
+{
+  __extension__ typedef unsigned __int128 u128;
+
+  return (uint64_t)(((u128)ns << 32) / ticks);
+}
+
+/// Read the counter and the steady clock as close to each other as possible.
+///
+/// @param[out] tsc counter value
+/// @param[out] mt  steady time
+static void
+read_pair(uint64_t* tsc, uint64_t* mt)
+{
+  uint64_t t0;
+  uint64_t t1;
+  uint64_t ns;
+  uint64_t best;
+  int i;
+
+  // Keep the reading with the shortest window, attributing the steady time to
+  // the middle of the window.
+  best = UINT64_MAX;
+  for (i = 0; i < TSC_PAIR_TRIES; i++) {
+    t0 = read_tsc();
+    ns = read_clock(mclk);
+    t1 = read_tsc();
+
+    if (t1 - t0 < best) {
+      best = t1 - t0;
+      *tsc = t0 + (t1 - t0) / 2;
+      *mt  = ns;
+    }
+  }
+}
+
+/// Verify that the counter runs at a constant rate in all power states.
+/// @return decision
+static bool
+tsc_invariant(void)
+{
+  unsigned int a;
+  unsigned int b;
+  unsigned int c;
+  unsigned int d;
+
+  if (__get_cpuid(0x80000007, &a, &b, &c, &d) == 0)
+    return false;
+
+  return (d & (1U << 8)) != 0;
+}
+
+#endif
+
+/// Re-anchor the derived times to the system clocks and measure the drift
+/// accumulated since the previous anchoring.
+static void
+anchor(void)
+{
+  uint64_t mt;
+  uint64_t rt;
+  int64_t off;
+  int64_t drift;
+#if defined(MBEAT_HAVE_TSC)
+  uint64_t tsc;
+#endif
+
+  drift = 0;
+
+#if defined(MBEAT_HAVE_TSC)
+  if (src == TS_TSC) {
+    read_pair(&tsc, &mt);
+
+    // Compare the steady time derived from the counter with the actual one,
+    // then refine the tick length over the whole run.
+    drift = (int64_t)(an_mt + tsc_to_ns(tsc - an_tsc) - mt);
+    an_mult = tsc_mult(tsc - cal_tsc, mt - cal_mt);
+    an_tsc  = tsc;
+  } else {
+    mt = read_clock(mclk);
+  }
+#else
+  mt = read_clock(mclk);
+#endif
+
+  rt  = read_clock(rclk);
+  off = (int64_t)(rt - mt);
+
+  // Derived system time follows the steps and slewing of the system clock
+  // only upon anchoring.
+  if (src == TS_RAW)
+    drift = off - an_off;
+
+  an_mt   = mt;
+  an_off  = off;
+  an_next = mt + TS_ANCHOR_PERIOD;
+
+  dr_cnt++;
+  dr_last = drift;
+  if ((uint64_t)(drift < 0 ? -drift : drift) > dr_max)
+    dr_max = (uint64_t)(drift < 0 ? -drift : drift);
+
+  notify(NL_TRACE, false, "Re-anchored timestamps with drift of %" PRIi64
+         " ns", drift);
+}
+
+/// Select the timestamp source.
+/// @return status code
+///
+/// @param[in] name source name
+bool
+tstamp_select(const char* name)
+{
+#if defined(MBEAT_HAVE_TSC)
+  struct timespec tv;
+  uint64_t tsc;
+  uint64_t mt;
+#endif
+
+  if (strcmp(name, "realtime") == 0) {
+    src  = TS_REALTIME;
+    rclk = CLOCK_REALTIME;
+    return true;
+  }
+
+  if (strcmp(name, "tai") == 0) {
+#if defined(CLOCK_TAI)
+    src  = TS_TAI;
+    rclk = CLOCK_TAI;
+    return true;
+#else
+    notify(NL_ERROR, false, "TAI clock is not supported on this platform");
+    return false;
+#endif
+  }
+
+  if (strcmp(name, "monotonic_raw") == 0) {
+    src  = TS_RAW;
+    rclk = CLOCK_REALTIME;
+    an_off = 0;
+    anchor();
+    dr_cnt  = 0;
+    dr_last = 0;
+    dr_max  = 0;
+    return true;
+  }
+
+  if (strcmp(name, "tsc") == 0) {
+#if defined(MBEAT_HAVE_TSC)
+    if (!tsc_invariant())
+      notify(NL_WARN, false, "Time Stamp Counter is not invariant, the "
+             "derived times depend on re-anchoring");
+
+    src  = TS_TSC;
+    rclk = CLOCK_REALTIME;
+
+    // Measure the tick length over a short interval, which is refined with
+    // each subsequent anchoring.
+    read_pair(&cal_tsc, &cal_mt);
+    from_nanos(&tv, TSC_CALIBRATION);
+    nanosleep(&tv, NULL);
+    read_pair(&tsc, &mt);
+    if (tsc <= cal_tsc) {
+      notify(NL_ERROR, false, "Time Stamp Counter does not advance");
+      return false;
+    }
+
+    an_mult = tsc_mult(tsc - cal_tsc, mt - cal_mt);
+    an_tsc  = tsc;
+    an_mt   = mt;
+    anchor();
+    dr_cnt  = 0;
+    dr_last = 0;
+    dr_max  = 0;
+
+    notify(NL_DEBUG, false, "Calibrated Time Stamp Counter to %.6f GHz",
+           4294967296.0 / (double)an_mult);
+    return true;
+#else
+    notify(NL_ERROR, false, "Time Stamp Counter is not supported on this "
+           "platform");
+    return false;
+#endif
+  }
+
+  notify(NL_ERROR, false, "Unknown timestamp source %s", name);
+  return false;
+}
+
+/// Obtain the current system and steady time from the selected source.
+///
+/// @param[out] rt system time in nanoseconds
+/// @param[out] mt steady time in nanoseconds
+void
+tstamp_now(uint64_t* rt, uint64_t* mt)
+{
+  switch (src) {
+    case TS_RAW:
+      *mt = read_clock(mclk);
+      if (*mt >= an_next)
+        anchor();
+      break;
+
+#if defined(MBEAT_HAVE_TSC)
+    case TS_TSC:
+      *mt = an_mt + tsc_to_ns(read_tsc() - an_tsc);
+      if (*mt >= an_next) {
+        anchor();
+        *mt = an_mt + tsc_to_ns(read_tsc() - an_tsc);
+      }
+
+      // The re-anchoring must not make the steady time go backwards.
+      if (*mt < an_last)
+        *mt = an_last;
+      an_last = *mt;
+      break;
+#endif
+
+    default:
+      *rt = read_clock(rclk);
+      *mt = read_clock(mclk);
+      return;
+  }
+
+  *rt = (uint64_t)((int64_t)*mt + an_off);
+}
+
+/// Report the drift of the derived times.
+void
+tstamp_report(void)
+{
+  if (src != TS_RAW && src != TS_TSC)
+    return;
+
+  notify(NL_INFO, false, "Timestamps re-anchored %" PRIu64 " times, last "
+         "drift %" PRIi64 " ns, max drift %" PRIu64 " ns",
+         dr_cnt, dr_last, dr_max);
+
+#if defined(MBEAT_HAVE_TSC)
+  if (src == TS_TSC)
+    notify(NL_INFO, false, "Time Stamp Counter frequency %.6f GHz",
+           4294967296.0 / (double)an_mult);
+#endif
+}
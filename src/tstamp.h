@@ -0,0 +1,27 @@
+// Copyright (c) 2017-2018 Two Sigma Open Source, LLC.
+// All Rights Reserved
+//
+// Distributed under the terms of the 2-clause BSD License. The full
+// license is in the file LICENSE, distributed as part of this software.
+
+#ifndef MBEAT_TSTAMP_H
+#define MBEAT_TSTAMP_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+// Timestamp sources.
+#define TS_REALTIME 0 // System and steady clock are read for each timestamp.
+#define TS_TAI      1 // Same as above, with the system time on the TAI scale.
+#define TS_RAW      2 // Steady clock is read, system time is derived.
+#define TS_TSC      3 // Time Stamp Counter is read, both times are derived.
+
+// Period of re-anchoring the derived times to the system clocks.
+#define TS_ANCHOR_PERIOD 1000000000
+
+bool tstamp_select(const char* name);
+void tstamp_now(uint64_t* rt, uint64_t* mt);
+void tstamp_report(void);
+
+#endif
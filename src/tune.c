@@ -0,0 +1,195 @@
+// Copyright (c) 2017-2018 Two Sigma Open Source, LLC.
+// All Rights Reserved
+//
+// Distributed under the terms of the 2-clause BSD License. The full
+// license is in the file LICENSE, distributed as part of this software.
+
+// The sched_setaffinity(2) function is a GNU extension on Linux.
+#if defined(__linux__) && !defined(MBEAT_FORCE_POSIX)
+  #define _GNU_SOURCE
+#endif
+
+#include "platform.h"
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sched.h>
+
+#include "tune.h"
+#include "common.h"
+
+
+// Size of the stack that is faulted in ahead of the run.
+#define STACK_PREFAULT (512 * 1024)
+
+// Alignment of transparent huge pages.
+#define HUGE_PAGE (2 * 1024 * 1024)
+
+/// Power management latency request, held open for the lifetime of the
+/// process, as the kernel drops the request once the file is closed.
+static int dma_fd = -1;
+
+/// Advise the kernel to back a buffer with huge pages. The advice has to be
+/// given before the buffer is first touched, and applies only to the huge
+/// pages that fit within the buffer.
+///
+/// @param[in] addr buffer
+/// @param[in] len  length of the buffer in bytes
+void
+tune_advise(void* addr, const size_t len)
+{
+#if defined(MADV_HUGEPAGE)
+  uintptr_t start;
+  uintptr_t end;
+
+  start = ((uintptr_t)addr + HUGE_PAGE - 1) & ~(uintptr_t)(HUGE_PAGE - 1);
+  end   = ((uintptr_t)addr + len) & ~(uintptr_t)(HUGE_PAGE - 1);
+  if (end <= start) {
+    notify(NL_DEBUG, false, "Buffer of %zu bytes is too small for huge "
+           "pages", len);
+    return;
+  }
+
+  if (madvise((void*)start, end - start, MADV_HUGEPAGE) == -1)
+    notify(NL_WARN, true, "Unable to back %zu bytes with huge pages",
+           (size_t)(end - start));
+  else
+    notify(NL_DEBUG, false, "Backing %zu bytes with huge pages",
+           (size_t)(end - start));
+#else
+  (void)addr;
+  (void)len;
+
+  notify(NL_WARN, false, "Huge pages are not supported on this platform");
+#endif
+}
+
+/// Pin the process to a CPU.
+/// @return status code
+///
+/// @param[in] cpu CPU number
+bool
+tune_pin(const uint64_t cpu)
+{
+#if defined(MBEAT_HAVE_AFFINITY)
+  cpu_set_t set;
+
+  CPU_ZERO(&set);
+  CPU_SET((int)cpu, &set);
+  if (sched_setaffinity(0, sizeof(set), &set) == -1) {
+    notify(NL_WARN, true, "Unable to pin the process to CPU %" PRIu64, cpu);
+    return false;
+  }
+
+  notify(NL_INFO, false, "Pinned the process to CPU %" PRIu64, cpu);
+  return true;
+#else
+  notify(NL_WARN, false, "Pinning to CPU %" PRIu64 " is not supported on "
+         "this platform", cpu);
+  return false;
+#endif
+}
+
+/// Fault in the stack ahead of the run, so that deeper calls do not take
+/// page faults once the memory is locked.
+static void
+prefault_stack(void)
+{
+  volatile char stack[STACK_PREFAULT];
+  size_t i;
+
+  for (i = 0; i < sizeof(stack); i += 4096)
+    stack[i] = 0;
+}
+
+/// Lock all current and future memory of the process, which also faults in
+/// all of its buffers.
+/// @return status code
+static bool
+lock_memory(void)
+{
+  if (mlockall(MCL_CURRENT | MCL_FUTURE) == -1) {
+    notify(NL_WARN, true, "Unable to lock the process memory");
+    return false;
+  }
+
+  prefault_stack();
+  notify(NL_INFO, false, "Locked and faulted in the process memory");
+  return true;
+}
+
+/// Run the process with a real-time priority.
+/// @return status code
+///
+/// @param[in] prio priority
+static bool
+raise_priority(const uint64_t prio)
+{
+  struct sched_param sp;
+
+  memset(&sp, 0, sizeof(sp));
+  sp.sched_priority = (int)prio;
+  if (sched_setscheduler(0, SCHED_FIFO, &sp) == -1) {
+    notify(NL_WARN, true, "Unable to set the SCHED_FIFO priority %" PRIu64,
+           prio);
+    return false;
+  }
+
+  notify(NL_INFO, false, "Running with the SCHED_FIFO priority %" PRIu64,
+         prio);
+  return true;
+}
+
+/// Prevent the processors from entering deep idle states for the lifetime of
+/// the process.
+/// @return status code
+static bool
+hold_dma_latency(void)
+{
+  int32_t lat;
+
+  dma_fd = open("/dev/cpu_dma_latency", O_WRONLY);
+  if (dma_fd == -1) {
+    notify(NL_WARN, true, "Unable to open /dev/cpu_dma_latency");
+    return false;
+  }
+
+  lat = 0;
+  if (write(dma_fd, &lat, sizeof(lat)) != (ssize_t)sizeof(lat)) {
+    notify(NL_WARN, true, "Unable to request zero wakeup latency");
+    close(dma_fd);
+    dma_fd = -1;
+    return false;
+  }
+
+  notify(NL_INFO, false, "Holding the wakeup latency of the CPUs at zero");
+  return true;
+}
+
+/// Apply the low-latency tuning of the host and report which steps
+/// succeeded. None of the steps is required, as the run is still valid
+/// without them.
+///
+/// @param[in] prio real-time priority
+void
+tune_latency(const uint64_t prio)
+{
+  unsigned int done;
+
+  done = 0;
+  done += lock_memory()        ? 1 : 0;
+  done += raise_priority(prio) ? 1 : 0;
+  done += hold_dma_latency()   ? 1 : 0;
+
+  notify(done == 3 ? NL_INFO : NL_WARN, false, "Latency mode applied %u of 3 "
+         "steps", done);
+}
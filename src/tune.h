@@ -0,0 +1,25 @@
+// Copyright (c) 2017-2018 Two Sigma Open Source, LLC.
+// All Rights Reserved
+//
+// Distributed under the terms of the 2-clause BSD License. The full
+// license is in the file LICENSE, distributed as part of this software.
+
+#ifndef MBEAT_TUNE_H
+#define MBEAT_TUNE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+// Default real-time priority of the latency mode.
+#define TUNE_PRIORITY 50
+
+// Highest CPU number accepted for pinning.
+#define TUNE_CPU_MAX 1023
+
+void tune_advise(void* addr, const size_t len);
+bool tune_pin(const uint64_t cpu);
+void tune_latency(const uint64_t prio);
+
+#endif
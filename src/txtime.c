@@ -0,0 +1,479 @@
+// Copyright (c) 2017-2018 Two Sigma Open Source, LLC.
+// All Rights Reserved
+//
+// Distributed under the terms of the 2-clause BSD License. The full
+// license is in the file LICENSE, distributed as part of this software.
+
+#include "platform.h"
+
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#include <netinet/in.h>
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+
+#if defined(MBEAT_HAVE_TXTIME)
+  #include <linux/errqueue.h>
+  #include <linux/net_tstamp.h>
+#endif
+
+#include "txtime.h"
+#include "common.h"
+
+
+#if defined(MBEAT_HAVE_TXTIME)
+
+// Older C libraries do not expose the launch time constants, even though the
+// kernel supports them.
+#ifndef SO_TXTIME
+  #define SO_TXTIME 61
+#endif
+#ifndef SCM_TXTIME
+  #define SCM_TXTIME SO_TXTIME
+#endif
+
+/// Enable launch times on a socket.
+/// @return status code
+///
+/// @param[in] sock socket
+/// @param[in] clk  clock of the launch times
+bool
+tx_enable(const int sock, const clockid_t clk)
+{
+  struct sock_txtime stx;
+
+  // Let the kernel report datagrams dropped by the queueing discipline.
+  stx.clockid = clk;
+  stx.flags   = SOF_TXTIME_REPORT_ERRORS;
+  if (setsockopt(sock, SOL_SOCKET, SO_TXTIME, &stx, sizeof(stx)) == -1) {
+    notify(NL_ERROR, true, "Unable to enable launch times");
+    return false;
+  }
+
+  return true;
+}
+
+/// Enable software transmit timestamps on a socket.
+/// @return status code
+///
+/// @param[in] sock socket
+bool
+tx_stamp(const int sock)
+{
+  int flags;
+
+  // Request a timestamp of each datagram upon its hand-over to the device,
+  // identified by a per-socket counter rather than the datagram data.
+  flags = SOF_TIMESTAMPING_TX_SOFTWARE
+        | SOF_TIMESTAMPING_SOFTWARE
+        | SOF_TIMESTAMPING_OPT_ID
+        | SOF_TIMESTAMPING_OPT_TSONLY;
+  if (setsockopt(sock, SOL_SOCKET, SO_TIMESTAMPING,
+                 &flags, sizeof(flags)) == -1) {
+    notify(NL_ERROR, true, "Unable to enable transmit timestamps");
+    return false;
+  }
+
+  return true;
+}
+
+/// Reset the launch time state of an endpoint.
+/// @return status code
+///
+/// @param[out] ts    launch time state
+/// @param[in]  flows number of flows whose last transmit time is kept
+bool
+tx_create(tx_state* ts, const uint64_t flows)
+{
+  uint64_t i;
+
+  memset(ts, 0, sizeof(*ts));
+  ts->ts_min = INT64_MAX;
+  ts->ts_max = INT64_MIN;
+
+  if (flows == 0)
+    return true;
+
+  ts->ts_ftime = calloc(flows, sizeof(*ts->ts_ftime));
+  ts->ts_fsnum = malloc(flows * sizeof(*ts->ts_fsnum));
+  if (ts->ts_ftime == NULL || ts->ts_fsnum == NULL) {
+    notify(NL_ERROR, true, "Unable to allocate transmit times of %" PRIu64
+           " flows", flows);
+    tx_free(ts);
+    return false;
+  }
+
+  for (i = 0; i < flows; i++)
+    ts->ts_fsnum[i] = TX_NO_SNUM;
+  ts->ts_fcnt = flows;
+
+  return true;
+}
+
+/// Release the memory held by the launch time state.
+///
+/// @param[in] ts launch time state
+void
+tx_free(tx_state* ts)
+{
+  free(ts->ts_ftime);
+  free(ts->ts_fsnum);
+  ts->ts_ftime = NULL;
+  ts->ts_fsnum = NULL;
+  ts->ts_fcnt  = 0;
+}
+
+/// Fill the control message that carries the launch time of a datagram.
+///
+/// @param[out] buf control message buffer
+/// @param[in]  len length of the buffer
+/// @param[in]  launch launch time in nanoseconds
+void
+tx_control(void* buf, const size_t len, const uint64_t launch)
+{
+  struct msghdr msg;
+  struct cmsghdr* cmsg;
+
+  msg.msg_control    = buf;
+  msg.msg_controllen = len;
+
+  cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type  = SCM_TXTIME;
+  cmsg->cmsg_len   = CMSG_LEN(sizeof(launch));
+  memcpy(CMSG_DATA(cmsg), &launch, sizeof(launch));
+}
+
+/// Register a successful send of a datagram. The kernel assigns consecutive
+/// timestamp identifiers to all successful sends on a socket.
+///
+/// @param[in] ts    launch time state
+/// @param[in] sched scheduled system time in nanoseconds
+/// @param[in] flow  flow index
+/// @param[in] snum  sequence number (TX_NO_SNUM for other datagrams)
+void
+tx_sent(tx_state* ts,
+        const uint64_t sched,
+        const uint64_t flow,
+        const uint64_t snum)
+{
+  uint32_t idx;
+
+  idx = ts->ts_next % TX_WINDOW;
+  ts->ts_sched[idx] = sched;
+  ts->ts_key[idx]   = ts->ts_next;
+  ts->ts_flow[idx]  = (uint32_t)flow;
+  ts->ts_snum[idx]  = snum;
+  ts->ts_next++;
+  ts->ts_pend++;
+}
+
+/// Obtain the transmit time of the datagram that preceded a datagram of a
+/// flow, to be carried as its follow-up.
+/// @return system time in nanoseconds, or zero if unknown
+///
+/// @param[in] ts   launch time state
+/// @param[in] flow flow index
+/// @param[in] snum sequence number of the datagram
+uint64_t
+tx_follow_up(const tx_state* ts, const uint64_t flow, const uint64_t snum)
+{
+  if (flow >= ts->ts_fcnt || ts->ts_fsnum[flow] + 1 != snum)
+    return 0;
+
+  return ts->ts_ftime[flow];
+}
+
+/// Compare the transmit timestamp of a datagram with its schedule.
+///
+/// @param[in] ts  launch time state
+/// @param[in] key timestamp identifier
+/// @param[in] tv  transmit timestamp
+static void
+tx_complete(tx_state* ts, const uint32_t key, const struct timespec tv)
+{
+  uint32_t idx;
+  uint64_t now;
+  int64_t dev;
+
+  if (ts->ts_pend > 0)
+    ts->ts_pend--;
+
+  idx = key % TX_WINDOW;
+  if (ts->ts_key[idx] != key) {
+    ts->ts_lost++;
+    return;
+  }
+
+  to_nanos(&now, tv);
+  dev = (int64_t)(now - ts->ts_sched[idx]);
+
+  // Keep the transmit time of the last datagram of the flow.
+  if (ts->ts_snum[idx] != TX_NO_SNUM && ts->ts_flow[idx] < ts->ts_fcnt) {
+    ts->ts_ftime[ts->ts_flow[idx]] = now;
+    ts->ts_fsnum[ts->ts_flow[idx]] = ts->ts_snum[idx];
+  }
+
+  ts->ts_cnt++;
+  ts->ts_sum += dev;
+  if (dev < ts->ts_min)
+    ts->ts_min = dev;
+  if (dev > ts->ts_max)
+    ts->ts_max = dev;
+  if (dev > 0)
+    ts->ts_late++;
+
+  hist_add(&ts->ts_hist, (uint64_t)(dev < 0 ? -dev : dev));
+}
+
+/// Process all timestamps and errors available on the error queue of a socket.
+/// @return status code
+///
+/// @param[in] ts   launch time state
+/// @param[in] sock socket
+bool
+tx_reap(tx_state* ts, const int sock)
+{
+  struct msghdr msg;
+  struct cmsghdr* cmsg;
+  struct sock_extended_err* serr;
+  struct scm_timestamping* tss;
+  char cdata[256];
+
+  while (ts->ts_pend > 0) {
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_control    = cdata;
+    msg.msg_controllen = sizeof(cdata);
+
+    if (recvmsg(sock, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) == -1) {
+      if (errno == EAGAIN)
+        return true;
+
+      notify(NL_ERROR, true, "Unable to read the socket error queue");
+      return false;
+    }
+
+    // The timestamp precedes the extended error that identifies the datagram.
+    tss = NULL;
+    for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL;
+         cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+      if (cmsg->cmsg_level == SOL_SOCKET
+       && cmsg->cmsg_type  == SCM_TIMESTAMPING) {
+        tss = (struct scm_timestamping*)CMSG_DATA(cmsg);
+        continue;
+      }
+
+      if (cmsg->cmsg_level != IPPROTO_IP || cmsg->cmsg_type != IP_RECVERR)
+        continue;
+
+      serr = (struct sock_extended_err*)CMSG_DATA(cmsg);
+      if (serr->ee_origin == SO_EE_ORIGIN_TIMESTAMPING && tss != NULL) {
+        tx_complete(ts, serr->ee_data, tss->ts[0]);
+        continue;
+      }
+
+      // Datagrams dropped by the queueing discipline are never transmitted.
+      if (serr->ee_origin == SO_EE_ORIGIN_TXTIME) {
+        if (serr->ee_code == SO_EE_CODE_TXTIME_MISSED)
+          ts->ts_miss++;
+        else
+          ts->ts_inv++;
+
+        if (ts->ts_pend > 0)
+          ts->ts_pend--;
+      }
+    }
+  }
+
+  return true;
+}
+
+/// Wait for the transmit timestamps of all datagrams sent on a socket.
+/// @return status code
+///
+/// @param[in] ts   launch time state
+/// @param[in] sock socket
+/// @param[in] dur  maximal duration of the wait in nanoseconds
+bool
+tx_drain(tx_state* ts, const int sock, const uint64_t dur)
+{
+  struct pollfd pfd;
+  struct timespec tv;
+  uint64_t now;
+  uint64_t end;
+  int ret;
+
+  clock_gettime(CLOCK_MONOTONIC, &tv);
+  to_nanos(&end, tv);
+  end += dur;
+
+  while (1) {
+    if (!tx_reap(ts, sock))
+      return false;
+
+    if (ts->ts_pend == 0)
+      return true;
+
+    clock_gettime(CLOCK_MONOTONIC, &tv);
+    to_nanos(&now, tv);
+    if (now >= end)
+      break;
+
+    // Pending error queue entries are signalled by the POLLERR event, which
+    // does not need to be requested.
+    pfd.fd      = sock;
+    pfd.events  = 0;
+    pfd.revents = 0;
+    ret = poll(&pfd, 1, (int)((end - now + 999999) / 1000000));
+    if (ret == -1 && errno != EINTR) {
+      notify(NL_ERROR, true, "Unable to wait for transmit timestamps");
+      return false;
+    }
+  }
+
+  notify(NL_WARN, false, "Timed out waiting for %" PRIu64
+         " transmit timestamps", ts->ts_pend);
+  return true;
+}
+
+#else
+
+/// Enable launch times on a socket.
+/// @return status code
+///
+/// @param[in] sock socket
+/// @param[in] clk  clock of the launch times
+bool
+tx_enable(const int sock, const clockid_t clk)
+{
+  (void)sock;
+  (void)clk;
+
+  notify(NL_ERROR, false, "Launch times are not supported on this platform");
+  return false;
+}
+
+/// Enable software transmit timestamps on a socket.
+/// @return status code
+///
+/// @param[in] sock socket
+bool
+tx_stamp(const int sock)
+{
+  (void)sock;
+
+  notify(NL_ERROR, false, "Transmit timestamps are not supported on this "
+         "platform");
+  return false;
+}
+
+/// Reset the launch time state of an endpoint.
+/// @return status code
+///
+/// @param[out] ts    launch time state
+/// @param[in]  flows number of flows whose last transmit time is kept
+bool
+tx_create(tx_state* ts, const uint64_t flows)
+{
+  (void)flows;
+
+  memset(ts, 0, sizeof(*ts));
+  return true;
+}
+
+/// Release the memory held by the launch time state.
+///
+/// @param[in] ts launch time state
+void
+tx_free(tx_state* ts)
+{
+  (void)ts;
+}
+
+/// Fill the control message that carries the launch time of a datagram.
+///
+/// @param[out] buf control message buffer
+/// @param[in]  len length of the buffer
+/// @param[in]  launch launch time in nanoseconds
+void
+tx_control(void* buf, const size_t len, const uint64_t launch)
+{
+  (void)buf;
+  (void)len;
+  (void)launch;
+}
+
+/// Register a successful send of a datagram.
+///
+/// @param[in] ts    launch time state
+/// @param[in] sched scheduled system time in nanoseconds
+/// @param[in] flow  flow index
+/// @param[in] snum  sequence number (TX_NO_SNUM for other datagrams)
+void
+tx_sent(tx_state* ts,
+        const uint64_t sched,
+        const uint64_t flow,
+        const uint64_t snum)
+{
+  (void)ts;
+  (void)sched;
+  (void)flow;
+  (void)snum;
+}
+
+/// Obtain the transmit time of the datagram that preceded a datagram of a
+/// flow, to be carried as its follow-up.
+/// @return system time in nanoseconds, or zero if unknown
+///
+/// @param[in] ts   launch time state
+/// @param[in] flow flow index
+/// @param[in] snum sequence number of the datagram
+uint64_t
+tx_follow_up(const tx_state* ts, const uint64_t flow, const uint64_t snum)
+{
+  (void)ts;
+  (void)flow;
+  (void)snum;
+
+  return 0;
+}
+
+/// Process all timestamps and errors available on the error queue of a socket.
+/// @return status code
+///
+/// @param[in] ts   launch time state
+/// @param[in] sock socket
+bool
+tx_reap(tx_state* ts, const int sock)
+{
+  (void)ts;
+  (void)sock;
+
+  return true;
+}
+
+/// Wait for the transmit timestamps of all datagrams sent on a socket.
+/// @return status code
+///
+/// @param[in] ts   launch time state
+/// @param[in] sock socket
+/// @param[in] dur  maximal duration of the wait in nanoseconds
+bool
+tx_drain(tx_state* ts, const int sock, const uint64_t dur)
+{
+  (void)ts;
+  (void)sock;
+  (void)dur;
+
+  return true;
+}
+
+#endif
@@ -0,0 +1,63 @@
+// Copyright (c) 2017-2018 Two Sigma Open Source, LLC.
+// All Rights Reserved
+//
+// Distributed under the terms of the 2-clause BSD License. The full
+// license is in the file LICENSE, distributed as part of this software.
+
+#ifndef MBEAT_TXTIME_H
+#define MBEAT_TXTIME_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+
+#include "types.h"
+#include "flow.h"
+
+
+// Number of recent sends whose scheduled time is remembered, so that it can be
+// matched with the transmit timestamp reported by the kernel.
+#define TX_WINDOW 4096
+
+// Sequence number of sends that do not belong to the sequence of a flow.
+#define TX_NO_SNUM UINT64_MAX
+
+/// Launch time and transmit timestamp state of a single endpoint.
+typedef struct _tx_state {
+  uint64_t  ts_sched[TX_WINDOW]; ///< Scheduled system time of recent sends.
+  uint32_t  ts_key[TX_WINDOW];   ///< Timestamp identifier of recent sends.
+  uint32_t  ts_flow[TX_WINDOW];  ///< Flow index of recent sends.
+  uint64_t  ts_snum[TX_WINDOW];  ///< Sequence number of recent sends.
+  uint64_t* ts_ftime; ///< Transmit time of the last timestamped send per flow.
+  uint64_t* ts_fsnum; ///< Sequence number of the last timestamped send per flow.
+  uint64_t  ts_fcnt;  ///< Number of flows.
+  uint32_t  ts_next; ///< Timestamp identifier of the next send.
+  uint64_t  ts_pend; ///< Sends awaiting their transmit timestamp.
+  uint64_t  ts_cnt;  ///< Number of matched transmit timestamps.
+  uint64_t  ts_late; ///< Datagrams transmitted after their launch time.
+  int64_t   ts_sum;  ///< Sum of the signed deviations in nanoseconds.
+  int64_t   ts_min;  ///< Minimal signed deviation in nanoseconds.
+  int64_t   ts_max;  ///< Maximal signed deviation in nanoseconds.
+  uint64_t  ts_miss; ///< Datagrams dropped for missing their launch time.
+  uint64_t  ts_inv;  ///< Datagrams dropped for invalid launch parameters.
+  uint64_t  ts_lost; ///< Timestamps without a known scheduled time.
+  histogram ts_hist; ///< Absolute deviations in nanoseconds.
+} tx_state;
+
+bool tx_enable(const int sock, const clockid_t clk);
+bool tx_stamp(const int sock);
+bool tx_create(tx_state* ts, const uint64_t flows);
+void tx_free(tx_state* ts);
+void tx_control(void* buf, const size_t len, const uint64_t launch);
+void tx_sent(tx_state* ts,
+             const uint64_t sched,
+             const uint64_t flow,
+             const uint64_t snum);
+uint64_t tx_follow_up(const tx_state* ts,
+                      const uint64_t flow,
+                      const uint64_t snum);
+bool tx_reap(tx_state* ts, const int sock);
+bool tx_drain(tx_state* ts, const int sock, const uint64_t dur);
+
+#endif
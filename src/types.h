@@ -15,14 +15,14 @@
 #define INAME_LEN 16 // Maximal interface name length.
 #define HNAME_LEN 64 // Maximal hostname length.
 
-/// Payload of the datagram (136 bytes).
+/// Payload of the datagram (136 bytes), optionally followed by padding.
 typedef struct _payload {
   uint32_t pl_magic;            ///< Magic identifier.
   uint8_t  pl_fver;             ///< Format version.
   uint8_t  pl_ttl;              ///< Source Time-To-Live.
   uint16_t pl_mport;            ///< Multicast IPv4 port.
   uint32_t pl_maddr;            ///< Multicast IPv4 address.
-  uint32_t pl_pad;              ///< Padding (unused).
+  uint32_t pl_plen;             ///< Datagram length including padding.
   uint64_t pl_rtime;            ///< System time of departure (ns).
   uint64_t pl_mtime;            ///< Steady time of departure (ns).
   uint64_t pl_key;              ///< Unique key.
@@ -32,7 +32,50 @@ typedef struct _payload {
   char     pl_hname[HNAME_LEN]; ///< Publisher's hostname.
 } payload;
 
-/// Raw binary output format (248 bytes).
+/// Compact payload of the datagram (72 bytes), optionally followed by padding.
+/// The publisher is identified by its ID, which announcements map to names.
+typedef struct _compact {
+  uint32_t cp_magic;            ///< Magic identifier.
+  uint8_t  cp_fver;             ///< Format version.
+  uint8_t  cp_ttl;              ///< Source Time-To-Live.
+  uint16_t cp_mport;            ///< Multicast IPv4 port.
+  uint32_t cp_maddr;            ///< Multicast IPv4 address.
+  uint16_t cp_plen;             ///< Datagram length including padding.
+  uint8_t  cp_type;             ///< Datagram type.
+  uint8_t  cp_pad;              ///< Padding (unused).
+  uint64_t cp_pid;              ///< Publisher ID.
+  uint64_t cp_rtime;            ///< System time of departure (ns).
+  uint64_t cp_mtime;            ///< Steady time of departure (ns).
+  uint64_t cp_ttime;            ///< Transmit time of the previous datagram (ns).
+  uint64_t cp_key;              ///< Unique key.
+  uint64_t cp_snum;             ///< Sequence iteration counter.
+  uint64_t cp_slen;             ///< Sequence length.
+} compact;
+
+/// Announcement of the names of a publisher (112 bytes).
+typedef struct _announce {
+  uint32_t an_magic;            ///< Magic identifier.
+  uint8_t  an_fver;             ///< Format version.
+  uint8_t  an_ttl;              ///< Source Time-To-Live.
+  uint16_t an_mport;            ///< Multicast IPv4 port.
+  uint32_t an_maddr;            ///< Multicast IPv4 address.
+  uint16_t an_plen;             ///< Datagram length.
+  uint8_t  an_type;             ///< Datagram type.
+  uint8_t  an_pad;              ///< Padding (unused).
+  uint64_t an_pid;              ///< Publisher ID.
+  uint64_t an_key;              ///< Unique key.
+  char     an_iname[INAME_LEN]; ///< Publisher's interface name.
+  char     an_hname[HNAME_LEN]; ///< Publisher's hostname.
+} announce;
+
+/// Datagram of any of the supported payload formats.
+typedef union _datagram {
+  payload  dg_pl;               ///< Payload with names (format 4).
+  compact  dg_cp;               ///< Compact payload (format 5).
+  announce dg_an;               ///< Announcement (format 5).
+} datagram;
+
+/// Raw binary output format (240 bytes).
 typedef struct _raw_output {
   payload  ro_pl;               ///< Received payload.
   char     ro_iname[INAME_LEN]; ///< Subscriber's interface name.
@@ -44,12 +87,66 @@ typedef struct _raw_output {
   uint8_t  ro_pad[6];           ///< Padding (unused).
 } raw_output;
 
+/// Raw binary rollup format (280 bytes), optionally followed by the counters
+/// of the latency buckets.
+typedef struct _raw_rollup {
+  uint64_t rr_start;             ///< System time of the interval start (ns).
+  uint64_t rr_dur;               ///< Duration of the interval (ns).
+  uint64_t rr_key;               ///< Unique key.
+  uint32_t rr_maddr;             ///< Multicast IPv4 address.
+  uint16_t rr_nbkt;              ///< Number of latency buckets that follow.
+  uint8_t  rr_pad[2];            ///< Padding (unused).
+  char     rr_piname[INAME_LEN]; ///< Publisher's interface name.
+  char     rr_phname[HNAME_LEN]; ///< Publisher's hostname.
+  char     rr_iname[INAME_LEN];  ///< Subscriber's interface name.
+  char     rr_hname[HNAME_LEN];  ///< Subscriber's hostname.
+  uint64_t rr_recv;              ///< Received datagrams.
+  uint64_t rr_bytes;             ///< Received bytes.
+  uint64_t rr_lost;              ///< Datagrams missing from the sequence.
+  uint64_t rr_gaps;              ///< Gaps in the sequence.
+  uint64_t rr_dups;              ///< Duplicate datagrams.
+  uint64_t rr_reord;             ///< Datagrams that arrived out of order.
+  uint64_t rr_lmin;              ///< Minimal latency (ns).
+  uint64_t rr_lmean;             ///< Mean latency (ns).
+  uint64_t rr_lmax;              ///< Maximal latency (ns).
+  uint64_t rr_lp99;              ///< 99th percentile of the latency (ns).
+  uint64_t rr_drops;             ///< Datagrams dropped by the kernel.
+} raw_rollup;
+
+/// Simulated publisher flow.
+typedef struct _pub_flow {
+  uint64_t pf_key;              ///< Unique key.
+  uint64_t pf_snum;             ///< Next sequence number.
+  char     pf_hname[HNAME_LEN]; ///< Synthetic hostname.
+  char     pf_isfx[INAME_LEN];  ///< Suffix of the synthetic interface name.
+  size_t   pf_islen;            ///< Length of the interface name suffix.
+} pub_flow;
+
 /// Connection between a local interface and a multicast group.
 typedef struct _endpoint {
   int               ep_sock;             ///< Connection socket.
   struct in_addr    ep_maddr;            ///< Multicast address.
   struct in_addr    ep_iaddr;            ///< Local interface address.
   char              ep_iname[INAME_LEN]; ///< Local interface name.
+  uint64_t          ep_dgrams;           ///< Datagrams in current interval.
+  uint64_t          ep_bytes;            ///< Bytes in current interval.
+  uint64_t          ep_wblk;             ///< Sends that would block.
+  uint64_t          ep_nobuf;            ///< Sends without buffer space.
+  uint64_t          ep_fail;             ///< Sends failed for other reasons.
+  uint64_t*         ep_pids;             ///< Publisher IDs of the flows.
+  struct _zc_state* ep_zc;               ///< Zero-copy send state.
+  struct _tx_state* ep_tx;               ///< Launch time state.
+  int               ep_node;             ///< NUMA node of the interface.
+  int               ep_cpu;              ///< CPU that delivered the traffic.
+  unsigned int      ep_napi;             ///< NIC queue that received it.
+  uint64_t          ep_xnode;            ///< Datagrams from other nodes.
+  uint64_t          ep_flap;             ///< Steady time of the link change.
+  uint8_t           ep_rjn;              ///< The groups were joined again.
+  uint8_t           ep_chk;              ///< The interface has to be checked.
+  uint32_t          ep_ovfl;             ///< Drop counter of the socket.
+  uint32_t          ep_oshd;             ///< Output shard of the records.
+  uint64_t          ep_drops;            ///< Datagrams dropped by the kernel.
+  uint64_t          ep_rdrop;            ///< Drops of the closed rollup.
   struct _endpoint* ep_next;             ///< Link to the next endpoint.
 } endpoint;
 
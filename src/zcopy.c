@@ -0,0 +1,369 @@
+// Copyright (c) 2017-2018 Two Sigma Open Source, LLC.
+// All Rights Reserved
+//
+// Distributed under the terms of the 2-clause BSD License. The full
+// license is in the file LICENSE, distributed as part of this software.
+
+#include "platform.h"
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/mman.h>
+
+#include <netinet/in.h>
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+
+#if defined(MBEAT_HAVE_ZEROCOPY)
+  #include <linux/errqueue.h>
+#endif
+
+#include "zcopy.h"
+#include "common.h"
+
+
+#if defined(MBEAT_HAVE_ZEROCOPY)
+
+// Older C libraries do not expose the zero-copy constants, even though the
+// kernel supports them.
+#ifndef SO_ZEROCOPY
+  #define SO_ZEROCOPY 60
+#endif
+#ifndef SO_EE_ORIGIN_ZEROCOPY
+  #define SO_EE_ORIGIN_ZEROCOPY 5
+#endif
+#ifndef SO_EE_CODE_ZEROCOPY_COPIED
+  #define SO_EE_CODE_ZEROCOPY_COPIED 1
+#endif
+
+// Maximal duration of a wait for a single completion in milliseconds.
+#define ZC_TIMEOUT 1000
+
+/// Enable zero-copy sends on a socket.
+/// @return status code
+///
+/// @param[in] sock socket
+bool
+zc_enable(const int sock)
+{
+  int enable;
+
+  enable = 1;
+  if (setsockopt(sock, SOL_SOCKET, SO_ZEROCOPY,
+                 &enable, sizeof(enable)) == -1) {
+    notify(NL_ERROR, true, "Unable to enable zero-copy sends");
+    return false;
+  }
+
+  return true;
+}
+
+/// Create the pinned payloads of an endpoint.
+/// @return status code
+///
+/// @param[out] zs  zero-copy state
+/// @param[in]  cnt number of payloads
+bool
+zc_create(zc_state* zs, const uint64_t cnt)
+{
+  void* addr;
+
+  memset(zs, 0, sizeof(*zs));
+  zs->zs_cnt = cnt;
+  zs->zs_len = cnt * sizeof(datagram);
+
+  // Map the payloads separately from the heap, so that they can be locked in
+  // memory without affecting any other allocation.
+  addr = mmap(NULL, zs->zs_len, PROT_READ | PROT_WRITE,
+              MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (addr == MAP_FAILED) {
+    notify(NL_ERROR, true, "Unable to map %zu bytes of payloads", zs->zs_len);
+    return false;
+  }
+  zs->zs_pl = addr;
+
+  // Pinning the pages is an optimisation only, as the kernel takes its own
+  // references for the duration of each send.
+  if (mlock(zs->zs_pl, zs->zs_len) == -1)
+    notify(NL_WARN, true, "Unable to lock %zu bytes of payloads in memory",
+           zs->zs_len);
+
+  zs->zs_id   = calloc(cnt, sizeof(*zs->zs_id));
+  zs->zs_busy = calloc(cnt, sizeof(*zs->zs_busy));
+  if (zs->zs_id == NULL || zs->zs_busy == NULL) {
+    notify(NL_ERROR, true, "Unable to allocate zero-copy state");
+    zc_free(zs);
+    return false;
+  }
+
+  return true;
+}
+
+/// Release the resources held by the zero-copy state.
+///
+/// @param[in] zs zero-copy state
+void
+zc_free(zc_state* zs)
+{
+  if (zs->zs_pl != NULL)
+    munmap(zs->zs_pl, zs->zs_len);
+
+  free(zs->zs_id);
+  free(zs->zs_busy);
+
+  zs->zs_pl   = NULL;
+  zs->zs_id   = NULL;
+  zs->zs_busy = NULL;
+}
+
+/// Register a successful send of a payload. The kernel assigns consecutive
+/// completion identifiers to all successful sends on a socket.
+///
+/// @param[in] zs  zero-copy state
+/// @param[in] idx payload index
+void
+zc_sent(zc_state* zs, const uint64_t idx)
+{
+  zs->zs_id[idx]   = zs->zs_next++;
+  zs->zs_busy[idx] = 1;
+  zs->zs_pend++;
+}
+
+/// Release all payloads whose sends fall into a range of completions.
+///
+/// @param[in] zs   zero-copy state
+/// @param[in] lo   first completion identifier
+/// @param[in] hi   last completion identifier
+/// @param[in] copy the kernel had to copy the data
+static void
+zc_complete(zc_state* zs, const uint32_t lo, const uint32_t hi, const bool copy)
+{
+  uint64_t i;
+  uint64_t n;
+
+  // The identifiers wrap around, so the range is tested by distance.
+  n = (uint64_t)(uint32_t)(hi - lo) + 1;
+  for (i = 0; i < zs->zs_cnt && zs->zs_pend > 0; i++) {
+    if (zs->zs_busy[i] && (uint32_t)(zs->zs_id[i] - lo) < n) {
+      zs->zs_busy[i] = 0;
+      zs->zs_pend--;
+    }
+  }
+
+  zs->zs_done += n;
+  if (copy)
+    zs->zs_copy += n;
+}
+
+/// Process all completions available on the error queue of a socket.
+/// @return status code
+///
+/// @param[in] zs   zero-copy state
+/// @param[in] sock socket
+bool
+zc_reap(zc_state* zs, const int sock)
+{
+  struct msghdr msg;
+  struct cmsghdr* cmsg;
+  struct sock_extended_err* serr;
+  char cdata[128];
+
+  while (zs->zs_pend > 0) {
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_control    = cdata;
+    msg.msg_controllen = sizeof(cdata);
+
+    if (recvmsg(sock, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) == -1) {
+      if (errno == EAGAIN)
+        return true;
+
+      notify(NL_ERROR, true, "Unable to read the socket error queue");
+      return false;
+    }
+
+    for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL;
+         cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+      if (cmsg->cmsg_level != IPPROTO_IP || cmsg->cmsg_type != IP_RECVERR)
+        continue;
+
+      serr = (struct sock_extended_err*)CMSG_DATA(cmsg);
+      if (serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY || serr->ee_errno != 0)
+        continue;
+
+      zc_complete(zs, serr->ee_info, serr->ee_data,
+                  (serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) != 0);
+    }
+  }
+
+  return true;
+}
+
+/// Wait for the completions of the socket to arrive.
+/// @return status code
+///
+/// @param[in] zs   zero-copy state
+/// @param[in] sock socket
+static bool
+zc_poll(zc_state* zs, const int sock)
+{
+  struct pollfd pfd;
+  int ret;
+
+  // Pending error queue entries are signalled by the POLLERR event, which
+  // does not need to be requested.
+  pfd.fd      = sock;
+  pfd.events  = 0;
+  pfd.revents = 0;
+
+  ret = poll(&pfd, 1, ZC_TIMEOUT);
+  if (ret == -1 && errno != EINTR) {
+    notify(NL_ERROR, true, "Unable to wait for zero-copy completions");
+    return false;
+  }
+
+  if (ret == 0) {
+    notify(NL_ERROR, false, "Timed out waiting for %" PRIu64
+           " zero-copy completions", zs->zs_pend);
+    return false;
+  }
+
+  return zc_reap(zs, sock);
+}
+
+/// Wait until a payload is no longer referenced by the kernel.
+/// @return status code
+///
+/// @param[in] zs   zero-copy state
+/// @param[in] sock socket
+/// @param[in] idx  payload index
+bool
+zc_wait(zc_state* zs, const int sock, const uint64_t idx)
+{
+  if (zs->zs_busy[idx] && !zc_reap(zs, sock))
+    return false;
+
+  while (zs->zs_busy[idx])
+    if (!zc_poll(zs, sock))
+      return false;
+
+  return true;
+}
+
+/// Wait until all sends on a socket have completed.
+/// @return status code
+///
+/// @param[in] zs   zero-copy state
+/// @param[in] sock socket
+bool
+zc_drain(zc_state* zs, const int sock)
+{
+  if (!zc_reap(zs, sock))
+    return false;
+
+  while (zs->zs_pend > 0)
+    if (!zc_poll(zs, sock))
+      return false;
+
+  return true;
+}
+
+#else
+
+/// Enable zero-copy sends on a socket.
+/// @return status code
+///
+/// @param[in] sock socket
+bool
+zc_enable(const int sock)
+{
+  (void)sock;
+
+  notify(NL_ERROR, false, "Zero-copy sends are not supported on this platform");
+  return false;
+}
+
+/// Create the pinned payloads of an endpoint.
+/// @return status code
+///
+/// @param[out] zs  zero-copy state
+/// @param[in]  cnt number of payloads
+bool
+zc_create(zc_state* zs, const uint64_t cnt)
+{
+  (void)cnt;
+
+  memset(zs, 0, sizeof(*zs));
+  return false;
+}
+
+/// Release the resources held by the zero-copy state.
+///
+/// @param[in] zs zero-copy state
+void
+zc_free(zc_state* zs)
+{
+  (void)zs;
+}
+
+/// Register a successful send of a payload.
+///
+/// @param[in] zs  zero-copy state
+/// @param[in] idx payload index
+void
+zc_sent(zc_state* zs, const uint64_t idx)
+{
+  (void)zs;
+  (void)idx;
+}
+
+/// Process all completions available on the error queue of a socket.
+/// @return status code
+///
+/// @param[in] zs   zero-copy state
+/// @param[in] sock socket
+bool
+zc_reap(zc_state* zs, const int sock)
+{
+  (void)zs;
+  (void)sock;
+
+  return true;
+}
+
+/// Wait until a payload is no longer referenced by the kernel.
+/// @return status code
+///
+/// @param[in] zs   zero-copy state
+/// @param[in] sock socket
+/// @param[in] idx  payload index
+bool
+zc_wait(zc_state* zs, const int sock, const uint64_t idx)
+{
+  (void)zs;
+  (void)sock;
+  (void)idx;
+
+  return true;
+}
+
+/// Wait until all sends on a socket have completed.
+/// @return status code
+///
+/// @param[in] zs   zero-copy state
+/// @param[in] sock socket
+bool
+zc_drain(zc_state* zs, const int sock)
+{
+  (void)zs;
+  (void)sock;
+
+  return true;
+}
+
+#endif
@@ -0,0 +1,55 @@
+// Copyright (c) 2017-2018 Two Sigma Open Source, LLC.
+// All Rights Reserved
+//
+// Distributed under the terms of the 2-clause BSD License. The full
+// license is in the file LICENSE, distributed as part of this software.
+
+#ifndef MBEAT_ZCOPY_H
+#define MBEAT_ZCOPY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include <sys/socket.h>
+
+#include "platform.h"
+#include "types.h"
+
+
+// Flag that requests a zero-copy send, which is missing from the headers of
+// older C libraries.
+#if defined(MBEAT_HAVE_ZEROCOPY)
+  #if defined(MSG_ZEROCOPY)
+    #define ZC_SEND_FLAG MSG_ZEROCOPY
+  #else
+    #define ZC_SEND_FLAG 0x4000000
+  #endif
+#else
+  #define ZC_SEND_FLAG 0
+#endif
+
+/// Zero-copy send state of a single endpoint. The kernel references the
+/// payload memory until it reports the completion of the send, therefore each
+/// payload is rewritten only after its previous send has completed.
+typedef struct _zc_state {
+  datagram* zs_pl;   ///< Pinned payloads, one per flow.
+  uint32_t* zs_id;   ///< Completion identifier of the last send of a payload.
+  uint8_t*  zs_busy; ///< Payloads that are still referenced by the kernel.
+  size_t    zs_len;  ///< Length of the payload mapping.
+  uint64_t  zs_cnt;  ///< Number of payloads.
+  uint64_t  zs_pend; ///< Number of sends awaiting completion.
+  uint32_t  zs_next; ///< Completion identifier of the next send.
+  uint64_t  zs_done; ///< Number of completed sends.
+  uint64_t  zs_copy; ///< Number of sends that the kernel had to copy.
+} zc_state;
+
+bool zc_enable(const int sock);
+bool zc_create(zc_state* zs, const uint64_t cnt);
+void zc_free(zc_state* zs);
+void zc_sent(zc_state* zs, const uint64_t idx);
+bool zc_reap(zc_state* zs, const int sock);
+bool zc_wait(zc_state* zs, const int sock, const uint64_t idx);
+bool zc_drain(zc_state* zs, const int sock);
+
+#endif